@@ -0,0 +1,34 @@
+/*!
+  \file arena.cc
+  \brief implementation of monotonic string storage
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/arena.h"
+
+#include <cstring>
+
+std::string_view initialize_output_directories::string_arena::store(
+    const char *data, std::size_t size) {
+  if (!size) return std::string_view();
+  _bytes_used += size;
+  if (size > _chunk_size) {
+    // oversized entries get a dedicated chunk, leaving the current one open
+    _chunks.push_back(std::unique_ptr<char[]>(new char[size]));
+    _bytes_reserved += size;
+    memcpy(_chunks.rbegin()->get(), data, size);
+    return std::string_view(_chunks.rbegin()->get(), size);
+  }
+  if (size > _chunk_remaining) {
+    _chunks.push_back(std::unique_ptr<char[]>(new char[_chunk_size]));
+    _bytes_reserved += _chunk_size;
+    _cursor = _chunks.rbegin()->get();
+    _chunk_remaining = _chunk_size;
+  }
+  memcpy(_cursor, data, size);
+  std::string_view res(_cursor, size);
+  _cursor += size;
+  _chunk_remaining -= size;
+  return res;
+}
@@ -0,0 +1,72 @@
+/*!
+  \file arena.h
+  \brief monotonic storage for many small immutable strings
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_ARENA_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_ARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace initialize_output_directories {
+/*!
+  \class string_arena
+  \brief append-only byte arena handing out views into large chunks
+
+  Phenotype databases are millions of short cells. Storing each as its
+  own std::string costs an object header per cell and, for anything
+  past the small string limit, a heap allocation. The arena instead
+  copies cell bytes end to end into chunks of a fixed size, and every
+  chunk is released at once when the arena is destroyed. Views stay
+  valid for the lifetime of the arena; it cannot be copied.
+ */
+class string_arena {
+ public:
+  /*!
+    \brief constructor
+    @param chunk_size bytes per chunk; larger strings get their own chunk
+   */
+  explicit string_arena(std::size_t chunk_size = 1024 * 1024)
+      : _chunk_size(chunk_size),
+        _chunk_remaining(0),
+        _bytes_reserved(0),
+        _bytes_used(0),
+        _cursor(0) {}
+  string_arena(const string_arena &) = delete;
+  string_arena &operator=(const string_arena &) = delete;
+  ~string_arena() throw() {}
+
+  /*!
+    \brief copy bytes into the arena
+    @param data start of bytes to copy
+    @param size number of bytes to copy
+    \return view of the stored copy
+   */
+  std::string_view store(const char *data, std::size_t size);
+
+  /*!
+    \brief total bytes allocated for chunks
+   */
+  std::size_t bytes_reserved() const { return _bytes_reserved; }
+
+  /*!
+    \brief total bytes handed out by store()
+   */
+  std::size_t bytes_used() const { return _bytes_used; }
+
+ private:
+  std::vector<std::unique_ptr<char[]> > _chunks;
+  std::size_t _chunk_size;
+  std::size_t _chunk_remaining;
+  std::size_t _bytes_reserved;
+  std::size_t _bytes_used;
+  char *_cursor;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_ARENA_H_
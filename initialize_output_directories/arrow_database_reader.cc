@@ -0,0 +1,432 @@
+/*!
+  \file arrow_database_reader.cc
+  \brief implementation of Parquet and Arrow IPC database readers
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/arrow_database_reader.h"
+
+#include <stdexcept>
+
+#include "initialize_output_directories/config.h"
+
+#ifdef INITIALIZE_OUTPUT_DIRECTORIES_HAVE_ARROW
+#include <charconv>
+#include <vector>
+
+#include "arrow/api.h"
+#include "arrow/io/file.h"
+#include "arrow/ipc/reader.h"
+#include "parquet/arrow/reader.h"
+#include "parquet/arrow/schema.h"
+
+namespace {
+const char missing_cell[] = "NA";
+
+std::string format_name(initialize_output_directories::arrow_format format) {
+  return format == initialize_output_directories::parquet_file ? "Parquet"
+                                                               : "Arrow";
+}
+
+/*!
+  \brief throw for a failed Arrow call
+ */
+void check(const arrow::Status &status, const std::string &filename,
+           initialize_output_directories::arrow_format format) {
+  if (!status.ok())
+    throw std::runtime_error("cannot read " + format_name(format) +
+                             " phenotype file \"" + filename +
+                             "\": " + status.ToString());
+}
+
+template <class value_type>
+value_type check(arrow::Result<value_type> result, const std::string &filename,
+                 initialize_output_directories::arrow_format format) {
+  check(result.status(), filename, format);
+  return std::move(result).ValueUnsafe();
+}
+
+template <class array_type>
+void format_numbers(const arrow::Array &array,
+                    initialize_output_directories::string_arena *arena,
+                    std::vector<std::string_view> *cells) {
+  const array_type &values = static_cast<const array_type &>(array);
+  char buffer[64];
+  for (int64_t i = 0; i < values.length(); ++i) {
+    if (values.IsNull(i)) {
+      cells->push_back(std::string_view(missing_cell));
+      continue;
+    }
+    // shortest representation that reads back as the same value
+    std::to_chars_result res =
+        std::to_chars(buffer, buffer + sizeof(buffer), values.Value(i));
+    cells->push_back(arena->store(buffer, res.ptr - buffer));
+  }
+}
+
+template <class array_type>
+void format_strings(const arrow::Array &array,
+                    initialize_output_directories::string_arena *arena,
+                    std::vector<std::string_view> *cells) {
+  const array_type &values = static_cast<const array_type &>(array);
+  for (int64_t i = 0; i < values.length(); ++i) {
+    if (values.IsNull(i)) {
+      cells->push_back(std::string_view(missing_cell));
+      continue;
+    }
+    std::string_view value = values.GetView(i);
+    cells->push_back(arena->store(value.data(), value.size()));
+  }
+}
+
+/*!
+  \brief append the text of every value of an array
+  @param name column name, for messages
+  @param arena storage for the text
+  @param cells where to append views of the text
+ */
+void format_cells(const arrow::Array &array, const std::string &name,
+                  const std::string &filename,
+                  initialize_output_directories::string_arena *arena,
+                  std::vector<std::string_view> *cells) {
+  cells->reserve(cells->size() + array.length());
+  switch (array.type_id()) {
+    case arrow::Type::NA:
+      cells->insert(cells->end(), array.length(),
+                    std::string_view(missing_cell));
+      return;
+    case arrow::Type::BOOL: {
+      const arrow::BooleanArray &values =
+          static_cast<const arrow::BooleanArray &>(array);
+      for (int64_t i = 0; i < values.length(); ++i) {
+        cells->push_back(std::string_view(
+            values.IsNull(i) ? missing_cell : values.Value(i) ? "1" : "0"));
+      }
+      return;
+    }
+    case arrow::Type::INT8:
+      return format_numbers<arrow::Int8Array>(array, arena, cells);
+    case arrow::Type::INT16:
+      return format_numbers<arrow::Int16Array>(array, arena, cells);
+    case arrow::Type::INT32:
+      return format_numbers<arrow::Int32Array>(array, arena, cells);
+    case arrow::Type::INT64:
+      return format_numbers<arrow::Int64Array>(array, arena, cells);
+    case arrow::Type::UINT8:
+      return format_numbers<arrow::UInt8Array>(array, arena, cells);
+    case arrow::Type::UINT16:
+      return format_numbers<arrow::UInt16Array>(array, arena, cells);
+    case arrow::Type::UINT32:
+      return format_numbers<arrow::UInt32Array>(array, arena, cells);
+    case arrow::Type::UINT64:
+      return format_numbers<arrow::UInt64Array>(array, arena, cells);
+    case arrow::Type::FLOAT:
+      return format_numbers<arrow::FloatArray>(array, arena, cells);
+    case arrow::Type::DOUBLE:
+      return format_numbers<arrow::DoubleArray>(array, arena, cells);
+    case arrow::Type::STRING:
+      return format_strings<arrow::StringArray>(array, arena, cells);
+    case arrow::Type::LARGE_STRING:
+      return format_strings<arrow::LargeStringArray>(array, arena, cells);
+    case arrow::Type::DICTIONARY: {
+      // each dictionary entry is written once, and shared by its indices
+      const arrow::DictionaryArray &values =
+          static_cast<const arrow::DictionaryArray &>(array);
+      std::vector<std::string_view> entries;
+      format_cells(*values.dictionary(), name, filename, arena, &entries);
+      for (int64_t i = 0; i < values.length(); ++i) {
+        cells->push_back(values.IsNull(i)
+                             ? std::string_view(missing_cell)
+                             : entries.at(values.GetValueIndex(i)));
+      }
+      return;
+    }
+    default:
+      throw std::runtime_error("column \"" + name + "\" of phenotype file \"" +
+                               filename + "\" has unsupported type " +
+                               array.type()->ToString());
+  }
+}
+
+/*!
+  \struct projection
+  \brief the schema fields a selection reads, in schema order
+ */
+struct projection {
+  std::vector<int> fields;
+  unsigned id_slot;  //!< position of the ID column in fields
+  //! position in fields of each selected column, and its name
+  std::vector<unsigned> selected_slots;
+  std::vector<std::string> headers;
+};
+
+/*!
+  \brief as for text, the ID column is the last so named, else the first
+ */
+projection project(
+    const arrow::Schema &schema,
+    const initialize_output_directories::column_selection &selection) {
+  int id_field = 0;
+  for (int i = 0; i < schema.num_fields(); ++i) {
+    if (!schema.field(i)->name().compare(selection.id)) id_field = i;
+  }
+  projection res;
+  res.id_slot = 0;
+  for (int i = 0; i < schema.num_fields(); ++i) {
+    bool wanted = selection.wants(schema.field(i)->name());
+    if (!wanted && i != id_field) continue;
+    if (i == id_field) res.id_slot = res.fields.size();
+    if (wanted) {
+      res.selected_slots.push_back(res.fields.size());
+      res.headers.push_back(schema.field(i)->name());
+    }
+    res.fields.push_back(i);
+  }
+  return res;
+}
+
+/*!
+  \class ipc_file_batches
+  \brief the record batches of an Arrow IPC file, in order
+ */
+class ipc_file_batches : public arrow::RecordBatchReader {
+ public:
+  explicit ipc_file_batches(
+      const std::shared_ptr<arrow::ipc::RecordBatchFileReader> &file)
+      : _file(file), _next(0) {}
+  std::shared_ptr<arrow::Schema> schema() const { return _file->schema(); }
+  arrow::Status ReadNext(std::shared_ptr<arrow::RecordBatch> *batch) {
+    if (_next == _file->num_record_batches()) {
+      batch->reset();
+      return arrow::Status::OK();
+    }
+    arrow::Result<std::shared_ptr<arrow::RecordBatch> > res =
+        _file->ReadRecordBatch(_next++);
+    if (res.ok()) *batch = *res;
+    return res.status();
+  }
+
+ private:
+  std::shared_ptr<arrow::ipc::RecordBatchFileReader> _file;
+  int _next;
+};
+
+/*!
+  \class projected_batches
+  \brief record batches of a file, holding only the projected fields
+ */
+class projected_batches {
+ public:
+  /*!
+    \brief constructor; opens the file and reads its schema
+   */
+  projected_batches(
+      const std::string &filename,
+      initialize_output_directories::arrow_format format,
+      const initialize_output_directories::column_selection &selection);
+  const projection &get_projection() const { return _projection; }
+  /*!
+    \brief the next batch, or null at the end of the file
+   */
+  std::shared_ptr<arrow::RecordBatch> next();
+  const std::string &filename() const { return _filename; }
+
+ private:
+  std::string _filename;
+  initialize_output_directories::arrow_format _format;
+  projection _projection;
+  std::shared_ptr<arrow::io::ReadableFile> _input;
+  //! must outlive _batches, which reads through it
+  std::unique_ptr<parquet::arrow::FileReader> _parquet;
+  std::shared_ptr<arrow::RecordBatchReader> _batches;
+};
+
+projected_batches::projected_batches(
+    const std::string &filename,
+    initialize_output_directories::arrow_format format,
+    const initialize_output_directories::column_selection &selection)
+    : _filename(filename), _format(format) {
+  _input = check(arrow::io::ReadableFile::Open(filename), filename, format);
+  if (format == initialize_output_directories::parquet_file) {
+    _parquet = check(
+        parquet::arrow::OpenFile(_input, arrow::default_memory_pool()),
+        filename, format);
+    std::shared_ptr<arrow::Schema> schema;
+    check(_parquet->GetSchema(&schema), filename, format);
+    _projection = project(*schema, selection);
+    // only the chunks of the projected leaf columns are read
+    std::vector<int> row_groups, columns;
+    for (int i = 0; i < _parquet->num_row_groups(); ++i) {
+      row_groups.push_back(i);
+    }
+    for (std::vector<int>::const_iterator iter = _projection.fields.begin();
+         iter != _projection.fields.end(); ++iter) {
+      const parquet::arrow::SchemaField &field =
+          _parquet->manifest().schema_fields.at(*iter);
+      if (!field.is_leaf())
+        throw std::runtime_error(
+            "column \"" + field.field->name() + "\" of phenotype file \"" +
+            filename + "\" has unsupported type " +
+            field.field->type()->ToString());
+      columns.push_back(field.column_index);
+    }
+    _batches = check(_parquet->GetRecordBatchReader(row_groups, columns),
+                     filename, format);
+    return;
+  }
+  // IPC: the schema comes first, then only the projected buffers are read
+  arrow::ipc::IpcReadOptions options = arrow::ipc::IpcReadOptions::Defaults();
+  if (format == initialize_output_directories::arrow_ipc_file) {
+    std::shared_ptr<arrow::ipc::RecordBatchFileReader> file =
+        check(arrow::ipc::RecordBatchFileReader::Open(_input, options),
+              filename, format);
+    _projection = project(*file->schema(), selection);
+    options.included_fields = _projection.fields;
+    file = check(arrow::ipc::RecordBatchFileReader::Open(_input, options),
+                 filename, format);
+    _batches.reset(new ipc_file_batches(file));
+    return;
+  }
+  std::shared_ptr<arrow::ipc::RecordBatchStreamReader> stream =
+      check(arrow::ipc::RecordBatchStreamReader::Open(_input, options),
+            filename, format);
+  _projection = project(*stream->schema(), selection);
+  // a stream cannot be rewound; reopen it from the start
+  _input = check(arrow::io::ReadableFile::Open(filename), filename, format);
+  options.included_fields = _projection.fields;
+  _batches = check(arrow::ipc::RecordBatchStreamReader::Open(_input, options),
+                   filename, format);
+}
+
+std::shared_ptr<arrow::RecordBatch> projected_batches::next() {
+  std::shared_ptr<arrow::RecordBatch> res;
+  check(_batches->ReadNext(&res), _filename, _format);
+  if (res && res->num_columns() !=
+                 static_cast<int>(_projection.fields.size()))
+    throw std::runtime_error("unexpected columns in " + format_name(_format) +
+                             " phenotype file \"" + _filename + "\"");
+  return res;
+}
+
+/*!
+  \brief the text of one batch's projected columns
+  @param arena storage for the text
+  @param columns where to store each projected column's cells
+ */
+void format_batch(const arrow::RecordBatch &batch, const projected_batches &src,
+                  initialize_output_directories::string_arena *arena,
+                  std::vector<std::vector<std::string_view> > *columns) {
+  columns->resize(batch.num_columns());
+  for (int j = 0; j < batch.num_columns(); ++j) {
+    format_cells(*batch.column(j), batch.schema()->field(j)->name(),
+                 src.filename(), arena, &(*columns)[j]);
+  }
+}
+
+/*!
+  \class arrow_database_cursor
+  \brief rows of a Parquet or Arrow IPC file, one batch held at a time
+ */
+class arrow_database_cursor
+    : public initialize_output_directories::database_cursor {
+ public:
+  explicit arrow_database_cursor(std::unique_ptr<projected_batches> src)
+      : _src(std::move(src)), _row(0), _n_rows(0) {
+    _headers = _src->get_projection().headers;
+  }
+  bool next(std::string_view *id, std::vector<std::string_view> *cells);
+
+ private:
+  std::unique_ptr<projected_batches> _src;
+  std::unique_ptr<initialize_output_directories::string_arena> _arena;
+  std::vector<std::vector<std::string_view> > _columns;
+  int64_t _row;
+  int64_t _n_rows;
+};
+
+bool arrow_database_cursor::next(std::string_view *id,
+                                 std::vector<std::string_view> *cells) {
+  while (_row == _n_rows) {
+    std::shared_ptr<arrow::RecordBatch> batch = _src->next();
+    if (!batch) return false;
+    // the previous batch's text is no longer referenced
+    _arena.reset(new initialize_output_directories::string_arena);
+    _columns.clear();
+    format_batch(*batch, *_src, _arena.get(), &_columns);
+    _row = 0;
+    _n_rows = batch->num_rows();
+  }
+  const projection &p = _src->get_projection();
+  *id = _columns.at(p.id_slot).at(_row);
+  cells->resize(p.selected_slots.size());
+  for (unsigned i = 0; i < p.selected_slots.size(); ++i) {
+    (*cells)[i] = _columns.at(p.selected_slots.at(i)).at(_row);
+  }
+  ++_row;
+  return true;
+}
+
+/*!
+  \class arrow_database_reader
+  \brief Parquet file, or Arrow IPC file or stream
+ */
+class arrow_database_reader
+    : public initialize_output_directories::database_reader {
+ public:
+  arrow_database_reader(const std::string &filename,
+                        initialize_output_directories::arrow_format format)
+      : _filename(filename), _format(format) {}
+  void read(const initialize_output_directories::column_selection &selection,
+            initialize_output_directories::database_table *table);
+  std::unique_ptr<initialize_output_directories::database_cursor> stream(
+      const initialize_output_directories::column_selection &selection) {
+    return std::unique_ptr<initialize_output_directories::database_cursor>(
+        new arrow_database_cursor(std::unique_ptr<projected_batches>(
+            new projected_batches(_filename, _format, selection))));
+  }
+  std::string name() const { return format_name(_format); }
+
+ private:
+  std::string _filename;
+  initialize_output_directories::arrow_format _format;
+};
+
+void arrow_database_reader::read(
+    const initialize_output_directories::column_selection &selection,
+    initialize_output_directories::database_table *table) {
+  projected_batches src(_filename, _format, selection);
+  const projection &p = src.get_projection();
+  table->headers = p.headers;
+  table->data.resize(p.headers.size());
+  std::vector<std::vector<std::string_view> > columns;
+  while (std::shared_ptr<arrow::RecordBatch> batch = src.next()) {
+    columns.clear();
+    format_batch(*batch, src, &table->arena, &columns);
+    std::vector<std::string_view> &ids = columns.at(p.id_slot);
+    table->ids.insert(table->ids.end(), ids.begin(), ids.end());
+    for (unsigned i = 0; i < p.selected_slots.size(); ++i) {
+      std::vector<std::string_view> &cells = columns.at(p.selected_slots.at(i));
+      table->data[i].insert(table->data[i].end(), cells.begin(), cells.end());
+    }
+  }
+}
+}  // namespace
+
+std::unique_ptr<initialize_output_directories::database_reader>
+initialize_output_directories::open_arrow(const std::string &filename,
+                                          arrow_format format) {
+  return std::unique_ptr<database_reader>(
+      new arrow_database_reader(filename, format));
+}
+#else
+std::unique_ptr<initialize_output_directories::database_reader>
+initialize_output_directories::open_arrow(const std::string &filename,
+                                          arrow_format format) {
+  throw std::runtime_error(
+      "\"" + filename + "\" is " +
+      (format == parquet_file ? "a Parquet" : "an Arrow IPC") +
+      " file, but this build has no Arrow support; reconfigure with the "
+      "Apache Arrow and Parquet C++ libraries, or read the text release");
+}
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_HAVE_ARROW
@@ -0,0 +1,53 @@
+/*!
+  \file arrow_database_reader.h
+  \brief Parquet and Arrow IPC phenotype databases
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_ARROW_DATABASE_READER_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_ARROW_DATABASE_READER_H_
+
+#include <memory>
+#include <string>
+
+#include "initialize_output_directories/database_reader.h"
+
+namespace initialize_output_directories {
+/*!
+  \brief binary database formats read through Apache Arrow
+ */
+enum arrow_format {
+  parquet_file,      //!< "PAR1" at both ends
+  arrow_ipc_file,    //!< "ARROW1" at both ends, as Feather V2 writes
+  arrow_ipc_stream,  //!< schema message first, with no magic
+};
+
+/*!
+  \brief open a Parquet or Arrow IPC phenotype database
+  @param filename name of file to open
+  @param format the format its leading bytes show
+  \return reader for the file
+
+  Only the ID column and the selected columns are read, with no text
+  parsing: Parquet column chunks of the other columns are never
+  touched, and neither are their Arrow IPC buffers. Streaming passes
+  hold one record batch (for Parquet, part of one row group) at a time.
+
+  Each value is written as the text a delimited release would hold:
+  strings (dictionary encoded or not) as they are, integers in decimal,
+  floating point numbers in their shortest form that reads back exactly
+  (so 1.0 becomes 1), booleans as 1 and 0, and nulls as NA. Columns
+  of any other type, nested ones included, are rejected if selected.
+  Exact comparison of a Parquet release against a text one whose
+  numbers were formatted otherwise therefore sees a change, and typed
+  comparison does not.
+
+  This is implemented in its own translation unit, built with the
+  compiler flags the installed Arrow needs; without Arrow, it throws.
+ */
+std::unique_ptr<database_reader> open_arrow(const std::string &filename,
+                                            arrow_format format);
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_ARROW_DATABASE_READER_H_
@@ -12,14 +12,18 @@ void initialize_output_directories::cargs::initialize_options() {
       "extension-config,e", boost::program_options::value<std::string>(),
       "file extension configuration file, yaml format")(
       "force,B", "force updates to all tracking files unless in pretend mode")(
-      "phenotype-config,p", boost::program_options::value<std::string>(),
-      "phenotype configuration file, yaml format")(
+      "phenotype-config,p",
+      boost::program_options::value<std::vector<std::string> >()->composing(),
+      "phenotype configuration file, yaml format; may be repeated")(
       "phenotype-database,D", boost::program_options::value<std::string>(),
       "name of current phenotype dataset in use")(
       "phenotype-id-colname,I", boost::program_options::value<std::string>(),
       "column header for subject IDs in phenotype dataset")(
       "pretend,n",
       "emit analysis target directories but do not write any changes to disk")(
+      "explain",
+      "evaluate every tracker in memory and list the targets that would be "
+      "invalidated, with reasons, without writing anything")(
       "bgen-dir,b", boost::program_options::value<std::string>(),
       "top level directory containing imputed bgen files")(
       "results-dir,r", boost::program_options::value<std::string>(),
@@ -28,5 +32,60 @@ void initialize_output_directories::cargs::initialize_options() {
       "requested software (e.g. SAIGE, BOLTLMM)")(
       "software-min-sample-size,N", boost::program_options::value<unsigned>(),
       "minimum heuristic sample size for software")(
-      "timer,t", "emit elapsed runtime at end of program execution");
+      "memory-limit",
+      boost::program_options::value<unsigned>()->default_value(0),
+      "hold at most about this many megabytes of phenotype data, reading "
+      "the database in streaming passes instead of loading it; 0 for no "
+      "limit")(
+      "timer,t",
+      "emit elapsed runtime, phenotype load time and storage (or streaming "
+      "passes), database read throughput, and peak memory at end of "
+      "program execution")(
+      "threads,j",
+      boost::program_options::value<unsigned>()->default_value(1),
+      "number of worker threads")(
+      "io-backend",
+      boost::program_options::value<std::string>()->default_value("auto"),
+      "tracking file I/O backend: auto, io_uring, threads, or sync")(
+      "database-io",
+      boost::program_options::value<std::string>()->default_value("auto"),
+      "how plain text phenotype databases are read: auto, mmap, pread, or "
+      "direct")(
+      "compare-values",
+      boost::program_options::value<std::string>()->default_value("exact"),
+      "how a new phenotype database is compared with the one a target last "
+      "used: exact (byte for byte) or typed (by value)")(
+      "compare-tolerance",
+      boost::program_options::value<double>()->default_value(0.0),
+      "largest relative difference between numbers that typed comparison "
+      "treats as equal")(
+      "model-matrix",
+      boost::program_options::value<std::string>()->default_value("none"),
+      "write per-target model matrices: none, tsv, gzip, or binary")(
+      "covariate-statistics",
+      boost::program_options::value<std::string>()->default_value("none"),
+      "summarize each target's phenotype and covariates over its subjects: "
+      "none, report (write a statistics tracker), or drop (also leave "
+      "covariates constant for the target out of its covariates tracker)")(
+      "content-store",
+      "deduplicate written files through a content store in the results "
+      "directory, and skip targets whose inputs are unchanged")(
+      "report", boost::program_options::value<std::string>()->default_value(""),
+      "write one JSON record per analysis target to this file")(
+      "diff-database",
+      boost::program_options::value<std::string>()->default_value(""),
+      "compare this earlier phenotype database against -D, report per-column "
+      "changes and which -p configs they affect, and exit")(
+      "emit-order",
+      boost::program_options::value<std::string>()->default_value("config"),
+      "order of the analysis prefixes written: config (each config's chips "
+      "and ancestries in turn) or cost (invalidated targets first, then "
+      "largest estimated job first)")(
+      "shard", boost::program_options::value<std::string>()->default_value(""),
+      "process only shard i/n (0 <= i < n) of the targets, writing a "
+      "fragment for --merge-shards instead of bare analysis prefixes")(
+      "merge-shards",
+      boost::program_options::value<std::vector<std::string> >()->composing(),
+      "combine the fragments written by every --shard into the output of "
+      "an unsharded run, and exit; may be repeated");
 }
@@ -14,6 +14,7 @@
 
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #include "boost/program_options.hpp"
 
@@ -73,6 +74,20 @@ class cargs {
    */
   bool pretend() const { return compute_flag("pretend"); }
 
+  /*!
+    \brief determine whether the run should explain its invalidations
+    \return whether the run is in explain mode
+
+    Explain mode performs every check a normal run would, including
+    comparing against the previous phenotype database and computing
+    categories, but applies nothing: no directories, trackers, model
+    matrices, locks or content store entries are written. Instead of
+    analysis prefixes, it reports each target that a normal run would
+    invalidate, with the phenotype database state and the invalidating
+    trackers, tab separated. It overrides pretend mode.
+   */
+  bool explain() const { return compute_flag("explain"); }
+
   /*!
     \brief determine whether the run is in force mode
     \return whether the run is in force mode
@@ -91,21 +106,26 @@ class cargs {
     Almost all of this program is super fast, but one step, processing
     the phenotype database, can be comparatively slow. to ease the
     comparison of different implementations, this flag will turn on
-    an internal timer that will report the elapsed runtime.
+    an internal timer that will report the elapsed runtime, along
+    with the time spent loading the phenotype database, the bytes
+    used to store it, the throughput achieved reading it, and the
+    peak resident memory of the process.
    */
   bool timer() const { return compute_flag("timer"); }
 
   /*!
-    \brief get the user-specified phenotype configuration file
-    \return the user-specified phenotype configuration file
+    \brief get the user-specified phenotype configuration files
+    \return the user-specified phenotype configuration files
 
-    This file should be in yaml format and specify each of the
+    Each file should be in yaml format and specify each of the
     phenotype run configuration options required for the analysis.
     Yaml format is checked by yaml-cpp but any config file extension
-    is allowed.
+    is allowed. Several configs may be given to process them as one
+    batch sharing the thread pool and tracker I/O; analysis targets
+    are still reported in the order the configs were given.
    */
-  std::string get_phenotype_config() const {
-    return compute_parameter<std::string>("phenotype-config");
+  std::vector<std::string> get_phenotype_configs() const {
+    return compute_parameter<std::vector<std::string> >("phenotype-config");
   }
 
   /*!
@@ -200,6 +220,204 @@ class cargs {
     return compute_parameter<unsigned>("software-min-sample-size");
   }
 
+  /*!
+    \brief get the cap on phenotype data held in memory
+    \return the cap in megabytes, or 0 for no cap
+
+    With a cap, phenotype databases are never loaded whole. Categories
+    and database comparisons are computed in single passes over the
+    file, and each model matrix is gathered in as many passes as its
+    share of the cap requires. Meant for small shared hosts, at the
+    cost of reading databases more than once.
+   */
+  unsigned get_memory_limit() const {
+    return compute_parameter<unsigned>("memory-limit");
+  }
+
+  /*!
+    \brief get the number of worker threads to use
+    \return the number of worker threads to use
+
+    Defaults to 1. Worker threads are used for the threaded tracking file
+    I/O backend, among other things.
+   */
+  unsigned get_threads() const {
+    return compute_parameter<unsigned>("threads");
+  }
+
+  /*!
+    \brief get the requested tracking file I/O backend
+    \return the requested tracking file I/O backend
+
+    Tracking files for every target are read in one batch and written in
+    another. "io_uring" submits each batch as deep asynchronous queues,
+    which mostly helps on network filesystems where every stat and open
+    is a round trip; "threads" spreads blocking calls over the worker
+    threads; "sync" issues one call at a time. The default, "auto",
+    uses io_uring when the kernel supports it and otherwise falls back
+    to threads (or sync, with a single thread).
+   */
+  std::string get_io_backend() const {
+    return compute_parameter<std::string>("io-backend");
+  }
+
+  /*!
+    \brief get the requested phenotype database read strategy
+    \return the requested phenotype database read strategy
+
+    One of "mmap", "pread", "direct", or the default, "auto", which
+    uses pread on network and parallel filesystems and mmap elsewhere;
+    see input_source::set_read_strategy. Only plain text databases are
+    affected.
+   */
+  std::string get_database_io() const {
+    return compute_parameter<std::string>("database-io");
+  }
+
+  /*!
+    \brief get the requested phenotype database comparison mode
+    \return the requested phenotype database comparison mode
+
+    When a target last used a different database, the two are compared
+    in the target's columns. "exact", the default, requires identical
+    bytes; "typed" compares values, so that reformatted numbers and
+    missing values do not trigger reruns. See value_comparison.
+   */
+  std::string get_compare_values() const {
+    return compute_parameter<std::string>("compare-values");
+  }
+
+  /*!
+    \brief get the relative tolerance for typed comparison
+    \return the relative tolerance for typed comparison
+   */
+  double get_compare_tolerance() const {
+    return compute_parameter<double>("compare-tolerance");
+  }
+
+  /*!
+    \brief get the requested per-target model matrix format
+    \return the requested per-target model matrix format
+
+    Defaults to "none". Otherwise one of "tsv", "gzip", or "binary":
+    for each chip/ancestry target, the phenotype and covariates of
+    the subjects in that target's bgen sample file are written next to
+    the software directories, as
+    {results}/{analysis_prefix}/{ancestry}/{analysis_prefix}.{chip}.model_matrix.*
+    The file is shared by every software run on the same chip and
+    ancestry, and is only rewritten when it is missing or the target's
+    trackers changed.
+   */
+  std::string get_model_matrix_format() const {
+    return compute_parameter<std::string>("model-matrix");
+  }
+
+  /*!
+    \brief get the requested per-target column statistics mode
+    \return the requested per-target column statistics mode
+
+    Defaults to "none". With "report", each target's phenotype and
+    covariate columns are summarized over the subjects in its bgen
+    sample file (counts, mean, variance, range and level counts) in a
+    tracker next to the others. "drop" also leaves covariates with a
+    single value among those subjects, such as the batch indicator of
+    the target's own chip, out of the covariates tracker.
+   */
+  std::string get_covariate_statistics() const {
+    return compute_parameter<std::string>("covariate-statistics");
+  }
+
+  /*!
+    \brief determine whether to use a content store
+    \return whether to use a content store
+
+    With this flag, trackers and model matrices are written once per
+    distinct payload into {results}/.content_store and hard linked
+    into place, so identical files across targets (and comparisonN
+    subdirectories) share one inode. Each target's complete inputs
+    are also hashed; a target whose hash is already recorded is
+    skipped entirely on later runs. The phenotype database and sample
+    files enter the hash by name, size and modification time rather
+    than contents. --force ignores recorded targets.
+   */
+  bool content_store() const { return compute_flag("content-store"); }
+
+  /*!
+    \brief get the user-specified run report filename
+    \return the run report filename, or empty if none was requested
+
+    The report is newline-delimited JSON with one object per analysis
+    target, written as each target is checked: the target's config,
+    prefix, chip, ancestry and software; its subject count; category
+    and comparison counts; whether the content store skipped it; the
+    phenotype database state; the trackers whose changes invalidated
+    it; whether its finalization file was removed and its model matrix
+    written; and the time spent checking it.
+   */
+  std::string get_report() const {
+    return compute_parameter<std::string>("report");
+  }
+
+  /*!
+    \brief get the earlier phenotype database to compare against
+    \return the earlier database filename, or empty for a normal run
+
+    When set, no targets are processed. Instead both databases are
+    loaded in full and compared by subject ID, column by column, and
+    tab-delimited records are written to stdout: a "subjects" record,
+    a "column" record for each changed column, and a "config" record
+    for each phenotype config given with -p, stating whether its
+    phenotype or covariates (or its subjects) changed. Only -D, -I,
+    -p and -j are used in this mode.
+   */
+  std::string get_diff_database() const {
+    return compute_parameter<std::string>("diff-database");
+  }
+
+  /*!
+    \brief get the share of targets this run is responsible for
+    \return "i/n" for shard i of n, or empty for every target
+
+    Targets (one per config, software, chip and ancestry) are assigned
+    to shards by a stable hash of their analysis prefix, software, chip
+    and ancestry, so the n runs of a split, given the same configs,
+    partition the batch without coordinating. They may share one
+    results directory. Each writes a fragment to stdout in place of the
+    analysis prefixes: its lines tagged with their position in the
+    batch, between a header and a completion trailer.
+   */
+  std::string get_shard() const {
+    return compute_parameter<std::string>("shard");
+  }
+
+  /*!
+    \brief get the requested order of emitted analysis prefixes
+    \return the requested order of emitted analysis prefixes
+
+    "config", the default, writes each config's targets in chip and
+    ancestry order. "cost" writes invalidated targets first, then
+    every target by decreasing estimated cost: its subject count,
+    scaled for categorical phenotypes by the share of subjects each
+    comparison analyzes. Handing make the longest jobs first keeps the
+    largest chips from becoming the tail of the pipeline.
+   */
+  std::string get_emit_order() const {
+    return compute_parameter<std::string>("emit-order");
+  }
+
+  /*!
+    \brief get shard fragments to combine
+    \return fragment filenames, or empty if not merging
+
+    When set, nothing else is done: the fragments of every shard of a
+    split are checked for completeness and their lines written to
+    stdout in the order an unsharded run would have emitted them.
+   */
+  std::vector<std::string> get_shard_fragments() const {
+    if (!compute_flag("merge-shards")) return std::vector<std::string>();
+    return compute_parameter<std::vector<std::string> >("merge-shards");
+  }
+
   /*!
     \brief find status of arbitrary flag
     @param tag name of flag
@@ -0,0 +1,242 @@
+/*!
+  \file column_statistics.cc
+  \brief implementation of per-target column summaries
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/column_statistics.h"
+
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+
+namespace {
+/*!
+  \brief independent accumulators per reduction
+
+  Floating point sums may not be reordered by the compiler, so a single
+  accumulator serializes on its own latency; several lanes, combined at
+  the end, keep the loop free to use vector registers.
+ */
+const unsigned lanes = 4;
+
+std::string format_number(double value) {
+  // shortest representation that reads back as the same double
+  char buffer[64];
+  std::to_chars_result res =
+      std::to_chars(buffer, buffer + sizeof(buffer), value);
+  return std::string(buffer, res.ptr);
+}
+
+std::string format_moment(double value) {
+  // moments summed in a different order differ in their last bits; the
+  // tracker should not
+  char buffer[64];
+  std::to_chars_result res = std::to_chars(
+      buffer, buffer + sizeof(buffer), value, std::chars_format::general, 10);
+  return std::string(buffer, res.ptr);
+}
+
+bool level_order(const std::pair<std::string, unsigned> &a,
+                 const std::pair<std::string, unsigned> &b) {
+  // levels carry no leading zeros, so shorter is smaller
+  if (a.first.size() != b.first.size())
+    return a.first.size() < b.first.size();
+  return a.first < b.first;
+}
+}  // namespace
+
+const unsigned initialize_output_directories::column_summary::max_levels = 32;
+
+void initialize_output_directories::column_summary::add(
+    const std::vector<std::string_view> &cells) {
+  _present = true;
+  // classify every cell, setting the numbers of the batch aside
+  std::vector<double> values;
+  if (_numeric) values.reserve(cells.size());
+  unsigned n_batch = 0;
+  for (std::vector<std::string_view>::const_iterator iter = cells.begin();
+       iter != cells.end(); ++iter) {
+    if (value_comparison::missing(*iter)) {
+      ++_n_missing;
+      continue;
+    }
+    if (!_n && !n_batch) {
+      _first = std::string(*iter);
+    } else if (_same_text && *iter != _first) {
+      _same_text = false;
+    }
+    ++n_batch;
+    if (_numeric) {
+      double value = 0.0;
+      if (value_comparison::number(*iter, &value)) {
+        values.push_back(value);
+      } else {
+        _numeric = false;
+        std::vector<double>().swap(values);
+      }
+    }
+    if (_counting_levels) {
+      if (!value_comparison::level(*iter)) {
+        _counting_levels = false;
+        _levels.clear();
+        continue;
+      }
+      std::string_view level = *iter;
+      level.remove_prefix(
+          std::min(level.find_first_not_of('0'), level.size() - 1));
+      std::vector<std::pair<std::string, unsigned> >::iterator finder =
+          _levels.begin();
+      for (; finder != _levels.end(); ++finder) {
+        if (finder->first == level) break;
+      }
+      if (finder != _levels.end()) {
+        ++finder->second;
+      } else if (_levels.size() < max_levels) {
+        _levels.push_back(std::make_pair(std::string(level), 1u));
+      } else {
+        // too many to be categorical
+        _counting_levels = false;
+        _levels.clear();
+      }
+    }
+  }
+  unsigned n_before = _n;
+  _n += n_batch;
+  if (!_numeric || values.empty()) return;
+  // reduce the batch: range and sum, then squared deviations
+  const double *v = values.data();
+  std::size_t n_values = values.size(), i = 0;
+  double lo[lanes], hi[lanes], sum[lanes], m2[lanes];
+  for (unsigned l = 0; l < lanes; ++l) {
+    lo[l] = hi[l] = v[0];
+    sum[l] = m2[l] = 0.0;
+  }
+  for (; i + lanes <= n_values; i += lanes) {
+    for (unsigned l = 0; l < lanes; ++l) {
+      lo[l] = std::min(lo[l], v[i + l]);
+      hi[l] = std::max(hi[l], v[i + l]);
+      sum[l] += v[i + l];
+    }
+  }
+  for (; i < n_values; ++i) {
+    lo[0] = std::min(lo[0], v[i]);
+    hi[0] = std::max(hi[0], v[i]);
+    sum[0] += v[i];
+  }
+  for (unsigned l = 1; l < lanes; ++l) {
+    lo[0] = std::min(lo[0], lo[l]);
+    hi[0] = std::max(hi[0], hi[l]);
+    sum[0] += sum[l];
+  }
+  double batch_mean = sum[0] / n_values;
+  for (i = 0; i + lanes <= n_values; i += lanes) {
+    for (unsigned l = 0; l < lanes; ++l) {
+      double d = v[i + l] - batch_mean;
+      m2[l] += d * d;
+    }
+  }
+  for (; i < n_values; ++i) {
+    double d = v[i] - batch_mean;
+    m2[0] += d * d;
+  }
+  for (unsigned l = 1; l < lanes; ++l) m2[0] += m2[l];
+  if (!n_before) {
+    _mean = batch_mean;
+    _m2 = m2[0];
+    _min = lo[0];
+    _max = hi[0];
+    return;
+  }
+  // merge with the earlier batches
+  double delta = batch_mean - _mean;
+  double n_a = n_before, n_b = n_values, n_ab = n_a + n_b;
+  _mean += delta * n_b / n_ab;
+  _m2 += m2[0] + delta * delta * n_a * n_b / n_ab;
+  _min = std::min(_min, lo[0]);
+  _max = std::max(_max, hi[0]);
+}
+
+bool initialize_output_directories::column_summary::constant() const {
+  if (!_present) return false;
+  if (!_n) return true;
+  return _numeric ? _min == _max : _same_text;
+}
+
+std::vector<std::pair<std::string, unsigned> >
+initialize_output_directories::column_summary::levels() const {
+  std::vector<std::pair<std::string, unsigned> > res;
+  if (!_counting_levels) return res;
+  res = _levels;
+  std::sort(res.begin(), res.end(), level_order);
+  return res;
+}
+
+void initialize_output_directories::column_statistics::add(
+    const model_matrix &mm) {
+  const std::vector<std::string> &headers = mm.get_headers();
+  for (unsigned j = 0; j < headers.size(); ++j) {
+    for (unsigned k = 0; k < _columns.size(); ++k) {
+      if (!_columns[k].compare(headers[j]))
+        _summaries[k].add(mm.get_data().at(j));
+    }
+  }
+}
+
+const initialize_output_directories::column_summary &
+initialize_output_directories::column_statistics::get(
+    const std::string &column) const {
+  for (unsigned k = 0; k < _columns.size(); ++k) {
+    if (!_columns[k].compare(column)) return _summaries[k];
+  }
+  throw std::runtime_error("column_statistics: no summary for column \"" +
+                           column + "\"");
+}
+
+std::vector<std::string>
+initialize_output_directories::column_statistics::excluding_constant(
+    const std::vector<std::string> &columns) const {
+  std::vector<std::string> res;
+  for (std::vector<std::string>::const_iterator iter = columns.begin();
+       iter != columns.end(); ++iter) {
+    if (!get(*iter).constant()) res.push_back(*iter);
+  }
+  return res;
+}
+
+std::string initialize_output_directories::column_statistics::format() const {
+  std::string res =
+      "column\tn\tmissing\tmean\tvariance\tmin\tmax\tlevels\tconstant\n";
+  for (unsigned k = 0; k < _columns.size(); ++k) {
+    const column_summary &summary = _summaries[k];
+    res += _columns[k];
+    if (!summary.present()) {
+      res += "\tNA\tNA\tNA\tNA\tNA\tNA\tNA\tNA\n";
+      continue;
+    }
+    res += '\t' + std::to_string(summary.n()) + '\t' +
+           std::to_string(summary.n_missing()) + '\t';
+    if (summary.numeric() && summary.n()) {
+      res += format_moment(summary.mean()) + '\t' +
+             format_moment(summary.variance()) + '\t' +
+             format_number(summary.min()) + '\t' +
+             format_number(summary.max()) + '\t';
+    } else {
+      res += "NA\tNA\tNA\tNA\t";
+    }
+    std::vector<std::pair<std::string, unsigned> > levels = summary.levels();
+    if (levels.empty()) {
+      res += "NA";
+    } else {
+      for (std::vector<std::pair<std::string, unsigned> >::const_iterator
+               iter = levels.begin();
+           iter != levels.end(); ++iter) {
+        if (iter != levels.begin()) res += ',';
+        res += iter->first + ':' + std::to_string(iter->second);
+      }
+    }
+    res += summary.constant() ? "\t1\n" : "\t0\n";
+  }
+  return res;
+}
@@ -0,0 +1,167 @@
+/*!
+  \file column_statistics.h
+  \brief per-target summaries of phenotype and covariate columns
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_COLUMN_STATISTICS_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_COLUMN_STATISTICS_H_
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "initialize_output_directories/tracking_files.h"
+#include "initialize_output_directories/value_comparison.h"
+
+namespace initialize_output_directories {
+/*!
+  \class column_summary
+  \brief running summary of one column: counts, moments, range, levels
+
+  Cells are classified as value_comparison does: missing values are
+  counted apart, and the rest are numbers unless any cell of the
+  column is not. Numbers are parsed once into a contiguous buffer per
+  batch of cells, which is then reduced in independent lanes; batches
+  are merged with the pairwise update of Chan et al., so a column
+  summarized in parts gives the same counts and range, and the same
+  moments up to rounding, as in one part.
+ */
+class column_summary {
+ public:
+  column_summary()
+      : _present(false),
+        _numeric(true),
+        _same_text(true),
+        _counting_levels(true),
+        _n(0),
+        _n_missing(0),
+        _mean(0.0),
+        _m2(0.0),
+        _min(0.0),
+        _max(0.0) {}
+  column_summary(const column_summary &obj)
+      : _present(obj._present),
+        _numeric(obj._numeric),
+        _same_text(obj._same_text),
+        _counting_levels(obj._counting_levels),
+        _n(obj._n),
+        _n_missing(obj._n_missing),
+        _mean(obj._mean),
+        _m2(obj._m2),
+        _min(obj._min),
+        _max(obj._max),
+        _first(obj._first),
+        _levels(obj._levels) {}
+  ~column_summary() throw() {}
+
+  /*!
+    \brief add a batch of cells of the column
+   */
+  void add(const std::vector<std::string_view> &cells);
+
+  //! whether any batch came from a matrix with the column
+  bool present() const { return _present; }
+  //! whether every non-missing cell is a number
+  bool numeric() const { return _numeric; }
+  //! non-missing cells
+  unsigned n() const { return _n; }
+  unsigned n_missing() const { return _n_missing; }
+  double mean() const { return _mean; }
+  /*!
+    \brief sample variance, with denominator n - 1; 0 below two values
+   */
+  double variance() const { return _n > 1 ? _m2 / (_n - 1) : 0.0; }
+  double min() const { return _min; }
+  double max() const { return _max; }
+  /*!
+    \brief whether the column holds at most one distinct value
+
+    Numbers are compared by value, so "1" and "1.0" are the same; any
+    other cells by their bytes. A column with no values at all is
+    constant; one absent from the database is not, as there is nothing
+    to drop.
+   */
+  bool constant() const;
+  /*!
+    \brief subjects at each level, in increasing order, if every
+    non-missing cell is a level and there are at most max_levels
+   */
+  std::vector<std::pair<std::string, unsigned> > levels() const;
+
+  static const unsigned max_levels;
+
+ private:
+  bool _present;
+  bool _numeric;
+  bool _same_text;
+  bool _counting_levels;
+  unsigned _n;
+  unsigned _n_missing;
+  double _mean;
+  double _m2;  //!< sum of squared differences from the mean
+  double _min;
+  double _max;
+  std::string _first;  //!< first non-missing cell
+  //! level, without leading zeros, and its count, in order of appearance
+  std::vector<std::pair<std::string, unsigned> > _levels;
+};
+
+/*!
+  \class column_statistics
+  \brief summaries of a config's columns over one target's subjects
+
+  Rows may be added in any number of matrices, such as the parts a
+  streaming_database gathers, and each column is summarized in one
+  pass over its cells per matrix.
+ */
+class column_statistics {
+ public:
+  column_statistics() {}
+  /*!
+    \brief constructor
+    @param columns names of the columns to summarize, in report order
+   */
+  explicit column_statistics(const std::vector<std::string> &columns)
+      : _columns(columns), _summaries(columns.size()) {}
+  column_statistics(const column_statistics &obj)
+      : _columns(obj._columns), _summaries(obj._summaries) {}
+  ~column_statistics() throw() {}
+
+  /*!
+    \brief add the rows of a matrix; columns it lacks are unchanged
+   */
+  void add(const model_matrix &mm);
+
+  const column_summary &get(const std::string &column) const;
+
+  /*!
+    \brief the values of a sequence that are not constant columns
+    @param columns column names, such as a config's covariates
+    \return the names in order, less those whose columns are constant
+   */
+  std::vector<std::string> excluding_constant(
+      const std::vector<std::string> &columns) const;
+
+  /*!
+    \brief the summaries as tracker contents
+
+    A header row, then one tab-delimited row per column: its name, the
+    non-missing and missing cell counts, mean and sample variance (to
+    ten significant digits), minimum, maximum, level counts (as
+    level:count, comma-separated), and 1 if constant or 0 if not.
+    Statistics a column does not have are NA: moments and range unless
+    it is numeric, levels unless it is categorical, and every field if
+    it is absent from the database.
+   */
+  std::string format() const;
+
+ private:
+  std::vector<std::string> _columns;
+  std::vector<column_summary> _summaries;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_COLUMN_STATISTICS_H_
@@ -0,0 +1,430 @@
+/*!
+  \file config_run.cc
+  \brief implementation of per-config processing
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/config_run.h"
+
+#include "boost/filesystem.hpp"
+#include "initialize_output_directories/utilities.h"
+
+void initialize_output_directories::config_run::prepare() {
+  const run_settings &s = *_settings;
+  // read configuration file
+  _config.reset(new yaml_reader(_config_filename));
+  // read required entries from phenotype configuration
+  _analysis_prefix = _config->get_entry("analysis_prefix");
+  _chips = _config->get_sequence("chips");
+  _ancestries = _config->get_sequence("ancestries");
+  std::vector<std::string> algorithms = _config->get_sequence("algorithm");
+  _analysis_directory = s.results_dir + "/" + _analysis_prefix;
+  if (s.store) {
+    // everything that determines a target's output besides its own paths
+    _run_inputs = s.software + "\n" + s.model_matrix_format + "\n" +
+                  read_file(_config_filename) + "\n" +
+                  read_file(s.extension_config_filename) + "\n" +
+                  file_signature(s.phenotype_database) + "\n";
+    if (s.write_covariate_statistics)
+      _run_inputs += s.covariate_statistics_mode + "\n";
+  }
+  // tracker contents depend only on the config, not on the target
+  _trackers.reset(new resolved_tracker_set(*_config, *s.schema));
+  // which covariates are kept depends on the data; see check_target
+  if (s.drop_constant_covariates)
+    _trackers->exclude(s.schema->get_covariates_definition().get_name());
+
+  _phenotype = _config->get_entry("phenotype");
+  if (_config->query_valid("covariates")) {
+    _covariates = _config->get_sequence("covariates");
+  }
+  // categories are needed if one of the algorithms is saige
+  _uses_saige = find_entry("saige", algorithms);
+  _uses_software = find_entry(s.software, algorithms);
+  _columns.assign(1, _phenotype);
+  _columns.insert(_columns.end(), _covariates.begin(), _covariates.end());
+  // nothing is read yet: declare the columns, so that whichever target
+  // first needs the database loads it for every config at once
+  if (_uses_software) {
+    if (!s.streaming) {
+      s.library->require(s.phenotype_database, _columns);
+    } else if (_uses_saige) {
+      s.streaming->require_categories(s.phenotype_database, _phenotype);
+    }
+  }
+}
+
+void initialize_output_directories::config_run::discover() {
+  const run_settings &s = *_settings;
+  if (!_uses_software) return;
+  // probe every chip/ancestry combination concurrently; on network
+  // filesystems each probe is several round trips. when sharded, only
+  // this shard's combinations are probed at all
+  std::vector<std::string> candidate_chips, candidate_ancestries;
+  std::vector<unsigned> candidate_positions;
+  unsigned position = 0;
+  for (std::vector<std::string>::const_iterator chip = _chips.begin();
+       chip != _chips.end(); ++chip) {
+    for (std::vector<std::string>::const_iterator ancestry =
+             _ancestries.begin();
+         ancestry != _ancestries.end(); ++ancestry, ++position) {
+      if (s.shard.active() &&
+          !s.shard.contains(_analysis_prefix + "\t" +
+                            lowercase(s.software) + "\t" + *chip + "\t" +
+                            *ancestry))
+        continue;
+      candidate_chips.push_back(*chip);
+      candidate_ancestries.push_back(*ancestry);
+      candidate_positions.push_back(position);
+    }
+  }
+  // whether each candidate's sample file exists, and its subject count
+  std::vector<int> found(candidate_chips.size(), 0);
+  std::vector<unsigned> subjects(candidate_chips.size(), 0);
+  s.pool->parallel_for(candidate_chips.size(), [&](unsigned i) {
+    // if the bgen directory for this chip/ancestry combination exists
+    //    and the "chr22-filtered-noNAs.sample" file exists in that directory
+    std::string bgen_directory = s.bgen_prefix + "/" +
+                                 strreplace(candidate_chips.at(i), '_', '/') +
+                                 "/" + candidate_ancestries.at(i);
+    std::string bgen_samplefile =
+        bgen_directory + "/chr22-filtered-noNAs.sample";
+    if (boost::filesystem::is_directory(bgen_directory) &&
+        boost::filesystem::is_regular_file(bgen_samplefile)) {
+      // compute number of subjects in this sample file
+      // deduct 2 because of .sample file header conventions
+      subjects.at(i) = wc(bgen_samplefile) - 2;
+      found.at(i) = 1;
+    }
+  });
+  for (unsigned i = 0; i < candidate_chips.size(); ++i) {
+    // if there are enough subjects in this sample file to run this
+    // particular software
+    if (!found.at(i) || subjects.at(i) < s.software_min_sample_size)
+      continue;
+    const std::string &chip = candidate_chips.at(i);
+    const std::string &ancestry = candidate_ancestries.at(i);
+    // build the results directory name:
+    // {results/phenotype/ancestry/SOFTWARE}
+    std::string results_prefix = _analysis_directory + "/" + ancestry + "/" +
+                                 uppercase(s.software) + "/" +
+                                 _analysis_prefix + "." + chip + "." +
+                                 lowercase(s.software);
+    // presumably build a tracker class and initialize an instance of it
+    //   and register its directory for creation
+    target t(tracking_files(results_prefix, s.schema, s.cache, s.planner));
+    t.chip = chip;
+    t.ancestry = ancestry;
+    t.n_subjects = subjects.at(i);
+    t.position = candidate_positions.at(i);
+    t.sample_file = s.bgen_prefix + "/" + strreplace(chip, '_', '/') + "/" +
+                    ancestry + "/chr22-filtered-noNAs.sample";
+    t.model_matrix = _analysis_directory + "/" + ancestry + "/" +
+                     _analysis_prefix + "." + chip + s.matrix_suffix;
+    _targets.push_back(t);
+  }
+  // start reading the database while the caller gets on with trackers
+  if (needs_database() && !s.streaming) {
+    s.library->preload_async(s.phenotype_database, s.pool);
+  }
+}
+
+bool initialize_output_directories::config_run::needs_database() const {
+  const run_settings &s = *_settings;
+  return needs_categories() ||
+         (!_targets.empty() && s.write_model_matrices && !s.pretend &&
+          !s.explain && !s.store) ||
+         (!_targets.empty() && computes_statistics() && !s.store);
+}
+
+bool initialize_output_directories::config_run::computes_statistics() const {
+  const run_settings &s = *_settings;
+  return s.write_covariate_statistics && !s.pretend &&
+         (!s.explain || s.drop_constant_covariates);
+}
+
+const initialize_output_directories::model_matrix &
+initialize_output_directories::config_run::model() {
+  std::call_once(_model_loaded, [this]() {
+    _mm = _settings->library->get(_settings->phenotype_database, _phenotype,
+                                  _covariates);
+  });
+  return _mm;
+}
+
+initialize_output_directories::column_statistics
+initialize_output_directories::config_run::statistics(const target &t) {
+  if (_settings->streaming) {
+    return _settings->streaming->statistics(_settings->phenotype_database,
+                                            _columns, t.sample_file);
+  }
+  column_statistics res(_columns);
+  res.add(model().restrict_to(read_sample_ids(t.sample_file)));
+  return res;
+}
+
+void initialize_output_directories::config_run::categorize() {
+  if (!needs_categories()) return;
+  // compute groups and sizes, combining any group with N<100 into
+  //    a single meta-group
+  if (_settings->streaming) {
+    _categories = _settings->streaming->categorize(
+        _settings->phenotype_database, _phenotype);
+  } else {
+    _categories = model().categorize(_phenotype);
+  }
+}
+
+std::vector<std::string> initialize_output_directories::config_run::
+    tracker_paths() const {
+  std::vector<std::string> paths;
+  for (std::vector<target>::const_iterator iter = _targets.begin();
+       iter != _targets.end(); ++iter) {
+    std::vector<std::string> target_paths = iter->files.tracker_paths(
+        _categories.size() > 2 ? _categories.n_comparison_groups() : 0);
+    paths.insert(paths.end(), target_paths.begin(), target_paths.end());
+  }
+  return paths;
+}
+
+void initialize_output_directories::config_run::check_trackers(
+    unsigned index) {
+  const run_settings &s = *_settings;
+  std::chrono::time_point<std::chrono::high_resolution_clock> start_time =
+      std::chrono::high_resolution_clock::now();
+  target &t = _targets.at(index);
+  const tracking_files &tf = t.files;
+  t.findings = check_report();
+  t.skipped = false;
+  t.config_changed = false;
+  t.updated = false;
+  if (s.store) {
+    std::string key = content_store::hash(_run_inputs +
+                                          tf.get_output_prefix() + "\n" +
+                                          file_signature(t.sample_file));
+    // unchanged inputs and trackers still in place: nothing to do
+    if (!s.force && s.store->has_target(key) &&
+        s.cache->is_regular_file(
+            tf.get_output_prefix() +
+            tf.get_schema().get_phenotype_dataset_suffix())) {
+      t.skipped = true;
+    } else {
+      t.key = key;
+    }
+  }
+  if (!t.skipped) {
+    t.config_changed = tf.check_config_files(*_trackers, s.pretend, s.force,
+                                             &t.findings.changed_trackers);
+  }
+  t.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::high_resolution_clock::now() - start_time)
+                       .count();
+}
+
+void initialize_output_directories::config_run::check_target(unsigned index) {
+  const run_settings &s = *_settings;
+  std::chrono::time_point<std::chrono::high_resolution_clock> start_time =
+      std::chrono::high_resolution_clock::now();
+  target &t = _targets.at(index);
+  const tracking_files &tf = t.files;
+  target_record record;
+  record.config = _config_filename;
+  record.output_prefix = tf.get_output_prefix();
+  record.chip = t.chip;
+  record.ancestry = t.ancestry;
+  record.software = s.software;
+  record.n_subjects = t.n_subjects;
+  record.n_categories = _categories.size() >= 2 ? _categories.size() : 0;
+  record.n_comparisons =
+      _categories.size() > 2 ? _categories.n_comparison_groups() : 0;
+  check_report &findings = t.findings;
+  if (!t.skipped) {
+    // make the tracker class determine if updates are needed
+    // phenotype data is only read if the database tracker is out of date
+    bool updated = false;
+    if (s.streaming) {
+      updated = tf.check_phenotype_database(
+          [this, &s](const std::string &previous) {
+            return s.streaming->equivalent(s.phenotype_database, previous,
+                                           _columns, categorized_column());
+          },
+          s.phenotype_database, s.pretend, s.force, &findings.database);
+    } else {
+      updated = tf.check_phenotype_database(
+          [this, &s](const std::string &previous) {
+            model_matrix old_mm =
+                s.library->get(previous, _phenotype, _covariates);
+            return !old_mm.empty() &&
+                   old_mm.equivalent(model(), s.comparison,
+                                     categorized_column());
+          },
+          s.phenotype_database, s.pretend, s.force, &findings.database);
+    }
+    // the database tracker is reported ahead of the config trackers
+    if (updated) {
+      const std::string &suffix =
+          tf.get_schema().get_phenotype_dataset_suffix();
+      findings.changed_trackers.insert(findings.changed_trackers.begin(),
+                                       suffix);
+    }
+    if (computes_statistics()) {
+      column_statistics stats = statistics(t);
+      tf.update_covariate_statistics(stats.format());
+      if (s.drop_constant_covariates) {
+        // the config's covariates, less those with a single value among
+        // this target's subjects, which would make the model singular
+        resolved_tracker covariates;
+        covariates.assign(tf.get_schema().get_covariates_definition(),
+                          stats.excluding_constant(_covariates));
+        if (tf.check_file(covariates, s.pretend, s.force)) {
+          findings.changed_trackers.push_back(covariates.get_suffix());
+          updated = true;
+        }
+      }
+    }
+    updated |= t.config_changed;
+    // for categoricals (n comparisons > 1)
+    //    copy top-level trackers into "comparison[1-n]" subdirectories
+    if (updated) {
+      tf.remove_finalization();
+      // if there are more than two categories
+      if (_categories.size() > 2) {
+        unsigned comparison_count = 1;
+        for (std::vector<std::set<unsigned> >::const_iterator iter =
+                 _categories.comparison_begin();
+             iter != _categories.comparison_end();
+             ++iter, ++comparison_count) {
+          // at some point, this will have to be moved outside of this
+          // conditional, as the assignment of reference and comparison
+          // groups will be exposed as a configuration variable. but for
+          // now, comparison groups are determined by phenotype database
+          // counts, which is deterministic pending things that guarantee
+          // `updated == true`
+          tf.copy_trackers(comparison_count,
+                           _categories.get_reference_group(), *iter);
+        }
+      } else if (_categories.size() == 2) {
+        tf.report_categories(tf.get_output_prefix(),
+                             _categories.get_reference_group(),
+                             *_categories.comparison_begin());
+      }
+    }
+    if (s.write_model_matrices && !s.pretend && !s.explain && s.streaming) {
+      record.model_matrix_written = tf.write_model_matrix(
+          [this, &s, &t](const std::string &filename) {
+            s.streaming->write_model_matrix(s.phenotype_database, _columns,
+                                            t.sample_file, filename,
+                                            s.matrix_format, s.pool);
+          },
+          t.model_matrix, updated, s.store);
+    } else if (s.write_model_matrices && !s.pretend && !s.explain) {
+      record.model_matrix_written = tf.write_model_matrix(
+          model(), t.sample_file, t.model_matrix, s.matrix_format, s.pool,
+          updated, s.store);
+    }
+    t.updated = updated;
+    record.updated = updated;
+    record.finalization_removed = updated;
+  }
+  t.microseconds += std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::high_resolution_clock::now() - start_time)
+                        .count();
+  if (s.report) {
+    record.skipped = t.skipped;
+    record.database = findings.database;
+    record.changed_trackers = findings.changed_trackers;
+    record.microseconds = t.microseconds;
+    s.report->write(record);
+  }
+}
+
+void initialize_output_directories::config_run::mark_complete() const {
+  for (std::vector<target>::const_iterator iter = _targets.begin();
+       iter != _targets.end(); ++iter) {
+    if (!iter->key.empty()) _settings->store->mark_target(iter->key);
+  }
+}
+
+void initialize_output_directories::config_run::emit(std::ostream &out) const {
+  // actually emit output prefixes as appropriate
+  for (std::vector<target>::const_iterator iter = _targets.begin();
+       iter != _targets.end(); ++iter) {
+    std::vector<std::string> prefixes = output_prefixes(*iter);
+    for (std::vector<std::string>::const_iterator prefix = prefixes.begin();
+         prefix != prefixes.end(); ++prefix) {
+      write_line(out, *iter, *prefix);
+    }
+  }
+}
+
+void initialize_output_directories::config_run::emit(
+    std::vector<emitted_prefix> *out) const {
+  for (std::vector<target>::const_iterator iter = _targets.begin();
+       iter != _targets.end(); ++iter) {
+    std::vector<std::string> prefixes = output_prefixes(*iter);
+    for (unsigned i = 0; i < prefixes.size(); ++i) {
+      emitted_prefix p;
+      p.line = prefixes.at(i);
+      p.updated = iter->updated;
+      // a job's time grows with its subjects; with categories, only
+      // those at the reference and compared levels are analyzed, in the
+      // proportion the whole database has them
+      p.cost = iter->n_subjects;
+      if (_categories.size() >= 2) p.cost *= _categories.comparison_share(i);
+      out->push_back(p);
+    }
+  }
+}
+
+std::vector<std::string>
+initialize_output_directories::config_run::output_prefixes(
+    const target &t) const {
+  const std::string &results_prefix = t.files.get_output_prefix();
+  std::vector<std::string> res;
+  if (_categories.size() > 2) {
+    // for categorical data, suppress the top level directory
+    // as an analysis target, and just emit the comparison
+    // subdirectories
+    for (unsigned i = 1; i <= _categories.n_comparison_groups(); ++i) {
+      res.push_back(results_prefix.substr(0, results_prefix.rfind("/")) +
+                    "/comparison" + std::to_string(i) +
+                    results_prefix.substr(results_prefix.rfind("/")));
+    }
+  } else {
+    res.push_back(results_prefix);
+  }
+  return res;
+}
+
+void initialize_output_directories::config_run::explain(
+    std::ostream &out) const {
+  for (std::vector<target>::const_iterator iter = _targets.begin();
+       iter != _targets.end(); ++iter) {
+    if (!iter->updated) continue;
+    std::string line =
+        iter->files.get_output_prefix() + '\t' + iter->findings.database + '\t';
+    for (std::vector<std::string>::const_iterator tracker =
+             iter->findings.changed_trackers.begin();
+         tracker != iter->findings.changed_trackers.end(); ++tracker) {
+      if (tracker != iter->findings.changed_trackers.begin()) line += ',';
+      line += *tracker;
+    }
+    write_line(out, *iter, line);
+  }
+}
+
+void initialize_output_directories::config_run::write_line(
+    std::ostream &out, const target &t, const std::string &line) const {
+  if (_settings->shard.active()) {
+    shard_spec::write_record(out, _index, t.position, line);
+  } else {
+    out << line << std::endl;
+  }
+}
+
+bool initialize_output_directories::emitted_prefix::longest_first(
+    const emitted_prefix &a, const emitted_prefix &b) {
+  if (a.updated != b.updated) return a.updated;
+  return a.cost > b.cost;
+}
@@ -0,0 +1,324 @@
+/*!
+  \file config_run.h
+  \brief processing of one phenotype configuration within a batch
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_CONFIG_RUN_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_CONFIG_RUN_H_
+
+#include <chrono>  // NOLINT [build/c++11]
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "initialize_output_directories/column_statistics.h"
+#include "initialize_output_directories/content_store.h"
+#include "initialize_output_directories/directory_planner.h"
+#include "initialize_output_directories/extension_schema.h"
+#include "initialize_output_directories/phenotype_library.h"
+#include "initialize_output_directories/resolved_trackers.h"
+#include "initialize_output_directories/run_report.h"
+#include "initialize_output_directories/sharding.h"
+#include "initialize_output_directories/streaming_database.h"
+#include "initialize_output_directories/thread_pool.h"
+#include "initialize_output_directories/tracker_io.h"
+#include "initialize_output_directories/tracking_files.h"
+#include "initialize_output_directories/value_comparison.h"
+#include "initialize_output_directories/yaml_reader.h"
+
+namespace initialize_output_directories {
+/*!
+  \brief settings and shared state common to every config in a run
+ */
+struct run_settings {
+  run_settings()
+      : software_min_sample_size(0),
+        pretend(false),
+        explain(false),
+        force(false),
+        write_model_matrices(false),
+        matrix_format(model_matrix::tsv),
+        write_covariate_statistics(false),
+        drop_constant_covariates(false),
+        pool(0) {}
+  std::string extension_config_filename;
+  std::string bgen_prefix;
+  std::string phenotype_database;
+  std::string phenotype_id_colname;
+  std::string results_dir;
+  std::string software;
+  unsigned software_min_sample_size;
+  bool pretend;
+  bool explain;  //!< evaluate every check in memory, writing nothing
+  bool force;
+  bool write_model_matrices;
+  std::string model_matrix_format;
+  model_matrix::output_format matrix_format;
+  std::string matrix_suffix;
+  std::string covariate_statistics_mode;
+  //! summarize each target's columns over its subjects in a tracker
+  bool write_covariate_statistics;
+  //! leave covariates constant over a target's subjects out of its
+  //! covariates tracker; needs write_covariate_statistics
+  bool drop_constant_covariates;
+  std::shared_ptr<const extension_schema> schema;
+  std::shared_ptr<tracker_cache> cache;
+  std::shared_ptr<directory_planner> planner;
+  std::shared_ptr<content_store> store;
+  std::shared_ptr<run_report> report;  //!< may be null
+  std::shared_ptr<phenotype_library> library;
+  //! if set, databases are read in bounded-memory passes instead of
+  //! through library
+  std::shared_ptr<streaming_database> streaming;
+  //! how a new database is compared with the one a target last used
+  value_comparison comparison;
+  shard_spec shard;  //!< which targets this run handles
+  thread_pool *pool;
+};
+
+/*!
+  \brief one analysis prefix a run reports, with what is known of the
+  downstream job that will analyze it
+ */
+struct emitted_prefix {
+  emitted_prefix() : cost(0.0), updated(false) {}
+  std::string line;
+  /*!
+    \brief estimated relative cost of the job: the subjects in the
+    target's bgen sample file, times the share of the database's
+    subjects its comparison analyzes, if the phenotype is categorical
+   */
+  double cost;
+  bool updated;  //!< whether its target was invalidated
+  /*!
+    \brief order for longest-job-first scheduling: invalidated targets,
+    which are certain to run, then by decreasing cost
+   */
+  static bool longest_first(const emitted_prefix &a, const emitted_prefix &b);
+};
+
+/*!
+  \class config_run
+  \brief everything one phenotype config contributes to a run
+
+  A run proceeds in phases so that configs can be processed side by
+  side: prepare() parses the config and declares the columns its
+  targets may need to the run's phenotype library; discover() finds
+  the targets, starting a background load of the database as soon as
+  one of them is certain to need it; categorize() reads the phenotype
+  categories, if a target needs them, once that load is done. In the
+  meantime the caller creates directories and prefetches trackers for
+  all configs at once, and check_trackers() compares each target's
+  config-derived trackers. check_target() then completes each target
+  with the database tracker, column statistics, category propagation
+  and model matrix; and emit() reports the analysis prefixes in a
+  fixed order. When constant covariates are dropped, the covariates
+  tracker depends on the data, so it moves from check_trackers() to
+  check_target(). A
+  database that no target needs is never read. If the settings have a
+  streaming_database, the same phases read databases in bounded-memory
+  passes through it instead of loading them.
+ */
+class config_run {
+ public:
+  /*!
+    \brief constructor
+    @param config_filename phenotype config to process
+    @param index position of the config in the batch
+    @param settings settings shared by the batch
+   */
+  config_run(const std::string &config_filename, unsigned index,
+             const run_settings *settings)
+      : _config_filename(config_filename),
+        _index(index),
+        _settings(settings),
+        _uses_software(false),
+        _uses_saige(false) {
+    if (!_settings) throw std::runtime_error("config_run: null settings");
+  }
+  ~config_run() throw() {}
+
+  /*!
+    \brief parse the config and declare the columns it may need
+   */
+  void prepare();
+
+  /*!
+    \brief find the config's targets
+    \warning call after every config is prepared, so that a background
+    load of the database covers all of them
+   */
+  void discover();
+
+  /*!
+    \brief whether categorize() will need the phenotype database
+   */
+  bool needs_categories() const { return _uses_saige && !_targets.empty(); }
+
+  /*!
+    \brief whether a target is certain to read the phenotype database
+
+    Only then is the database loaded ahead of time. With a content
+    store, whether a target needs its model matrix is only known once
+    its trackers are read, so that load stays on demand.
+   */
+  bool needs_database() const;
+
+  /*!
+    \brief whether check_target() computes covariate statistics
+
+    Explaining only needs them to decide which covariates are kept, and
+    the trackers they feed are then compared in memory, not written.
+   */
+  bool computes_statistics() const;
+
+  /*!
+    \brief compute phenotype categories, if a target needs them
+    \warning do not call from a pool task while the database is loading
+   */
+  void categorize();
+
+  /*!
+    \brief every tracker any target of this config might inspect
+
+    Comparison subdirectories are only included once categorize() has
+    run; a first call before then covers each target's own trackers.
+   */
+  std::vector<std::string> tracker_paths() const;
+
+  unsigned n_targets() const { return _targets.size(); }
+
+  const std::string &get_target_prefix(unsigned index) const {
+    return _targets.at(index).files.get_output_prefix();
+  }
+
+  /*!
+    \brief bring one target's config-derived trackers up to date
+    @param index target to check
+
+    Never reads phenotype data, so this may run while it loads.
+   */
+  void check_trackers(unsigned index);
+
+  /*!
+    \brief finish one target once categories are known
+    @param index target to check, after check_trackers()
+
+    Checks the database tracker, summarizes the target's columns,
+    propagates trackers to comparison subdirectories and writes the
+    model matrix. If the run has a
+    report, the target's record is written to it.
+   */
+  void check_target(unsigned index);
+
+  /*!
+    \brief record completed targets in the content store, if any
+    \warning call only once all tracker changes are on disk
+   */
+  void mark_complete() const;
+
+  /*!
+    \brief report this config's analysis prefixes
+
+    When sharded, each line is a fragment record for shard_spec::merge.
+   */
+  void emit(std::ostream &out) const;
+  /*!
+    \brief collect this config's analysis prefixes, with their costs
+    @param out where to append them, in the order emit() writes them
+   */
+  void emit(std::vector<emitted_prefix> *out) const;
+
+  /*!
+    \brief report each target that was invalidated, and why
+
+    One line per invalidated target: its output prefix, the phenotype
+    database state, and the invalidating tracker suffixes, tab
+    separated. Meaningful after check_target() with the run's explain
+    setting, which evaluates every check without applying it.
+   */
+  void explain(std::ostream &out) const;
+
+ private:
+  config_run(const config_run &obj) = delete;
+  config_run &operator=(const config_run &obj) = delete;
+  std::string _config_filename;
+  unsigned _index;
+  const run_settings *_settings;
+  std::unique_ptr<yaml_reader> _config;
+  std::unique_ptr<resolved_tracker_set> _trackers;
+  /*!
+    \brief this config's columns of the current database, loaded once
+   */
+  const model_matrix &model();
+  /*!
+    \brief the column whose categories are computed, if any
+   */
+  std::string categorized_column() const {
+    return _uses_saige ? _phenotype : "";
+  }
+  std::string _phenotype;
+  std::vector<std::string> _covariates;
+  //! the phenotype, then the covariates
+  std::vector<std::string> _columns;
+  std::vector<std::string> _chips;
+  std::vector<std::string> _ancestries;
+  std::string _analysis_prefix;
+  bool _uses_software;
+  bool _uses_saige;
+  std::once_flag _model_loaded;
+  model_matrix _mm;
+  categorical_variable _categories;
+  std::string _analysis_directory;
+  std::string _run_inputs;
+  /*!
+    \brief one chip/ancestry combination with enough subjects
+   */
+  struct target {
+    explicit target(const tracking_files &f)
+        : files(f),
+          n_subjects(0),
+          position(0),
+          skipped(false),
+          config_changed(false),
+          updated(false),
+          microseconds(0) {}
+    tracking_files files;
+    std::string chip;
+    std::string ancestry;
+    unsigned n_subjects;
+    unsigned position;         //!< among the config's chip/ancestry pairs
+    std::string sample_file;   //!< bgen .sample file
+    std::string model_matrix;  //!< shared by targets on a chip and ancestry
+    std::string key;           //!< content store key, if not skipped
+    bool skipped;              //!< unchanged since the store recorded it
+    bool config_changed;       //!< whether a config-derived tracker changed
+    bool updated;              //!< whether the last check invalidated it
+    check_report findings;     //!< what the last check found
+    unsigned microseconds;     //!< time spent checking it
+  };
+  std::vector<target> _targets;
+  /*!
+    \brief summarize this config's columns over a target's subjects
+   */
+  column_statistics statistics(const target &t);
+  /*!
+    \brief the analysis prefixes reported for a target: its own, or
+    one per comparison subdirectory if the phenotype has more than two
+    categories
+   */
+  std::vector<std::string> output_prefixes(const target &t) const;
+  /*!
+    \brief write one output line for a target, tagged if sharded
+   */
+  void write_line(std::ostream &out, const target &t,
+                  const std::string &line) const;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_CONFIG_RUN_H_
@@ -0,0 +1,148 @@
+/*!
+  \file content_store.cc
+  \brief implementation of content-addressed blob storage
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/content_store.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "boost/filesystem.hpp"
+#include "boost/uuid/detail/sha1.hpp"
+
+namespace {
+void throw_errno(const std::string &what, const std::string &path) {
+  throw std::runtime_error("content_store: " + what + " \"" + path +
+                           "\": " + strerror(errno));
+}
+}  // namespace
+
+initialize_output_directories::content_store::content_store(
+    const std::string &root)
+    : _root(root), _counter(0) {
+  boost::filesystem::create_directories(_root + "/objects");
+  boost::filesystem::create_directories(_root + "/targets");
+  boost::filesystem::create_directories(_root + "/tmp");
+}
+
+std::string initialize_output_directories::content_store::hash(
+    const std::string &contents) {
+  boost::uuids::detail::sha1 hasher;
+  hasher.process_bytes(contents.data(), contents.size());
+  boost::uuids::detail::sha1::digest_type digest;
+  hasher.get_digest(digest);
+  char hex[41];
+  for (unsigned i = 0; i < 5; ++i) {
+    snprintf(hex + 8 * i, 9, "%08x", digest[i]);
+  }
+  return std::string(hex, 40);
+}
+
+std::string initialize_output_directories::content_store::blob_path(
+    const std::string &digest) const {
+  return _root + "/objects/" + digest.substr(0, 2) + "/" + digest.substr(2);
+}
+
+std::string initialize_output_directories::content_store::temporary_path() {
+  return _root + "/tmp/" + std::to_string(getpid()) + "." +
+         std::to_string(_counter.fetch_add(1));
+}
+
+std::string initialize_output_directories::content_store::put(
+    const std::string &contents) {
+  std::string blob = blob_path(hash(contents));
+  struct stat st;
+  if (!stat(blob.c_str(), &st)) return blob;
+  std::string tmp = temporary_path();
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0444);
+  if (fd < 0) throw_errno("cannot create", tmp);
+  const char *data = contents.data();
+  std::size_t remaining = contents.size();
+  while (remaining) {
+    ssize_t n = write(fd, data, remaining);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      close(fd);
+      unlink(tmp.c_str());
+      throw_errno("cannot write", tmp);
+    }
+    data += n;
+    remaining -= n;
+  }
+  if (close(fd)) throw_errno("cannot write", tmp);
+  return place(tmp, blob);
+}
+
+std::string initialize_output_directories::content_store::adopt(
+    const std::string &filename) {
+  std::string contents = "";
+  {
+    std::ifstream input(filename.c_str(), std::ios_base::binary);
+    if (!input.is_open())
+      throw std::runtime_error("content_store: cannot read \"" + filename +
+                               "\"");
+    contents.assign(std::istreambuf_iterator<char>(input),
+                    std::istreambuf_iterator<char>());
+  }
+  std::string blob = blob_path(hash(contents));
+  struct stat st;
+  if (!stat(blob.c_str(), &st)) {
+    unlink(filename.c_str());
+    return blob;
+  }
+  return place(filename, blob);
+}
+
+std::string initialize_output_directories::content_store::place(
+    const std::string &filename, const std::string &blob) {
+  boost::filesystem::create_directories(blob.substr(0, blob.rfind("/")));
+  chmod(filename.c_str(), 0444);
+  // if another process raced us to the same blob, either copy is correct
+  if (rename(filename.c_str(), blob.c_str())) throw_errno("cannot store", blob);
+  return blob;
+}
+
+bool initialize_output_directories::content_store::link(
+    const std::string &blob, const std::string &target) {
+  struct stat blob_st, target_st;
+  if (stat(blob.c_str(), &blob_st)) throw_errno("missing blob", blob);
+  if (!stat(target.c_str(), &target_st) && blob_st.st_dev == target_st.st_dev &&
+      blob_st.st_ino == target_st.st_ino)
+    return false;
+  // link under a temporary name next to the target, then rename over it
+  std::string tmp = target + ".store." + std::to_string(getpid()) + "." +
+                    std::to_string(_counter.fetch_add(1));
+  if (::link(blob.c_str(), tmp.c_str())) throw_errno("cannot link", tmp);
+  if (rename(tmp.c_str(), target.c_str())) {
+    unlink(tmp.c_str());
+    throw_errno("cannot replace", target);
+  }
+  return true;
+}
+
+bool initialize_output_directories::content_store::has_target(
+    const std::string &key) const {
+  struct stat st;
+  return !stat((_root + "/targets/" + key).c_str(), &st);
+}
+
+void initialize_output_directories::content_store::mark_target(
+    const std::string &key) {
+  std::string marker = _root + "/targets/" + key;
+  std::string tmp = temporary_path();
+  {
+    std::ofstream output(tmp.c_str());
+    if (!output.is_open()) throw_errno("cannot create", tmp);
+  }
+  if (rename(tmp.c_str(), marker.c_str())) throw_errno("cannot mark", marker);
+}
@@ -0,0 +1,100 @@
+/*!
+  \file content_store.h
+  \brief content-addressed blob storage for generated files
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_CONTENT_STORE_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_CONTENT_STORE_H_
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace initialize_output_directories {
+/*!
+  \class content_store
+  \brief deduplicated storage of file payloads, keyed by content hash
+
+  Many targets carry byte-identical trackers (and every comparisonN
+  subdirectory repeats its parent's). With a store, each distinct
+  payload is written once, as {root}/objects/{hash[0:2]}/{hash[2:]},
+  and every file with that payload becomes a hard link to it. Files
+  are only ever placed by renaming a fully written temporary file, so
+  blobs never change once visible, and an interrupted run cannot leave
+  a partial blob or target behind.
+
+  The store also records completed targets under {root}/targets/{key},
+  where key hashes everything that determines a target's output, so
+  later runs can skip targets whose inputs have not changed.
+
+  The store must be on the same filesystem as the files linking into
+  it; the results directory is the natural place.
+ */
+class content_store {
+ public:
+  /*!
+    \brief constructor
+    @param root top level store directory, created if needed
+   */
+  explicit content_store(const std::string &root);
+  ~content_store() throw() {}
+
+  /*!
+    \brief hex sha1 digest of a byte sequence
+   */
+  static std::string hash(const std::string &contents);
+
+  /*!
+    \brief add a payload to the store if not already present
+    @param contents payload bytes
+    \return path of the blob holding the payload
+   */
+  std::string put(const std::string &contents);
+
+  /*!
+    \brief move a fully written file into the store
+    @param filename file to adopt; it is consumed
+    \return path of the blob holding its contents
+
+    If the store already holds the same contents, the file is simply
+    removed.
+   */
+  std::string adopt(const std::string &filename);
+
+  /*!
+    \brief point a path at a blob
+    @param blob path returned by put() or adopt()
+    @param target path to replace with a hard link to the blob
+    \return whether target changed; false if it already was the blob
+   */
+  bool link(const std::string &blob, const std::string &target);
+
+  /*!
+    \brief a unique name for a temporary file inside the store
+   */
+  std::string temporary_path();
+
+  /*!
+    \brief whether a target with this input key has completed
+   */
+  bool has_target(const std::string &key) const;
+
+  /*!
+    \brief record completion of a target with this input key
+   */
+  void mark_target(const std::string &key);
+
+  const std::string &get_root() const { return _root; }
+
+ private:
+  std::string blob_path(const std::string &digest) const;
+  std::string place(const std::string &filename, const std::string &blob);
+  std::string _root;
+  std::atomic<unsigned> _counter;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_CONTENT_STORE_H_
@@ -0,0 +1,180 @@
+/*!
+  \file database_diff.cc
+  \brief implementation of phenotype database comparison
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/database_diff.h"
+
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+bool missing(std::string_view cell) { return cell.empty() || cell == "NA"; }
+
+bool integer_like(std::string_view cell) {
+  return !cell.empty() &&
+         cell.find_first_not_of("0123456789") == std::string_view::npos;
+}
+
+/*!
+  \brief count subjects per level of a column, unless it is not categorical
+  \return false if any non-missing cell is not a non-negative integer
+ */
+bool count_levels(const std::vector<std::string_view> &column,
+                  std::map<std::string_view, unsigned> *counts) {
+  for (std::vector<std::string_view>::const_iterator iter = column.begin();
+       iter != column.end(); ++iter) {
+    if (missing(*iter)) continue;
+    if (!integer_like(*iter)) return false;
+    ++(*counts)[*iter];
+  }
+  return true;
+}
+}  // namespace
+
+void initialize_output_directories::database_diff::compare(
+    const model_matrix &old_db, const model_matrix &new_db,
+    thread_pool *pool) {
+  const std::vector<std::string_view> &old_ids = old_db.get_ids();
+  const std::vector<std::string_view> &new_ids = new_db.get_ids();
+  _n_old = old_ids.size();
+  _n_new = new_ids.size();
+  // join subjects by ID: for each new row, the matching old row or -1
+  std::unordered_map<std::string_view, unsigned> old_rows;
+  old_rows.reserve(old_ids.size());
+  for (unsigned i = 0; i < old_ids.size(); ++i) {
+    old_rows.insert(std::make_pair(old_ids.at(i), i));
+  }
+  std::vector<int> old_row(new_ids.size(), -1);
+  std::vector<char> matched(old_ids.size(), 0);
+  _subjects_added = 0;
+  _reordered = false;
+  int previous = -1;
+  for (unsigned i = 0; i < new_ids.size(); ++i) {
+    std::unordered_map<std::string_view, unsigned>::const_iterator finder =
+        old_rows.find(new_ids.at(i));
+    if (finder == old_rows.end()) {
+      ++_subjects_added;
+      continue;
+    }
+    old_row.at(i) = finder->second;
+    matched.at(finder->second) = 1;
+    if (old_row.at(i) < previous) _reordered = true;
+    previous = old_row.at(i);
+  }
+  _subjects_removed = 0;
+  for (unsigned i = 0; i < old_ids.size(); ++i) {
+    if (!matched.at(i) && old_rows[old_ids.at(i)] == i) ++_subjects_removed;
+  }
+  // every column of either version, new columns first in database order
+  _columns.clear();
+  _column_index.clear();
+  std::vector<int> old_column, new_column;
+  for (unsigned pass = 0; pass < 2; ++pass) {
+    const std::vector<std::string> &headers =
+        pass ? old_db.get_headers() : new_db.get_headers();
+    for (unsigned i = 0; i < headers.size(); ++i) {
+      std::map<std::string, unsigned>::const_iterator finder =
+          _column_index.find(headers.at(i));
+      unsigned index = 0;
+      if (finder == _column_index.end()) {
+        index = _columns.size();
+        _column_index[headers.at(i)] = index;
+        _columns.push_back(column_diff());
+        _columns.rbegin()->name = headers.at(i);
+        old_column.push_back(-1);
+        new_column.push_back(-1);
+      } else {
+        index = finder->second;
+      }
+      if (pass) {
+        _columns.at(index).in_old = true;
+        old_column.at(index) = i;
+      } else {
+        _columns.at(index).in_new = true;
+        new_column.at(index) = i;
+      }
+    }
+  }
+  // columns are independent, so each is compared in full by one worker
+  std::function<void(unsigned)> compare_column = [&](unsigned c) {
+    column_diff &diff = _columns.at(c);
+    if (!diff.in_old || !diff.in_new) return;
+    const std::vector<std::string_view> &before =
+        old_db.get_data().at(old_column.at(c));
+    const std::vector<std::string_view> &after =
+        new_db.get_data().at(new_column.at(c));
+    for (unsigned i = 0; i < after.size(); ++i) {
+      if (old_row.at(i) < 0) continue;
+      std::string_view a = before.at(old_row.at(i)), b = after.at(i);
+      if (a == b) continue;
+      if (missing(a) && missing(b)) continue;
+      if (missing(a)) {
+        ++diff.na_to_value;
+      } else if (missing(b)) {
+        ++diff.value_to_na;
+      } else {
+        ++diff.cells_changed;
+      }
+    }
+    std::map<std::string_view, unsigned> before_levels, after_levels;
+    diff.categorical = count_levels(before, &before_levels) &&
+                       count_levels(after, &after_levels);
+    if (!diff.categorical) return;
+    for (std::map<std::string_view, unsigned>::const_iterator iter =
+             before_levels.begin();
+         iter != before_levels.end(); ++iter) {
+      std::map<std::string_view, unsigned>::const_iterator finder =
+          after_levels.find(iter->first);
+      if (finder == after_levels.end() || finder->second != iter->second)
+        ++diff.level_shifts;
+    }
+    for (std::map<std::string_view, unsigned>::const_iterator iter =
+             after_levels.begin();
+         iter != after_levels.end(); ++iter) {
+      if (before_levels.find(iter->first) == before_levels.end())
+        ++diff.level_shifts;
+    }
+  };
+  if (pool) {
+    pool->parallel_for(_columns.size(), compare_column);
+  } else {
+    for (unsigned i = 0; i < _columns.size(); ++i) compare_column(i);
+  }
+}
+
+std::vector<std::string>
+initialize_output_directories::database_diff::affected_by(
+    const std::vector<std::string> &columns) const {
+  std::vector<std::string> res;
+  if (_subjects_added || _subjects_removed || _reordered)
+    res.push_back("subjects");
+  for (std::vector<std::string>::const_iterator iter = columns.begin();
+       iter != columns.end(); ++iter) {
+    std::map<std::string, unsigned>::const_iterator finder =
+        _column_index.find(*iter);
+    if (finder != _column_index.end() && _columns.at(finder->second).changed())
+      res.push_back(*iter);
+  }
+  return res;
+}
+
+void initialize_output_directories::database_diff::report(
+    std::ostream &out) const {
+  out << "subjects\t" << _n_old << '\t' << _n_new << '\t' << _subjects_added
+      << '\t' << _subjects_removed << '\t'
+      << (_reordered ? "reordered" : "same_order") << '\n';
+  for (std::vector<column_diff>::const_iterator iter = _columns.begin();
+       iter != _columns.end(); ++iter) {
+    if (!iter->changed() && !iter->level_shifts) continue;
+    out << "column\t" << iter->name << '\t'
+        << (!iter->in_old   ? "added"
+            : !iter->in_new ? "removed"
+            : iter->changed() ? "changed"
+                              : "shifted")
+        << '\t' << iter->cells_changed << '\t' << iter->value_to_na << '\t'
+        << iter->na_to_value << '\t' << iter->level_shifts << '\n';
+  }
+}
@@ -0,0 +1,121 @@
+/*!
+  \file database_diff.h
+  \brief column-level comparison of two phenotype database versions
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_DATABASE_DIFF_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_DATABASE_DIFF_H_
+
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "initialize_output_directories/thread_pool.h"
+#include "initialize_output_directories/tracking_files.h"
+
+namespace initialize_output_directories {
+/*!
+  \brief how one column differs between two database versions
+
+  Cells are compared for subjects present in both versions, matched
+  by ID. "NA" and empty cells are missing values.
+ */
+struct column_diff {
+  column_diff()
+      : in_old(false),
+        in_new(false),
+        cells_changed(0),
+        value_to_na(0),
+        na_to_value(0),
+        categorical(false),
+        level_shifts(0) {}
+  std::string name;
+  bool in_old;
+  bool in_new;
+  unsigned cells_changed;  //!< value replaced by a different value
+  unsigned value_to_na;    //!< value replaced by a missing value
+  unsigned na_to_value;    //!< missing value filled in
+  //! whether every value in both versions is a non-negative integer
+  bool categorical;
+  //! for categorical columns, levels whose subject count changed
+  unsigned level_shifts;
+
+  /*!
+    \brief whether a model matrix using this column would change
+   */
+  bool changed() const {
+    return in_old != in_new || cells_changed || value_to_na || na_to_value;
+  }
+};
+
+/*!
+  \class database_diff
+  \brief per-column changes between two versions of a phenotype database
+
+  Subjects are joined by ID once; every column is then compared
+  independently, spread across the worker pool, so databases with
+  thousands of columns are handled in a single pass over each.
+ */
+class database_diff {
+ public:
+  database_diff()
+      : _n_old(0),
+        _n_new(0),
+        _subjects_added(0),
+        _subjects_removed(0),
+        _reordered(false) {}
+  ~database_diff() throw() {}
+
+  /*!
+    \brief compare two databases loaded with model_matrix::load_all_data
+    @param old_db earlier version
+    @param new_db later version
+    @param pool worker pool for per-column comparison; may be null
+   */
+  void compare(const model_matrix &old_db, const model_matrix &new_db,
+               thread_pool *pool);
+
+  /*!
+    \brief columns of a config's model matrix that changed
+    @param columns phenotype and covariate names
+    \return the changed columns, or "subjects" if the set or order of
+    subjects changed
+   */
+  std::vector<std::string> affected_by(
+      const std::vector<std::string> &columns) const;
+
+  /*!
+    \brief write the summary as tab-delimited, tagged records
+
+    One "subjects" record with the old and new counts, the numbers
+    added and removed, and whether shared subjects were reordered
+    ("reordered" or "same_order"); then one "column" record per changed
+    column with its status, cells changed, values made missing, missing
+    values filled, and categorical level shifts. The status is added,
+    removed, changed, or shifted: level counts moved only because
+    subjects were added or removed.
+   */
+  void report(std::ostream &out) const;
+
+  unsigned subjects_added() const { return _subjects_added; }
+  unsigned subjects_removed() const { return _subjects_removed; }
+  bool reordered() const { return _reordered; }
+  const std::vector<column_diff> &get_columns() const { return _columns; }
+
+ private:
+  unsigned _n_old;
+  unsigned _n_new;
+  unsigned _subjects_added;
+  unsigned _subjects_removed;
+  //! shared subjects appear in a different relative order
+  bool _reordered;
+  std::vector<column_diff> _columns;
+  std::map<std::string, unsigned> _column_index;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_DATABASE_DIFF_H_
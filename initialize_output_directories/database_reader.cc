@@ -0,0 +1,493 @@
+/*!
+  \file database_reader.cc
+  \brief implementation of phenotype database readers
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/database_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "initialize_output_directories/arrow_database_reader.h"
+#include "initialize_output_directories/input_source.h"
+
+namespace {
+//! leading bytes read to recognize a database's format
+const std::size_t magic_size = 8;
+//! bytes of a file held at once by a streaming pass
+const std::size_t stream_window = 4 * 1024 * 1024;
+
+/*!
+  \class text_line_reader
+  \brief lines of a text file, plain or compressed
+ */
+class text_line_reader {
+ public:
+  /*!
+    \brief constructor
+    @param window see input_source::open
+   */
+  text_line_reader(const std::string &filename,
+                   initialize_output_directories::thread_pool *pool,
+                   std::size_t window)
+      : _filename(filename),
+        _input(initialize_output_directories::input_source::open(
+            filename, pool, window)),
+        _next(0),
+        _end(0),
+        _carry_used(false),
+        _unread(false),
+        _unread_f(0),
+        _unread_l(0) {}
+  /*!
+    \brief find the next complete line, [*f, *l) excluding the newline
+   */
+  bool next_line(const char **f, const char **l);
+  /*!
+    \brief hand back the line just read, so the next call returns it again
+   */
+  void unread_line(const char *f, const char *l) {
+    _unread = true;
+    _unread_f = f;
+    _unread_l = l;
+  }
+  const std::string &filename() const { return _filename; }
+
+ private:
+  std::string _filename;
+  std::unique_ptr<initialize_output_directories::input_source> _input;
+  //! unconsumed part of the current block
+  const char *_next;
+  const char *_end;
+  //! a line split across blocks
+  std::string _carry;
+  bool _carry_used;
+  bool _unread;
+  const char *_unread_f;
+  const char *_unread_l;
+};
+
+bool text_line_reader::next_line(const char **f, const char **l) {
+  if (_unread) {
+    // still valid: nothing has been read since
+    _unread = false;
+    *f = _unread_f;
+    *l = _unread_l;
+    return true;
+  }
+  // plain files are mapped and arrive as one block or a series of
+  // windows; compressed files arrive as a series of blocks. lines may be
+  // split across block boundaries
+  if (_carry_used) {
+    _carry.clear();
+    _carry_used = false;
+  }
+  while (true) {
+    if (_next < _end) {
+      const char *newline =
+          static_cast<const char *>(memchr(_next, '\n', _end - _next));
+      if (!newline) {
+        _carry.append(_next, _end - _next);
+        _next = _end;
+      } else if (_carry.empty()) {
+        *f = _next;
+        *l = newline;
+        _next = newline + 1;
+        return true;
+      } else {
+        // finish a line left over from the previous block
+        _carry.append(_next, newline - _next);
+        _next = newline + 1;
+        *f = _carry.data();
+        *l = _carry.data() + _carry.size();
+        _carry_used = true;
+        return true;
+      }
+    }
+    std::size_t block_size = 0;
+    if (!_input->next_block(&_next, &block_size)) {
+      if (!_carry.empty()) {
+        throw std::runtime_error("insufficient tokens in phenotype file \"" +
+                                 _filename + "\"");
+      }
+      _next = _end = 0;
+      return false;
+    }
+    _end = _next + block_size;
+  }
+}
+
+/*
+  Delimited text formats. Each splits one cell at a time from a line
+  [*f, l): on success, *cell is the cell and *f is advanced past its
+  separator; false means the line holds no more cells. last is set for
+  the final column of a row. Quoted cells that need unescaping are
+  built in unescaped, which has room for the whole line, so the views
+  of a row stay valid together.
+ */
+
+/*!
+  \brief cells separated by single tabs, taken as they are; the last
+  column runs to the end of the line
+ */
+struct tsv_format {
+  static const bool quoted = false;
+  static bool next_cell(const char **f, const char *l, bool last,
+                        std::string *unescaped, std::string_view *cell,
+                        const std::string &filename) {
+    if (*f > l) return false;
+    const char *end =
+        last ? l : static_cast<const char *>(memchr(*f, '\t', l - *f));
+    if (!end) end = l;
+    *cell = std::string_view(*f, end - *f);
+    *f = end + 1;
+    return true;
+  }
+};
+
+/*!
+  \brief cells separated by commas, optionally double quoted with quotes
+  doubled inside; a quoted cell may not span lines
+ */
+struct csv_format {
+  static const bool quoted = true;
+  static bool next_cell(const char **f, const char *l, bool last,
+                        std::string *unescaped, std::string_view *cell,
+                        const std::string &filename) {
+    if (*f > l) return false;
+    if (*f == l || **f != '"') {
+      const char *end = static_cast<const char *>(memchr(*f, ',', l - *f));
+      if (!end) end = l;
+      *cell = std::string_view(*f, end - *f);
+      *f = end + 1;
+      return true;
+    }
+    const char *start = *f + 1, *from = start;
+    std::size_t mark = unescaped->size();
+    bool escaped = false;
+    while (true) {
+      const char *quote =
+          from < l ? static_cast<const char *>(memchr(from, '"', l - from))
+                   : 0;
+      if (!quote)
+        throw std::runtime_error(
+            "unterminated quoted cell in phenotype file \"" + filename +
+            "\"");
+      if (quote + 1 < l && quote[1] == '"') {
+        unescaped->append(from, quote + 1 - from);
+        from = quote + 2;
+        escaped = true;
+        continue;
+      }
+      if (quote + 1 < l && quote[1] != ',')
+        throw std::runtime_error("text after quoted cell in phenotype file \"" +
+                                 filename + "\"");
+      if (escaped) {
+        unescaped->append(from, quote - from);
+        *cell = std::string_view(unescaped->data() + mark,
+                                 unescaped->size() - mark);
+      } else {
+        *cell = std::string_view(start, quote - start);
+      }
+      *f = quote + 2;
+      return true;
+    }
+  }
+};
+
+/*!
+  \brief cells separated by runs of spaces and tabs; leading and
+  trailing blanks are ignored
+ */
+struct whitespace_format {
+  static const bool quoted = false;
+  static bool is_blank(char c) { return c == ' ' || c == '\t'; }
+  static bool next_cell(const char **f, const char *l, bool last,
+                        std::string *unescaped, std::string_view *cell,
+                        const std::string &filename) {
+    while (*f < l && is_blank(**f)) ++*f;
+    if (*f >= l) return false;
+    const char *end = *f;
+    while (end < l && !is_blank(*end)) ++end;
+    *cell = std::string_view(*f, end - *f);
+    *f = end;
+    return true;
+  }
+};
+
+enum text_format { tsv_text, csv_text, whitespace_text };
+
+/*!
+  \brief how a text database is laid out, found from its leading lines
+ */
+struct text_layout {
+  text_layout() : format(tsv_text), crlf(false) {}
+  text_format format;
+  bool crlf;  //!< lines end in "\r\n"
+  std::vector<std::string> names;  //!< every column header
+};
+
+template <class format>
+std::vector<std::string> split_header(const char *f, const char *l,
+                                      const std::string &filename) {
+  std::vector<std::string> res;
+  std::string unescaped;
+  unescaped.reserve(l - f);
+  std::string_view cell;
+  while (format::next_cell(&f, l, false, &unescaped, &cell, filename)) {
+    res.push_back(std::string(cell));
+  }
+  return res;
+}
+
+/*!
+  \brief read the header row and choose a format for the file
+
+  A header with tabs is tab-delimited and one with commas is CSV.
+  Otherwise, the header is split on blanks, and the rows are
+  tab-delimited if the first of them has a tab, as older releases are,
+  and split on blanks if not.
+ */
+text_layout read_layout(text_line_reader *lines) {
+  const char *f = 0, *l = 0;
+  if (!lines->next_line(&f, &l)) {
+    throw std::runtime_error("no header in phenotype file \"" +
+                             lines->filename() + "\"");
+  }
+  text_layout res;
+  if (l > f && l[-1] == '\r') {
+    res.crlf = true;
+    --l;
+  }
+  if (memchr(f, '\t', l - f)) {
+    res.format = tsv_text;
+    res.names = split_header<tsv_format>(f, l, lines->filename());
+  } else if (memchr(f, ',', l - f)) {
+    res.format = csv_text;
+    res.names = split_header<csv_format>(f, l, lines->filename());
+  } else {
+    res.names = split_header<whitespace_format>(f, l, lines->filename());
+    res.format = whitespace_text;
+    if (lines->next_line(&f, &l)) {
+      if (memchr(f, '\t', l - f)) res.format = tsv_text;
+      lines->unread_line(f, l);
+    }
+  }
+  return res;
+}
+
+/*!
+  \class text_database_cursor
+  \brief rows of delimited text, split by a format chosen at compile time
+ */
+template <class format, bool crlf>
+class text_database_cursor
+    : public initialize_output_directories::database_cursor {
+ public:
+  /*!
+    \brief constructor
+    @param lines lines of the file, after the header row
+    @param names every column header
+   */
+  text_database_cursor(
+      std::unique_ptr<text_line_reader> lines,
+      const std::vector<std::string> &names,
+      const initialize_output_directories::column_selection &selection);
+  bool next(std::string_view *id, std::vector<std::string_view> *cells);
+  /*!
+    \brief advance to the next row, handing each wanted cell to a function
+    @param visit called as visit(slot, is_id, cell), with slot the
+    cell's index among the selected columns, or -1
+    \return false once the database is exhausted
+   */
+  template <class visitor>
+  bool next_cells(const visitor &visit);
+
+ private:
+  std::unique_ptr<text_line_reader> _lines;
+  //! for each input column, its index among the extracted columns, or -1
+  std::vector<int> _column_slot;
+  unsigned _id_colnum;
+  //! quoted cells of the current row that needed unescaping
+  std::string _unescaped;
+};
+
+template <class format, bool crlf>
+text_database_cursor<format, crlf>::text_database_cursor(
+    std::unique_ptr<text_line_reader> lines,
+    const std::vector<std::string> &names,
+    const initialize_output_directories::column_selection &selection)
+    : _lines(std::move(lines)), _id_colnum(0) {
+  unsigned nfound = 0;
+  for (std::vector<std::string>::const_iterator iter = names.begin();
+       iter != names.end(); ++iter) {
+    if (selection.wants(*iter)) {
+      _column_slot.push_back(nfound++);
+      _headers.push_back(*iter);
+    } else {
+      _column_slot.push_back(-1);
+    }
+    if (!iter->compare(selection.id)) {
+      _id_colnum = _column_slot.size() - 1;
+    }
+  }
+}
+
+template <class format, bool crlf>
+template <class visitor>
+bool text_database_cursor<format, crlf>::next_cells(const visitor &visit) {
+  const char *f = 0, *l = 0;
+  if (!_lines->next_line(&f, &l)) return false;
+  if (crlf && l > f && l[-1] == '\r') --l;
+  if (format::quoted) {
+    _unescaped.clear();
+    _unescaped.reserve(l - f);
+  }
+  std::string_view cell;
+  for (unsigned i = 0; i < _column_slot.size(); ++i) {
+    if (!format::next_cell(&f, l, i == _column_slot.size() - 1, &_unescaped,
+                           &cell, _lines->filename()))
+      throw std::runtime_error("insufficient tokens in phenotype file \"" +
+                               _lines->filename() + "\"");
+    if (i == _id_colnum || _column_slot[i] >= 0)
+      visit(_column_slot[i], i == _id_colnum, cell);
+  }
+  return true;
+}
+
+template <class format, bool crlf>
+bool text_database_cursor<format, crlf>::next(
+    std::string_view *id, std::vector<std::string_view> *cells) {
+  cells->resize(_headers.size());
+  return next_cells([id, cells](int slot, bool is_id, std::string_view cell) {
+    if (is_id) *id = cell;
+    if (slot >= 0) (*cells)[slot] = cell;
+  });
+}
+
+template <class format, bool crlf, class action>
+void open_text_cursor(
+    std::unique_ptr<text_line_reader> lines, const text_layout &layout,
+    const initialize_output_directories::column_selection &selection,
+    const action &act) {
+  act(std::unique_ptr<text_database_cursor<format, crlf> >(
+      new text_database_cursor<format, crlf>(std::move(lines), layout.names,
+                                             selection)));
+}
+
+/*!
+  \brief open a cursor over a text database, specialized for its layout
+  @param window see input_source::open
+  @param act called with a unique_ptr to the cursor
+
+  The format is chosen once per file, so each format's splitting is
+  compiled into its own loop.
+ */
+template <class action>
+void open_text_cursor(
+    const std::string &filename,
+    initialize_output_directories::thread_pool *pool, std::size_t window,
+    const initialize_output_directories::column_selection &selection,
+    const action &act) {
+  std::unique_ptr<text_line_reader> lines(
+      new text_line_reader(filename, pool, window));
+  text_layout layout = read_layout(lines.get());
+  switch (layout.format) {
+    case csv_text:
+      if (layout.crlf)
+        return open_text_cursor<csv_format, true>(std::move(lines), layout,
+                                                  selection, act);
+      return open_text_cursor<csv_format, false>(std::move(lines), layout,
+                                                 selection, act);
+    case whitespace_text:
+      if (layout.crlf)
+        return open_text_cursor<whitespace_format, true>(
+            std::move(lines), layout, selection, act);
+      return open_text_cursor<whitespace_format, false>(
+          std::move(lines), layout, selection, act);
+    default:
+      if (layout.crlf)
+        return open_text_cursor<tsv_format, true>(std::move(lines), layout,
+                                                  selection, act);
+      return open_text_cursor<tsv_format, false>(std::move(lines), layout,
+                                                 selection, act);
+  }
+}
+
+/*!
+  \class text_database_reader
+  \brief delimited text with a header row: tab-delimited, CSV, or
+  split on blanks, with "\n" or "\r\n" line endings
+ */
+class text_database_reader
+    : public initialize_output_directories::database_reader {
+ public:
+  text_database_reader(const std::string &filename,
+                       initialize_output_directories::thread_pool *pool)
+      : _filename(filename), _pool(pool) {}
+  void read(const initialize_output_directories::column_selection &selection,
+            initialize_output_directories::database_table *table);
+  std::unique_ptr<initialize_output_directories::database_cursor> stream(
+      const initialize_output_directories::column_selection &selection) {
+    std::unique_ptr<initialize_output_directories::database_cursor> res;
+    open_text_cursor(_filename, 0, stream_window, selection,
+                     [&res](auto cursor) { res = std::move(cursor); });
+    return res;
+  }
+  std::string name() const { return "text"; }
+
+ private:
+  std::string _filename;
+  initialize_output_directories::thread_pool *_pool;
+};
+
+void text_database_reader::read(
+    const initialize_output_directories::column_selection &selection,
+    initialize_output_directories::database_table *table) {
+  // the whole file at once, decompressed with the pool if any
+  open_text_cursor(_filename, _pool, 0, selection, [table](auto cursor) {
+    table->headers = cursor->headers();
+    table->data.resize(table->headers.size());
+    while (cursor->next_cells(
+        [table](int slot, bool is_id, std::string_view cell) {
+          // the ID column may itself be selected; store it once
+          std::string_view stored =
+              table->arena.store(cell.data(), cell.size());
+          if (is_id) table->ids.push_back(stored);
+          if (slot >= 0) table->data[slot].push_back(stored);
+        })) {
+    }
+  });
+}
+}  // namespace
+
+bool initialize_output_directories::column_selection::wants(
+    const std::string &name) const {
+  if (all) return name.compare(id) != 0;
+  return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+std::unique_ptr<initialize_output_directories::database_reader>
+initialize_output_directories::database_reader::open(
+    const std::string &filename, thread_pool *pool) {
+  char magic[magic_size];
+  memset(magic, 0, sizeof(magic));
+  {
+    std::ifstream probe(filename.c_str(), std::ios_base::binary);
+    if (!probe.is_open())
+      throw std::runtime_error(
+          "initialize_output_directories::model_matrix::load_data: "
+          "cannot open file \"" +
+          filename + "\"");
+    probe.read(magic, sizeof(magic));
+  }
+  if (!memcmp(magic, "PAR1", 4)) return open_arrow(filename, parquet_file);
+  if (!memcmp(magic, "ARROW1", 6)) return open_arrow(filename, arrow_ipc_file);
+  if (!memcmp(magic, "\xff\xff\xff\xff", 4))
+    return open_arrow(filename, arrow_ipc_stream);
+  return std::unique_ptr<database_reader>(
+      new text_database_reader(filename, pool));
+}
@@ -0,0 +1,135 @@
+/*!
+  \file database_reader.h
+  \brief pluggable readers for phenotype database formats
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_DATABASE_READER_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_DATABASE_READER_H_
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "initialize_output_directories/arena.h"
+#include "initialize_output_directories/thread_pool.h"
+
+namespace initialize_output_directories {
+/*!
+  \brief columns extracted from a phenotype database
+
+  The views point into arena, so the table owns every byte it refers to.
+ */
+struct database_table {
+  string_arena arena;
+  std::vector<std::string_view> ids;
+  std::vector<std::string> headers;
+  //! one vector of cells per extracted column, in database order
+  std::vector<std::vector<std::string_view> > data;
+};
+
+/*!
+  \brief which columns of a database to extract
+ */
+struct column_selection {
+  column_selection() : all(false) {}
+  std::string id;  //!< subject ID column header
+  bool all;        //!< every column other than the ID column
+  std::vector<std::string> names;  //!< otherwise, the columns wanted
+
+  bool wants(const std::string &name) const;
+};
+
+/*!
+  \class database_cursor
+  \brief the rows of a database, one at a time
+
+  A cursor holds no more than a fixed-size window of its file, so a
+  pass over a database of any size runs in bounded memory.
+ */
+class database_cursor {
+ public:
+  virtual ~database_cursor() throw() {}
+
+  /*!
+    \brief names of the selected columns, in database order
+   */
+  const std::vector<std::string> &headers() const { return _headers; }
+
+  /*!
+    \brief advance to the next row
+    @param id where to store the row's subject ID
+    @param cells where to store the row's selected cells, in header order
+    \return false once the database is exhausted
+
+    The views stay valid until the next call.
+   */
+  virtual bool next(std::string_view *id,
+                    std::vector<std::string_view> *cells) = 0;
+
+ protected:
+  std::vector<std::string> _headers;
+};
+
+/*!
+  \class database_reader
+  \brief extracts selected columns from one phenotype database file
+
+  Every reader produces the same table for the same logical contents:
+  the selected columns in database order, the ID column (the first
+  column if no header matches) as subject IDs, and cells as the exact
+  bytes of the delimited text, less any CSV quoting, or, for Parquet
+  and Arrow, typed values written as text (see open_arrow). Change
+  detection and categorization therefore do not depend on the format a
+  release was published in.
+ */
+class database_reader {
+ public:
+  virtual ~database_reader() throw() {}
+
+  /*!
+    \brief extract columns
+    @param selection columns to extract
+    @param table empty table to fill
+   */
+  virtual void read(const column_selection &selection,
+                    database_table *table) = 0;
+
+  /*!
+    \brief read selected columns row by row, in bounded memory
+    @param selection columns to extract
+    \return cursor at the first row; it may outlive the reader
+
+    The rows are those read() would extract, in the same order. Reads
+    are made without the worker pool, so this may be called from a
+    pool task.
+   */
+  virtual std::unique_ptr<database_cursor> stream(
+      const column_selection &selection) = 0;
+
+  /*!
+    \brief short name of the format, for messages
+   */
+  virtual std::string name() const = 0;
+
+  /*!
+    \brief open a database, choosing a reader from its leading bytes
+    @param filename name of file to open
+    @param pool worker pool for parallel decompression; may be null
+    \return reader for the file
+
+    Parquet files and Arrow IPC files and streams are recognized by
+    their magic bytes (see open_arrow). Anything else is read as
+    delimited text with a header row, plain or compressed (see
+    input_source::open): tab-delimited, CSV, or split on blanks, as the
+    header row shows, with either line ending.
+   */
+  static std::unique_ptr<database_reader> open(const std::string &filename,
+                                               thread_pool *pool);
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_DATABASE_READER_H_
@@ -0,0 +1,68 @@
+/*!
+  \file directory_locks.cc
+  \brief implementation of advisory directory locks
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/directory_locks.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+initialize_output_directories::directory_locks::~directory_locks() throw() {
+  // remove each lock file while still holding it, so a run waiting on
+  // it sees it is stale; closing the descriptor releases its lock
+  for (unsigned i = 0; i < _fds.size(); ++i) {
+    unlink(_filenames.at(i).c_str());
+    close(_fds.at(i));
+  }
+}
+
+std::string initialize_output_directories::directory_locks::lock_filename(
+    const std::string &prefix) {
+  std::string::size_type slash = prefix.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : prefix.substr(0, slash);
+  std::string stem =
+      slash == std::string::npos ? prefix : prefix.substr(slash + 1);
+  return dir + "/." + stem + ".lock";
+}
+
+void initialize_output_directories::directory_locks::acquire(
+    const std::set<std::string> &prefixes) {
+  if (!_fds.empty())
+    throw std::runtime_error("directory_locks: locks already held");
+  for (std::set<std::string>::const_iterator iter = prefixes.begin();
+       iter != prefixes.end(); ++iter) {
+    std::string filename = lock_filename(*iter);
+    while (true) {
+      int fd = open(filename.c_str(), O_RDONLY | O_CREAT | O_CLOEXEC, 0666);
+      if (fd < 0)
+        throw std::runtime_error("cannot open lock file \"" + filename +
+                                 "\": " + strerror(errno));
+      while (flock(fd, LOCK_EX)) {
+        if (errno != EINTR) {
+          int error = errno;
+          close(fd);
+          throw std::runtime_error("cannot lock \"" + *iter +
+                                   "\": " + strerror(error));
+        }
+      }
+      // the previous holder may have removed the file while this run
+      // waited; the lock only counts if it is on the file at the name
+      struct stat held, named;
+      if (!fstat(fd, &held) && !stat(filename.c_str(), &named) &&
+          held.st_dev == named.st_dev && held.st_ino == named.st_ino) {
+        _fds.push_back(fd);
+        _filenames.push_back(filename);
+        break;
+      }
+      close(fd);
+    }
+  }
+}
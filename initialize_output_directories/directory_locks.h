@@ -0,0 +1,64 @@
+/*!
+  \file directory_locks.h
+  \brief advisory locks shared with concurrent runs
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_DIRECTORY_LOCKS_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_DIRECTORY_LOCKS_H_
+
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace initialize_output_directories {
+/*!
+  \class directory_locks
+  \brief exclusive flock()s on a set of output prefixes, held until
+  destruction
+
+  Several instances of this program may run against one results
+  directory at once (e.g. under make -j, or as shards of one batch).
+  Runs touching the same output prefix must not interleave their
+  tracker checks and updates, so each run locks the prefixes it will
+  modify before reading any tracker, and keeps them until its changes
+  are on disk. Everything a run modifies belongs to a single prefix,
+  or (model matrices) is replaced atomically, so runs on different
+  prefixes of one analysis proceed in parallel. Each prefix is locked
+  through a hidden lock file in its directory, which the holder removes
+  on release, so a finished run leaves no lock files in the results
+  tree; a run that locked a file since removed retries on the file now
+  at its name. Locks are always taken in sorted order, so runs with
+  overlapping prefix sets cannot deadlock. The kernel releases the
+  locks if the process dies, leaving only the lock files behind.
+ */
+class directory_locks {
+ public:
+  directory_locks() {}
+  ~directory_locks() throw();
+
+  /*!
+    \brief block until every prefix is locked
+    @param prefixes output prefixes, in existing directories, to lock
+    \warning may only be called once per object
+   */
+  void acquire(const std::set<std::string> &prefixes);
+
+  /*!
+    \brief name of the lock file for an output prefix
+    @param prefix output prefix, directory and file stem
+    \return the hidden lock file beside the prefix's trackers
+   */
+  static std::string lock_filename(const std::string &prefix);
+
+ private:
+  directory_locks(const directory_locks &) = delete;
+  directory_locks &operator=(const directory_locks &) = delete;
+  std::vector<int> _fds;
+  std::vector<std::string> _filenames;  //!< lock file of each descriptor
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_DIRECTORY_LOCKS_H_
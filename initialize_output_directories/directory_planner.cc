@@ -0,0 +1,106 @@
+/*!
+  \file directory_planner.cc
+  \brief implementation of batched directory creation
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/directory_planner.h"
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+
+namespace {
+std::string normalize(const std::string &dir) {
+  std::string res = dir;
+  while (res.size() > 1 && *res.rbegin() == '/') res.erase(res.size() - 1);
+  return res;
+}
+
+std::string parent(const std::string &dir) {
+  std::string::size_type pos = dir.rfind("/");
+  if (pos == std::string::npos) return "";
+  if (!pos) return dir.size() > 1 ? "/" : "";
+  return normalize(dir.substr(0, pos));
+}
+
+unsigned depth(const std::string &dir) {
+  unsigned res = 0;
+  for (std::string::const_iterator iter = dir.begin(); iter != dir.end();
+       ++iter) {
+    if (*iter == '/') ++res;
+  }
+  return res;
+}
+}  // namespace
+
+void initialize_output_directories::directory_planner::require(
+    const std::string &dir) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _pending.push_back(normalize(dir));
+}
+
+void initialize_output_directories::directory_planner::create(
+    thread_pool *pool) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::vector<std::string> dirs;
+  dirs.swap(_pending);
+  create_locked(dirs, pool);
+}
+
+void initialize_output_directories::directory_planner::ensure(
+    const std::string &dir) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  create_locked(std::vector<std::string>(1, normalize(dir)), 0);
+}
+
+void initialize_output_directories::directory_planner::create_locked(
+    const std::vector<std::string> &dirs, thread_pool *pool) {
+  // find what is missing, walking up only as far as the first directory
+  // already known or found to exist
+  std::set<std::string> planned;
+  std::map<unsigned, std::vector<std::string> > missing_by_depth;
+  struct stat st;
+  for (std::vector<std::string>::const_iterator iter = dirs.begin();
+       iter != dirs.end(); ++iter) {
+    for (std::string dir = *iter; !dir.empty(); dir = parent(dir)) {
+      if (_existing.find(dir) != _existing.end() ||
+          planned.find(dir) != planned.end())
+        break;
+      if (!stat(dir.c_str(), &st)) {
+        if (!S_ISDIR(st.st_mode))
+          throw std::runtime_error("cannot create directory \"" + *iter +
+                                   "\": \"" + dir + "\" is not a directory");
+        _existing.insert(dir);
+        break;
+      }
+      planned.insert(dir);
+      missing_by_depth[depth(dir)].push_back(dir);
+    }
+  }
+  // shallowest first, so every parent exists before its children
+  for (std::map<unsigned, std::vector<std::string> >::const_iterator level =
+           missing_by_depth.begin();
+       level != missing_by_depth.end(); ++level) {
+    const std::vector<std::string> &batch = level->second;
+    std::vector<int> errors(batch.size(), 0);
+    std::function<void(unsigned)> make = [this, &batch, &errors](unsigned i) {
+      if (_dry_run) return;
+      if (mkdir(batch[i].c_str(), 0777) && errno != EEXIST) errors[i] = errno;
+    };
+    if (pool) {
+      pool->parallel_for(batch.size(), make);
+    } else {
+      for (unsigned i = 0; i < batch.size(); ++i) make(i);
+    }
+    for (unsigned i = 0; i < batch.size(); ++i) {
+      if (errors[i])
+        throw std::runtime_error("cannot create directory \"" + batch[i] +
+                                 "\": " + strerror(errors[i]));
+      _existing.insert(batch[i]);
+    }
+  }
+}
@@ -0,0 +1,71 @@
+/*!
+  \file directory_planner.h
+  \brief batched creation of the results directory tree
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_DIRECTORY_PLANNER_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_DIRECTORY_PLANNER_H_
+
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "initialize_output_directories/thread_pool.h"
+
+namespace initialize_output_directories {
+/*!
+  \class directory_planner
+  \brief collects required directories and creates the missing ones
+
+  boost::filesystem::create_directories stats every component of a
+  path from the root on each call, so creating one directory per target
+  repeats the same ancestor lookups for every target. The planner
+  instead remembers every directory it has seen exist or created. Each
+  required directory is checked from the leaf upwards only until a known
+  or existing ancestor is found. The missing directories are then
+  created one depth level at a time, each level in parallel, so that
+  parents always precede children. A dry-run planner performs the same
+  lookups but creates nothing.
+ */
+class directory_planner {
+ public:
+  directory_planner() : _dry_run(false) {}
+  /*!
+    \brief constructor
+    @param dry_run whether to only record, never create, directories
+   */
+  explicit directory_planner(bool dry_run) : _dry_run(dry_run) {}
+  ~directory_planner() throw() {}
+
+  /*!
+    \brief queue a directory (and any missing ancestors) for creation
+   */
+  void require(const std::string &dir);
+
+  /*!
+    \brief create every queued directory that does not yet exist
+    @param pool worker pool for concurrent creation; may be null
+   */
+  void create(thread_pool *pool);
+
+  /*!
+    \brief create a single directory immediately, if not already known
+   */
+  void ensure(const std::string &dir);
+
+ private:
+  directory_planner(const directory_planner &) = delete;
+  directory_planner &operator=(const directory_planner &) = delete;
+  void create_locked(const std::vector<std::string> &dirs, thread_pool *pool);
+  bool _dry_run;
+  std::mutex _mutex;
+  std::set<std::string> _existing;
+  std::vector<std::string> _pending;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_DIRECTORY_PLANNER_H_
@@ -0,0 +1,129 @@
+/*!
+  \file extension_schema.cc
+  \brief implementation of compiled extension config
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/extension_schema.h"
+
+#include <map>
+
+void initialize_output_directories::extension_schema::compile(
+    const yaml_reader &config) {
+  // pull the required presets from this extension configuration
+  _phenotype_dataset_suffix = config.get_entry("phenotype-dataset");
+  _phenotype.set_name("phenotype");
+  _phenotype.set_extension(config.get_entry("phenotype"));
+  _covariates.set_name("covariates");
+  _covariates.set_extension(config.get_entry("covariates"));
+  _covariates.set_default("NA");
+  // the categories tracking suffix is permitted to be NA in the original code
+  // which indicated the use of BOLT or fastGWA, one of the methods that doesn't
+  // operate on categorical/binary traits. but now, the categorical tracker is
+  // specified once in the global tracker extension file and never again.
+  // so, it's appropriate to unconditionally search for it here, but later
+  // on the tracker should only run when the trait is actually categorical or
+  // binary
+  _categories_suffix = config.get_entry("categories");
+  _finalized_suffix = config.get_entry("finalization");
+  // added after the others, so older extension configs may lack it
+  _covariate_statistics_suffix =
+      config.query_valid("covariate-statistics")
+          ? config.get_entry("covariate-statistics")
+          : ".covariate_statistics";
+  // get as many custom extensions as are available
+  YAML::Node data;
+  data = config.get_node("general-extensions");
+  // should be a map
+  if (data.Type() != YAML::NodeType::Map) {
+    throw std::runtime_error(
+        "initialize: extensions config entry 'general-extensions'"
+        " is supposed to be a YAML Map, but is not :(");
+  }
+  std::map<std::string, extension_definition> general_extensions;
+  std::string observed_name = "", observed_suffix = "", observed_default = "",
+              observed_option = "";
+  for (YAML::const_iterator iter = data.begin(); iter != data.end(); ++iter) {
+    if (iter->second["suffix"] && iter->second["default"]) {
+      if (iter->second["suffix"].IsScalar() &&
+          iter->second["default"].IsScalar()) {
+        extension_definition edef;
+        observed_name = iter->first.as<std::string>();
+        observed_suffix = iter->second["suffix"].as<std::string>();
+        observed_default = iter->second["default"].as<std::string>();
+        edef.set_name(observed_name);
+        edef.set_extension(observed_suffix);
+        edef.set_default(observed_default);
+        // there is an optional "options" section that contains the predefined
+        // permitted values for this extension tracker
+        if (iter->second["options"]) {
+          if (iter->second["options"].Type() == YAML::NodeType::Scalar) {
+            observed_option = iter->second["options"].as<std::string>();
+            edef.add_permitted_value(observed_option);
+          } else if (iter->second["options"].Type() ==
+                     YAML::NodeType::Sequence) {
+            for (YAML::const_iterator options_iter =
+                     iter->second["options"].begin();
+                 options_iter != iter->second["options"].end();
+                 ++options_iter) {
+              observed_option = options_iter->as<std::string>();
+              edef.add_permitted_value(observed_option);
+            }
+          } else {
+            throw std::runtime_error(
+                "initialize: extensions config entry 'general-extensions'"
+                " key '" +
+                observed_name +
+                "' section 'options' contains "
+                "invalid data type (likely a Map which is not supported");
+          }
+        }
+        general_extensions[observed_name] = edef;
+      } else {
+        throw std::runtime_error(
+            "initialize: extensions config entry 'general-extensions'"
+            " key '" +
+            iter->first.as<std::string>() +
+            "' is supposed to contain "
+            "simple key:value pairs, but is not for either entry 'suffix' or "
+            "'default'");
+      }
+    } else {
+      throw std::runtime_error(
+          "initialize: extensions config entry 'general-extensions'"
+          " should have maps containing at least keys 'suffix' and "
+          "'default', but key '" +
+          iter->first.as<std::string>() + "' does not");
+    }
+  }
+  // intern: IDs are positions in name order
+  _general_extensions.clear();
+  _general_extensions.reserve(general_extensions.size());
+  for (std::map<std::string, extension_definition>::const_iterator iter =
+           general_extensions.begin();
+       iter != general_extensions.end(); ++iter) {
+    _general_extensions.push_back(iter->second);
+  }
+}
+
+bool initialize_output_directories::extension_schema::find_general_extension(
+    const std::string &name, unsigned *id) const {
+  if (!id)
+    throw std::runtime_error("find_general_extension: null pointer");
+  unsigned lower = 0, upper = _general_extensions.size();
+  while (lower < upper) {
+    unsigned mid = lower + (upper - lower) / 2;
+    int cmp = _general_extensions.at(mid).get_name().compare(name);
+    if (!cmp) {
+      *id = mid;
+      return true;
+    }
+    if (cmp < 0) {
+      lower = mid + 1;
+    } else {
+      upper = mid;
+    }
+  }
+  return false;
+}
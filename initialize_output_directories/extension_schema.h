@@ -0,0 +1,158 @@
+/*!
+  \file extension_schema.h
+  \brief compiled representation of the tracking file extension config
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_EXTENSION_SCHEMA_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_EXTENSION_SCHEMA_H_
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "initialize_output_directories/yaml_reader.h"
+
+namespace initialize_output_directories {
+class extension_definition {
+ public:
+  extension_definition() : _name(""), _extension(""), _default("") {}
+  extension_definition(const extension_definition &obj)
+      : _name(obj._name),
+        _extension(obj._extension),
+        _default(obj._default),
+        _permitted_values(obj._permitted_values) {}
+  ~extension_definition() throw() {}
+
+  void set_name(const std::string &s) { _name = s; }
+  const std::string &get_name() const { return _name; }
+  void set_extension(const std::string &s) { _extension = s; }
+  const std::string &get_extension() const { return _extension; }
+  void set_default(const std::string &s) { _default = s; }
+  const std::string &get_default() const { return _default; }
+  void add_permitted_value(const std::string &s) {
+    std::vector<std::string>::iterator finder =
+        std::lower_bound(_permitted_values.begin(), _permitted_values.end(), s);
+    if (finder == _permitted_values.end() || finder->compare(s))
+      _permitted_values.insert(finder, s);
+  }
+  bool is_permitted_value(const std::string &s) const {
+    return _permitted_values.empty() ||
+           std::binary_search(_permitted_values.begin(),
+                              _permitted_values.end(), s);
+  }
+
+ private:
+  std::string _name;
+  std::string _extension;
+  std::string _default;
+  std::vector<std::string> _permitted_values;  //!< sorted, unique
+};
+
+/*!
+  \class extension_schema
+  \brief immutable, compiled form of the extension configuration file
+
+  The extension config is identical for every analysis target in a run,
+  so it is validated and compiled exactly once and then shared by pointer
+  across all tracking_files instances. General extension trackers are
+  interned to small integer IDs, assigned in name order.
+ */
+class extension_schema {
+ public:
+  /*!
+    \brief compile an extension configuration
+    @param config loaded extension configuration file
+   */
+  explicit extension_schema(const yaml_reader &config) { compile(config); }
+  ~extension_schema() throw() {}
+
+  /*!
+    \brief compile an extension configuration into a shareable schema
+    @param config loaded extension configuration file
+    \return pointer to the compiled, immutable schema
+   */
+  static std::shared_ptr<const extension_schema> create(
+      const yaml_reader &config) {
+    return std::make_shared<const extension_schema>(config);
+  }
+
+  const std::string &get_phenotype_dataset_suffix() const {
+    return _phenotype_dataset_suffix;
+  }
+  const std::string &get_phenotype_suffix() const {
+    return _phenotype.get_extension();
+  }
+  const std::string &get_covariates_suffix() const {
+    return _covariates.get_extension();
+  }
+  const std::string &get_categories_suffix() const {
+    return _categories_suffix;
+  }
+  const std::string &get_finalized_suffix() const { return _finalized_suffix; }
+  /*!
+    \brief get the suffix of the per-target column statistics tracker
+
+    Optional in the extension config, as the tracker is only written
+    on request; defaults to ".covariate_statistics".
+   */
+  const std::string &get_covariate_statistics_suffix() const {
+    return _covariate_statistics_suffix;
+  }
+  /*!
+    \brief get the definition of the required phenotype tracker
+   */
+  const extension_definition &get_phenotype_definition() const {
+    return _phenotype;
+  }
+  /*!
+    \brief get the definition of the optional covariates tracker
+   */
+  const extension_definition &get_covariates_definition() const {
+    return _covariates;
+  }
+  /*!
+    \brief get the number of general extension trackers
+   */
+  unsigned n_general_extensions() const { return _general_extensions.size(); }
+  /*!
+    \brief get a general extension tracker by interned ID
+    @param id tracker ID, in [0, n_general_extensions())
+   */
+  const extension_definition &get_general_extension(unsigned id) const {
+    return _general_extensions.at(id);
+  }
+  /*!
+    \brief find the interned ID of a general extension tracker
+    @param name tracker name as listed in the config
+    @param id where to store the ID if found
+    \return whether the tracker exists
+   */
+  bool find_general_extension(const std::string &name, unsigned *id) const;
+  std::vector<extension_definition>::const_iterator general_begin() const {
+    return _general_extensions.begin();
+  }
+  std::vector<extension_definition>::const_iterator general_end() const {
+    return _general_extensions.end();
+  }
+
+ private:
+  extension_schema() {
+    throw std::domain_error(
+        "extension_schema: do not use default constructor");
+  }
+  void compile(const yaml_reader &config);
+  std::string _phenotype_dataset_suffix;
+  std::string _categories_suffix;
+  std::string _finalized_suffix;
+  std::string _covariate_statistics_suffix;
+  extension_definition _phenotype;
+  extension_definition _covariates;
+  std::vector<extension_definition> _general_extensions;  //!< sorted by name
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_EXTENSION_SCHEMA_H_
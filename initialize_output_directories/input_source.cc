@@ -0,0 +1,735 @@
+/*!
+  \file input_source.cc
+  \brief implementation of plain and compressed input readers
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/input_source.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <vector>
+
+#include "boost/iostreams/device/file.hpp"
+#include "boost/iostreams/filtering_stream.hpp"
+#include "initialize_output_directories/config.h"
+#ifdef INITIALIZE_OUTPUT_DIRECTORIES_HAVE_BOOST_ZSTD
+#include "boost/iostreams/filter/zstd.hpp"
+#endif
+
+namespace {
+const std::size_t stream_block_size = 4 * 1024 * 1024;
+//! block size for reading a whole plain file with pread
+const std::size_t read_block_size = 16 * 1024 * 1024;
+//! O_DIRECT buffer, offset and length alignment
+const std::size_t direct_alignment = 4096;
+
+enum read_strategy { automatic, mapped, buffered, direct };
+std::atomic<int> configured_strategy(automatic);
+
+std::mutex statistics_mutex;
+std::map<std::string,
+         initialize_output_directories::input_source::read_statistics>
+    statistics;
+
+/*!
+  \class read_meter
+  \brief bytes one file delivered and the time spent reading them
+ */
+class read_meter {
+ public:
+  explicit read_meter(const std::string &label)
+      : _label(label), _bytes(0), _seconds(0.0), _recorded(false) {}
+  ~read_meter() throw() {
+    try {
+      finish();
+    } catch (...) {
+    }
+  }
+  void set_label(const std::string &label) { _label = label; }
+  void add(std::size_t bytes) { _bytes += bytes; }
+  void add_seconds(double seconds) { _seconds += seconds; }
+  /*!
+    \brief record the file's statistics, once
+   */
+  void finish() {
+    if (_recorded) return;
+    _recorded = true;
+    std::lock_guard<std::mutex> lock(statistics_mutex);
+    initialize_output_directories::input_source::read_statistics &s =
+        statistics[_label];
+    ++s.n_files;
+    s.bytes += _bytes;
+    s.seconds += _seconds;
+  }
+
+ private:
+  std::string _label;
+  uint64_t _bytes;
+  double _seconds;
+  bool _recorded;
+};
+
+/*!
+  \class read_timer
+  \brief adds the time until it goes out of scope to a read_meter
+ */
+class read_timer {
+ public:
+  explicit read_timer(read_meter *meter)
+      : _meter(meter), _start(std::chrono::steady_clock::now()) {}
+  ~read_timer() throw() {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - _start;
+    _meter->add_seconds(elapsed.count());
+  }
+
+ private:
+  read_meter *_meter;
+  std::chrono::steady_clock::time_point _start;
+};
+
+/*!
+  \brief fault in pages of a mapping now, rather than as they are read
+ */
+void populate(char *data, std::size_t size) {
+#ifdef MADV_POPULATE_READ
+  if (!madvise(data, size, MADV_POPULATE_READ)) return;
+#endif
+  madvise(data, size, MADV_WILLNEED);
+}
+
+std::runtime_error open_failure(const std::string &filename) {
+  return std::runtime_error(
+      "initialize_output_directories::model_matrix::load_data: "
+      "cannot open file \"" +
+      filename + "\"");
+}
+
+/*!
+  \brief whether a file lives on a network or parallel filesystem
+ */
+bool on_remote_filesystem(const std::string &filename) {
+  struct statfs info;
+  if (statfs(filename.c_str(), &info)) return false;
+  switch (static_cast<uint64_t>(info.f_type)) {
+    case 0x47504653:  // GPFS
+    case 0x0bd00bd0:  // Lustre
+    case 0x6969:      // NFS
+    case 0x517b:      // SMB
+    case 0xff534d42:  // CIFS
+    case 0xfe534d42:  // SMB2
+    case 0x00c36400:  // CephFS
+    case 0x19830326:  // BeeGFS
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*!
+  \class mapped_input_source
+  \brief uncompressed file, memory mapped and handed out as one block, or
+  as a series of windows
+ */
+class mapped_input_source : public initialize_output_directories::input_source {
+ public:
+  mapped_input_source(const std::string &filename, std::size_t window)
+      : _data(0),
+        _size(0),
+        _window(window),
+        _offset(0),
+        _last(0),
+        _done(false),
+        _meter("mmap") {
+    // https://stackoverflow.com/questions/17925051/fast-textfile-reading-in-c
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info)) {
+      if (fd >= 0) ::close(fd);
+      throw open_failure(filename);
+    }
+    _size = info.st_size;
+    if (_size) {
+      // read whole, the file is prefaulted in large sequential reads;
+      // windows are prefaulted as they are handed out
+      read_timer timer(&_meter);
+      void *data = mmap(0, _size, PROT_READ,
+                        MAP_SHARED | (_window ? 0 : MAP_POPULATE), fd, 0);
+      if (data == MAP_FAILED) {
+        ::close(fd);
+        throw open_failure(filename);
+      }
+      _data = static_cast<char *>(data);
+      madvise(_data, _size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+      if (!_window) madvise(_data, _size, MADV_HUGEPAGE);
+#endif
+    }
+    ::close(fd);
+    _done = !_size;
+  }
+  ~mapped_input_source() throw() {
+    if (_data) munmap(_data, _size);
+  }
+  bool next_block(const char **data, std::size_t *size) {
+    if (_window && _last) {
+      // the previous window is finished with: drop its pages from this
+      // process, so that resident memory stays at about one window. the
+      // mapping starts on a page boundary and windows are whole pages
+      madvise(_data + _offset - _last, _last, MADV_DONTNEED);
+      _last = 0;
+    }
+    if (_done) {
+      _meter.finish();
+      return false;
+    }
+    std::size_t remaining = _size - _offset;
+    *data = _data + _offset;
+    *size = _window && _window < remaining ? _window : remaining;
+    _offset += *size;
+    _last = *size;
+    _done = _offset == _size;
+    if (_window) {
+      read_timer timer(&_meter);
+      populate(const_cast<char *>(*data), *size);
+    }
+    _meter.add(*size);
+    return true;
+  }
+
+ private:
+  char *_data;
+  std::size_t _size;
+  std::size_t _window;
+  std::size_t _offset;
+  std::size_t _last;
+  bool _done;
+  read_meter _meter;
+};
+
+/*!
+  \class pread_input_source
+  \brief uncompressed file read in large blocks, one block ahead
+
+  Each block is read on a thread of its own while the consumer works on
+  the previous one, so the file is read in a steady series of large
+  sequential requests. With O_DIRECT, reads bypass the page cache;
+  filesystems that refuse it are read normally.
+ */
+class pread_input_source : public initialize_output_directories::input_source {
+ public:
+  pread_input_source(const std::string &filename, std::size_t block_size,
+                     bool use_direct);
+  ~pread_input_source() throw();
+  bool next_block(const char **data, std::size_t *size);
+
+ private:
+  /*!
+    \brief fill a buffer from an offset, stopping short only at the end
+    of the file
+   */
+  std::size_t read_at(char *buffer, uint64_t offset) const;
+  void launch(unsigned index);
+  std::string _filename;
+  int _fd;
+  bool _direct;
+  std::size_t _block_size;
+  char *_buffers[2];
+  uint64_t _offset;  //!< of the next block to request
+  unsigned _current;
+  bool _started;
+  std::future<std::size_t> _pending;
+  read_meter _meter;
+};
+
+pread_input_source::pread_input_source(const std::string &filename,
+                                       std::size_t block_size,
+                                       bool use_direct)
+    : _filename(filename),
+      _fd(-1),
+      _direct(false),
+      _block_size((block_size + direct_alignment - 1) / direct_alignment *
+                  direct_alignment),
+      _offset(0),
+      _current(0),
+      _started(false),
+      _meter("pread") {
+  _buffers[0] = _buffers[1] = 0;
+  if (use_direct) {
+    _fd = ::open(filename.c_str(), O_RDONLY | O_DIRECT);
+    _direct = _fd >= 0;
+  }
+  if (_fd < 0) _fd = ::open(filename.c_str(), O_RDONLY);
+  if (_fd < 0) throw open_failure(filename);
+  if (_direct) _meter.set_label("direct");
+  posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  for (unsigned i = 0; i < 2; ++i) {
+    void *buffer = 0;
+    if (posix_memalign(&buffer, direct_alignment, _block_size)) {
+      free(_buffers[0]);
+      ::close(_fd);
+      throw std::bad_alloc();
+    }
+    _buffers[i] = static_cast<char *>(buffer);
+  }
+}
+
+pread_input_source::~pread_input_source() throw() {
+  try {
+    if (_pending.valid()) _pending.wait();
+  } catch (...) {
+  }
+  free(_buffers[0]);
+  free(_buffers[1]);
+  ::close(_fd);
+}
+
+std::size_t pread_input_source::read_at(char *buffer, uint64_t offset) const {
+  std::size_t total = 0;
+  while (total < _block_size) {
+    ssize_t n = pread(_fd, buffer + total, _block_size - total, offset + total);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0)
+      throw std::runtime_error("cannot read phenotype file \"" + _filename +
+                               "\": " + strerror(errno));
+    if (!n) break;
+    total += n;
+    // direct reads must stay aligned; a short one is the end of the file
+    if (_direct && total % direct_alignment) break;
+  }
+  return total;
+}
+
+void pread_input_source::launch(unsigned index) {
+  char *buffer = _buffers[index];
+  uint64_t offset = _offset;
+  _offset += _block_size;
+  _pending = std::async(std::launch::async, [this, buffer, offset]() {
+    read_timer timer(&_meter);
+    return read_at(buffer, offset);
+  });
+}
+
+bool pread_input_source::next_block(const char **data, std::size_t *size) {
+  if (!_started) {
+    _started = true;
+    launch(_current);
+  }
+  if (!_pending.valid()) {
+    _meter.finish();
+    return false;
+  }
+  std::size_t got = _pending.get();
+  _meter.add(got);
+  char *ready = _buffers[_current];
+  _current = 1 - _current;
+  // the other buffer held the previous block, which is now released
+  if (got == _block_size) launch(_current);
+  if (!got) {
+    _meter.finish();
+    return false;
+  }
+  *data = ready;
+  *size = got;
+  return true;
+}
+
+/*!
+  \class gzip_input_source
+  \brief single-threaded streaming gzip, including multi-member files
+ */
+class gzip_input_source : public initialize_output_directories::input_source {
+ public:
+  explicit gzip_input_source(const std::string &filename)
+      : _filename(filename),
+        _input(filename.c_str(), std::ios_base::binary),
+        _in_buffer(1024 * 1024),
+        _out_buffer(stream_block_size),
+        _finished(false),
+        _member_done(false),
+        _meter("gzip") {
+    if (!_input.is_open())
+      throw std::runtime_error("cannot open gzip file \"" + filename + "\"");
+    memset(&_stream, 0, sizeof(_stream));
+    // 15 + 32: maximum window, autodetect gzip/zlib header
+    if (inflateInit2(&_stream, 15 + 32) != Z_OK)
+      throw std::runtime_error("cannot initialize zlib for \"" + filename +
+                               "\"");
+  }
+  ~gzip_input_source() throw() { inflateEnd(&_stream); }
+  bool next_block(const char **data, std::size_t *size) {
+    if (_finished) return false;
+    read_timer timer(&_meter);
+    _stream.next_out = reinterpret_cast<Bytef *>(&_out_buffer[0]);
+    _stream.avail_out = _out_buffer.size();
+    while (_stream.avail_out) {
+      if (!_stream.avail_in) {
+        _input.read(&_in_buffer[0], _in_buffer.size());
+        _stream.next_in = reinterpret_cast<Bytef *>(&_in_buffer[0]);
+        _stream.avail_in = _input.gcount();
+        if (!_stream.avail_in) {
+          // a file cut off mid-member would otherwise load short
+          if (!_member_done)
+            throw std::runtime_error("truncated gzip file \"" + _filename +
+                                     "\"");
+          _finished = true;
+          break;
+        }
+      }
+      int res = inflate(&_stream, Z_NO_FLUSH);
+      _member_done = res == Z_STREAM_END;
+      if (res == Z_STREAM_END) {
+        // concatenated members are legal gzip; keep going if more follows
+        inflateReset(&_stream);
+      } else if (res != Z_OK && res != Z_BUF_ERROR) {
+        throw std::runtime_error("gzip decompression failed for \"" +
+                                 _filename + "\"");
+      }
+    }
+    *data = &_out_buffer[0];
+    *size = _out_buffer.size() - _stream.avail_out;
+    _meter.add(*size);
+    if (!*size && _finished) _meter.finish();
+    return *size || !_finished;
+  }
+
+ private:
+  std::string _filename;
+  std::ifstream _input;
+  std::vector<char> _in_buffer;
+  std::vector<char> _out_buffer;
+  z_stream _stream;
+  bool _finished;
+  bool _member_done;  //!< whether the last input ended a whole member
+  read_meter _meter;
+};
+
+#ifdef INITIALIZE_OUTPUT_DIRECTORIES_HAVE_BOOST_ZSTD
+/*!
+  \class zstd_input_source
+  \brief single-threaded streaming zstd via boost::iostreams
+ */
+class zstd_input_source : public initialize_output_directories::input_source {
+ public:
+  explicit zstd_input_source(const std::string &filename)
+      : _filename(filename), _buffer(stream_block_size), _meter("zstd") {
+    _input.push(boost::iostreams::zstd_decompressor());
+    _input.push(boost::iostreams::file_source(filename, std::ios_base::binary));
+    if (!_input.good())
+      throw std::runtime_error("cannot open zstd file \"" + filename + "\"");
+  }
+  bool next_block(const char **data, std::size_t *size) {
+    read_timer timer(&_meter);
+    try {
+      _input.read(&_buffer[0], _buffer.size());
+    } catch (const std::exception &e) {
+      throw std::runtime_error("zstd decompression failed for \"" + _filename +
+                               "\": " + e.what());
+    }
+    if (_input.bad())
+      throw std::runtime_error("zstd decompression failed for \"" +
+                               _filename + "\"");
+    *data = &_buffer[0];
+    *size = _input.gcount();
+    _meter.add(*size);
+    if (!*size) _meter.finish();
+    return *size;
+  }
+
+ private:
+  std::string _filename;
+  boost::iostreams::filtering_istream _input;
+  std::vector<char> _buffer;
+  read_meter _meter;
+};
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_HAVE_BOOST_ZSTD
+
+/*!
+  \class bgzf_input_source
+  \brief blocked gzip, decompressed in parallel batches
+
+  BGZF files are a series of independent gzip members of at most 64KB
+  uncompressed, each recording its compressed size in a header field
+  and its uncompressed size in the trailer. That allows a batch of
+  blocks to be read sequentially and then inflated concurrently, each
+  directly into its final offset in the output buffer. While the
+  consumer works on one batch the next one is decompressed, so memory
+  is bounded by two batches.
+ */
+class bgzf_input_source : public initialize_output_directories::input_source {
+ public:
+  bgzf_input_source(const std::string &filename,
+                    initialize_output_directories::thread_pool *pool)
+      : _filename(filename),
+        _input(filename.c_str(), std::ios_base::binary),
+        _pool(pool),
+        _blocks_per_batch(64 * (pool ? pool->size() : 1)),
+        _current(0),
+        _started(false),
+        _last_block_empty(false),
+        _meter("bgzf") {
+    if (!_input.is_open())
+      throw std::runtime_error("cannot open bgzf file \"" + filename + "\"");
+  }
+  ~bgzf_input_source() throw() {
+    // help rather than block, in case the batch is queued behind us
+    try {
+      if (_pending.valid() && _pool) _pool->await(&_pending);
+    } catch (...) {
+    }
+  }
+  bool next_block(const char **data, std::size_t *size);
+
+ private:
+  struct batch {
+    std::vector<char> compressed;
+    std::vector<std::size_t> block_offsets;  //!< into compressed; n + 1
+    std::vector<std::size_t> output_offsets;  //!< into output; n + 1
+    std::vector<char> output;
+  };
+  bool read_batch(batch *b);
+  void decompress_batch(batch *b);
+  void launch(unsigned index);
+  std::string _filename;
+  std::ifstream _input;
+  initialize_output_directories::thread_pool *_pool;
+  unsigned _blocks_per_batch;
+  batch _batches[2];
+  unsigned _current;
+  bool _started;
+  //! whether the last block read was empty, as the EOF marker is
+  bool _last_block_empty;
+  std::future<void> _pending;
+  read_meter _meter;
+};
+
+bool bgzf_input_source::read_batch(batch *b) {
+  b->compressed.clear();
+  b->block_offsets.assign(1, 0);
+  b->output_offsets.assign(1, 0);
+  unsigned char header[18];
+  while (b->block_offsets.size() <= _blocks_per_batch) {
+    if (!_input.read(reinterpret_cast<char *>(header), 12)) {
+      if (_input.gcount() == 0) {
+        // bgzip ends every file with an empty block; without it, the
+        // file was cut off at a block boundary
+        if (!_last_block_empty)
+          throw std::runtime_error("truncated bgzf file \"" + _filename +
+                                   "\": no end-of-file marker");
+        break;
+      }
+      throw std::runtime_error("truncated bgzf block header in \"" +
+                               _filename + "\"");
+    }
+    if (header[0] != 0x1f || header[1] != 0x8b || !(header[3] & 4))
+      throw std::runtime_error("invalid bgzf block header in \"" + _filename +
+                               "\"");
+    unsigned xlen = header[10] | (header[11] << 8);
+    std::vector<unsigned char> extra(xlen);
+    if (xlen && !_input.read(reinterpret_cast<char *>(&extra[0]), xlen))
+      throw std::runtime_error("truncated bgzf extra field in \"" + _filename +
+                               "\"");
+    // locate the BC subfield carrying the total block size minus one
+    unsigned bsize = 0;
+    bool found = false;
+    for (unsigned i = 0; i + 4 <= xlen;) {
+      unsigned slen = extra[i + 2] | (extra[i + 3] << 8);
+      if (extra[i] == 'B' && extra[i + 1] == 'C' && slen == 2 &&
+          i + 6 <= xlen) {
+        bsize = extra[i + 4] | (extra[i + 5] << 8);
+        found = true;
+        break;
+      }
+      i += 4 + slen;
+    }
+    if (!found || bsize + 1 < 12 + xlen + 8)
+      throw std::runtime_error("missing bgzf block size in \"" + _filename +
+                               "\"");
+    std::size_t remaining = bsize + 1 - 12 - xlen;
+    std::size_t offset = b->compressed.size();
+    b->compressed.resize(offset + remaining);
+    if (!_input.read(&b->compressed[offset], remaining))
+      throw std::runtime_error("truncated bgzf block in \"" + _filename +
+                               "\"");
+    const unsigned char *trailer = reinterpret_cast<const unsigned char *>(
+        &b->compressed[offset + remaining - 4]);
+    std::size_t isize = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) |
+                        (static_cast<std::size_t>(trailer[3]) << 24);
+    _last_block_empty = !isize;
+    b->block_offsets.push_back(b->compressed.size());
+    b->output_offsets.push_back(*b->output_offsets.rbegin() + isize);
+  }
+  return b->block_offsets.size() > 1;
+}
+
+void bgzf_input_source::decompress_batch(batch *b) {
+  b->output.resize(*b->output_offsets.rbegin());
+  unsigned n_blocks = b->block_offsets.size() - 1;
+  std::function<void(unsigned)> inflate_block = [this, b](unsigned i) {
+    // each block: raw deflate payload, then crc32 and isize
+    const char *payload = &b->compressed[0] + b->block_offsets.at(i);
+    std::size_t payload_size =
+        b->block_offsets.at(i + 1) - b->block_offsets.at(i) - 8;
+    std::size_t expected =
+        b->output_offsets.at(i + 1) - b->output_offsets.at(i);
+    // zlib rejects a null output pointer even for empty blocks
+    char empty = 0;
+    char *out = expected ? &b->output[0] + b->output_offsets.at(i) : &empty;
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, -15) != Z_OK)
+      throw std::runtime_error("cannot initialize zlib for \"" + _filename +
+                               "\"");
+    stream.next_in =
+        reinterpret_cast<Bytef *>(const_cast<char *>(payload));
+    stream.avail_in = payload_size;
+    stream.next_out = reinterpret_cast<Bytef *>(out);
+    stream.avail_out = expected;
+    int res = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    if (res != Z_STREAM_END || stream.avail_out)
+      throw std::runtime_error("bgzf block decompression failed in \"" +
+                               _filename + "\"");
+    const unsigned char *trailer =
+        reinterpret_cast<const unsigned char *>(payload + payload_size);
+    uLong stored_crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) |
+                       (static_cast<uLong>(trailer[3]) << 24);
+    if (crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(out),
+              expected) != stored_crc)
+      throw std::runtime_error("bgzf block crc mismatch in \"" + _filename +
+                               "\"");
+  };
+  if (_pool) {
+    _pool->parallel_for(n_blocks, inflate_block);
+  } else {
+    for (unsigned i = 0; i < n_blocks; ++i) inflate_block(i);
+  }
+}
+
+void bgzf_input_source::launch(unsigned index) {
+  batch *b = &_batches[index];
+  if (_pool) {
+    _pending = _pool->submit([this, b]() { decompress_batch(b); });
+  } else {
+    std::promise<void> done;
+    decompress_batch(b);
+    done.set_value();
+    _pending = done.get_future();
+  }
+}
+
+bool bgzf_input_source::next_block(const char **data, std::size_t *size) {
+  // decompression ahead of the consumer is not counted, only waits for it
+  read_timer timer(&_meter);
+  if (!_started) {
+    _started = true;
+    if (!read_batch(&_batches[_current])) return false;
+    launch(_current);
+  }
+  while (true) {
+    if (!_pending.valid()) {
+      _meter.finish();
+      return false;
+    }
+    if (_pool) {
+      _pool->await(&_pending);
+    } else {
+      _pending.get();
+    }
+    batch *ready = &_batches[_current];
+    _current = 1 - _current;
+    // queue up the next batch before handing this one out
+    if (read_batch(&_batches[_current])) launch(_current);
+    if (!ready->output.empty()) {
+      *data = &ready->output[0];
+      *size = ready->output.size();
+      _meter.add(*size);
+      return true;
+    }
+    // batch of empty blocks (e.g. the EOF marker); move on
+  }
+}
+}  // namespace
+
+std::unique_ptr<initialize_output_directories::input_source>
+initialize_output_directories::input_source::open(const std::string &filename,
+                                                  thread_pool *pool) {
+  return open(filename, pool, 0);
+}
+
+std::unique_ptr<initialize_output_directories::input_source>
+initialize_output_directories::input_source::open(const std::string &filename,
+                                                  thread_pool *pool,
+                                                  std::size_t window) {
+  unsigned char magic[14];
+  memset(magic, 0, sizeof(magic));
+  {
+    std::ifstream probe(filename.c_str(), std::ios_base::binary);
+    if (!probe.is_open()) throw open_failure(filename);
+    probe.read(reinterpret_cast<char *>(magic), sizeof(magic));
+  }
+  if (magic[0] == 0x1f && magic[1] == 0x8b) {
+    if ((magic[3] & 4) && magic[12] == 'B' && magic[13] == 'C') {
+      return std::unique_ptr<input_source>(
+          new bgzf_input_source(filename, pool));
+    }
+    return std::unique_ptr<input_source>(new gzip_input_source(filename));
+  }
+  if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+      magic[3] == 0xfd) {
+#ifdef INITIALIZE_OUTPUT_DIRECTORIES_HAVE_BOOST_ZSTD
+    return std::unique_ptr<input_source>(new zstd_input_source(filename));
+#else
+    throw std::runtime_error("\"" + filename +
+                             "\" is zstd compressed, but this build has no "
+                             "zstd support; reconfigure with boost iostreams "
+                             "built with zstd, or decompress it first");
+#endif
+  }
+  int strategy = configured_strategy;
+  if (strategy == automatic)
+    strategy = on_remote_filesystem(filename) ? buffered : mapped;
+  if (strategy == mapped)
+    return std::unique_ptr<input_source>(
+        new mapped_input_source(filename, window));
+  return std::unique_ptr<input_source>(new pread_input_source(
+      filename, window ? window : read_block_size, strategy == direct));
+}
+
+void initialize_output_directories::input_source::set_read_strategy(
+    const std::string &name) {
+  if (!name.compare("auto")) {
+    configured_strategy = automatic;
+  } else if (!name.compare("mmap")) {
+    configured_strategy = mapped;
+  } else if (!name.compare("pread")) {
+    configured_strategy = buffered;
+  } else if (!name.compare("direct")) {
+    configured_strategy = direct;
+  } else {
+    throw std::runtime_error("unrecognized database read strategy: \"" +
+                             name + "\"");
+  }
+}
+
+std::map<std::string,
+         initialize_output_directories::input_source::read_statistics>
+initialize_output_directories::input_source::get_read_statistics() {
+  std::lock_guard<std::mutex> lock(statistics_mutex);
+  return statistics;
+}
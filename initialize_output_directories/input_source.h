@@ -0,0 +1,101 @@
+/*!
+  \file input_source.h
+  \brief block-wise access to plain or compressed phenotype databases
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_INPUT_SOURCE_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_INPUT_SOURCE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "initialize_output_directories/thread_pool.h"
+
+namespace initialize_output_directories {
+/*!
+  \class input_source
+  \brief sequence of contiguous byte blocks making up one input file
+
+  Consumers must not assume blocks end on line boundaries. A block
+  stays valid until the next call to next_block.
+ */
+class input_source {
+ public:
+  virtual ~input_source() throw() {}
+
+  /*!
+    \brief acquire the next block of the file
+    @param data where to store the start of the block
+    @param size where to store the length of the block
+    \return false once the input is exhausted
+   */
+  virtual bool next_block(const char **data, std::size_t *size) = 0;
+
+  /*!
+    \brief open a file, choosing a reader from its leading magic bytes
+    @param filename name of file to open
+    @param pool worker pool for parallel decompression; may be null
+    \return reader for the file
+
+    Plain text is read with the strategy chosen by set_read_strategy:
+    memory mapped and returned as a single block, or read in large
+    blocks, one block ahead of the consumer. gzip is streamed; BGZF
+    (blocked gzip, as written by bgzip) is decompressed in parallel
+    batches of blocks, one batch ahead of the consumer. zstd is
+    streamed.
+   */
+  static std::unique_ptr<input_source> open(const std::string &filename,
+                                            thread_pool *pool);
+  /*!
+    \brief open a file for a single pass in bounded memory
+    @param window for plain text, the block size, a multiple of the page
+    size; 0 for the whole file as a single block
+
+    Mapped plain text is handed out one window at a time, each window's
+    pages being released once the next is requested; otherwise plain
+    text is read a window at a time.
+   */
+  static std::unique_ptr<input_source> open(const std::string &filename,
+                                            thread_pool *pool,
+                                            std::size_t window);
+
+  /*!
+    \brief choose how plain files opened from now on are read
+    @param name one of:
+     - "mmap": memory mapped, with sequential access and huge page
+       hints, and prefaulted when read whole
+     - "pread": large sequential reads, each made on a separate thread
+       while the consumer works on the previous block
+     - "direct": as pread, bypassing the page cache where the
+       filesystem supports O_DIRECT
+     - "auto": pread on network and parallel filesystems (GPFS, Lustre,
+       NFS and the like), where page faults are served slowly; mmap
+       elsewhere
+   */
+  static void set_read_strategy(const std::string &name);
+
+  /*!
+    \brief input read by one strategy
+   */
+  struct read_statistics {
+    read_statistics() : n_files(0), bytes(0), seconds(0.0) {}
+    unsigned n_files;
+    uint64_t bytes;  //!< bytes delivered, after any decompression
+    //! time spent reading (and decompressing) them, summed over files
+    double seconds;
+  };
+
+  /*!
+    \brief input read so far by each strategy or compressed format
+   */
+  static std::map<std::string, read_statistics> get_read_statistics();
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_INPUT_SOURCE_H_
@@ -5,16 +5,145 @@
   Copyright 2020 Cameron Palmer.
  */
 
+#include <algorithm>
 #include <chrono>  // NOLINT [build/c++11]
+#include <future>  // NOLINT [build/c++11]
 #include <iostream>
+#include <map>
+#include <memory>
+#include <set>
 #include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
-#include "boost/filesystem.hpp"
 #include "initialize_output_directories/cargs.h"
-#include "initialize_output_directories/tracking_files.h"
+#include "initialize_output_directories/config_run.h"
+#include "initialize_output_directories/content_store.h"
+#include "initialize_output_directories/database_diff.h"
+#include "initialize_output_directories/directory_locks.h"
+#include "initialize_output_directories/directory_planner.h"
+#include "initialize_output_directories/extension_schema.h"
+#include "initialize_output_directories/input_source.h"
+#include "initialize_output_directories/phenotype_library.h"
+#include "initialize_output_directories/run_report.h"
+#include "initialize_output_directories/sharding.h"
+#include "initialize_output_directories/streaming_database.h"
+#include "initialize_output_directories/thread_pool.h"
+#include "initialize_output_directories/tracker_io.h"
 #include "initialize_output_directories/utilities.h"
 #include "initialize_output_directories/yaml_reader.h"
 
+namespace {
+/*!
+  \brief compare two phenotype databases and the configs they affect
+  @param ap parsed command line, with --diff-database set
+  \return exit status
+ */
+int diff_databases(const initialize_output_directories::cargs &ap) {
+  initialize_output_directories::thread_pool pool(ap.get_threads());
+  initialize_output_directories::model_matrix old_db, new_db;
+  old_db.set_id(ap.get_phenotype_id_colname());
+  new_db.set_id(ap.get_phenotype_id_colname());
+  {
+    initialize_output_directories::task_group group(&pool);
+    std::string old_filename = ap.get_diff_database();
+    std::string new_filename = ap.get_phenotype_database();
+    group.run([&old_db, old_filename, &pool]() {
+      old_db.load_all_data(old_filename, &pool);
+    });
+    group.run([&new_db, new_filename, &pool]() {
+      new_db.load_all_data(new_filename, &pool);
+    });
+    group.wait();
+  }
+  initialize_output_directories::database_diff diff;
+  diff.compare(old_db, new_db, &pool);
+  diff.report(std::cout);
+  if (!ap.compute_flag("phenotype-config")) return 0;
+  std::vector<std::string> configs = ap.get_phenotype_configs();
+  for (std::vector<std::string>::const_iterator iter = configs.begin();
+       iter != configs.end(); ++iter) {
+    initialize_output_directories::yaml_reader config(*iter);
+    std::vector<std::string> columns;
+    columns.push_back(config.get_entry("phenotype"));
+    if (config.query_valid("covariates")) {
+      std::vector<std::string> covariates = config.get_sequence("covariates");
+      columns.insert(columns.end(), covariates.begin(), covariates.end());
+    }
+    std::vector<std::string> affected = diff.affected_by(columns);
+    std::cout << "config\t" << *iter << '\t'
+              << (affected.empty() ? "unaffected" : "affected") << '\t';
+    for (std::vector<std::string>::const_iterator column = affected.begin();
+         column != affected.end(); ++column) {
+      if (column != affected.begin()) std::cout << ',';
+      std::cout << *column;
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
+
+/*!
+  \brief targets sharing an output prefix, in config order, by prefix
+ */
+typedef std::map<
+    std::string,
+    std::vector<std::pair<initialize_output_directories::config_run *,
+                          unsigned> > >
+    target_group_map;
+
+/*!
+  \brief apply one phase to every target, one task per output prefix
+  @param groups targets grouped by output prefix
+  @param phase member of config_run taking a target index
+  @param pool worker pool
+
+  Targets sharing an output prefix touch the same trackers, so each
+  such group is handled by one task, in config order.
+ */
+void run_target_groups(
+    const target_group_map &groups,
+    void (initialize_output_directories::config_run::*phase)(unsigned),
+    initialize_output_directories::thread_pool *pool) {
+  initialize_output_directories::task_group group(pool);
+  for (target_group_map::const_iterator iter = groups.begin();
+       iter != groups.end(); ++iter) {
+    const std::vector<
+        std::pair<initialize_output_directories::config_run *, unsigned> >
+        *members = &iter->second;
+    group.run([members, phase]() {
+      for (std::vector<std::pair<initialize_output_directories::config_run *,
+                                 unsigned> >::const_iterator member =
+               members->begin();
+           member != members->end(); ++member) {
+        (member->first->*phase)(member->second);
+      }
+    });
+  }
+  group.wait();
+}
+
+/*!
+  \brief load, in one batch, every tracker not yet cached that any
+  target of any config might inspect
+ */
+void prefetch_trackers(
+    const std::vector<
+        std::unique_ptr<initialize_output_directories::config_run> > &configs,
+    initialize_output_directories::tracker_cache *cache) {
+  std::vector<std::string> paths;
+  for (std::vector<std::unique_ptr<initialize_output_directories::
+                                       config_run> >::const_iterator iter =
+           configs.begin();
+       iter != configs.end(); ++iter) {
+    std::vector<std::string> config_paths = (*iter)->tracker_paths();
+    paths.insert(paths.end(), config_paths.begin(), config_paths.end());
+  }
+  cache->prefetch(paths);
+}
+}  // namespace
+
 int main(int argc, char **argv) {
   // parse command line input
   initialize_output_directories::cargs ap(argc, argv);
@@ -24,17 +153,75 @@ int main(int argc, char **argv) {
     ap.print_help(std::cout);
     return 0;
   }
-  std::string phenotype_config_filename = ap.get_phenotype_config();
-  std::string extension_config_filename = ap.get_extension_config();
-  std::string bgen_prefix = ap.get_bgen_prefix();
-  std::string phenotype_database = ap.get_phenotype_database();
-  std::string phenotype_id_colname = ap.get_phenotype_id_colname();
-  std::string results_dir = ap.get_results_dir();
-  std::string software = ap.get_software();
-  unsigned software_min_sample_size = ap.get_software_min_sample_size();
-  bool pretend = ap.pretend();
-  bool force = ap.force();
+  // every database read, comparisons included, uses the same strategy
+  initialize_output_directories::input_source::set_read_strategy(
+      ap.get_database_io());
+  if (!ap.get_diff_database().empty()) return diff_databases(ap);
+  if (!ap.get_shard_fragments().empty()) {
+    initialize_output_directories::shard_spec::merge(
+        ap.get_shard_fragments(), std::cout);
+    return 0;
+  }
+  std::vector<std::string> phenotype_config_filenames =
+      ap.get_phenotype_configs();
+  // declared first, so that it outlives any background work using it
+  initialize_output_directories::thread_pool pool(ap.get_threads());
+  initialize_output_directories::run_settings settings;
+  settings.extension_config_filename = ap.get_extension_config();
+  settings.bgen_prefix = ap.get_bgen_prefix();
+  settings.phenotype_database = ap.get_phenotype_database();
+  settings.phenotype_id_colname = ap.get_phenotype_id_colname();
+  settings.results_dir = ap.get_results_dir();
+  settings.software = ap.get_software();
+  settings.software_min_sample_size = ap.get_software_min_sample_size();
+  settings.explain = ap.explain();
+  // explaining evaluates every check, so it overrides pretend
+  settings.pretend = ap.pretend() && !settings.explain;
+  settings.force = ap.force();
+  settings.shard = initialize_output_directories::shard_spec(ap.get_shard());
+  std::string emit_order = ap.get_emit_order();
+  bool emit_by_cost = !emit_order.compare("cost");
+  if (!emit_by_cost && emit_order.compare("config")) {
+    throw std::runtime_error("unrecognized emit order: \"" + emit_order +
+                             "\"");
+  }
+  // merging restores config order, whatever order the shards wrote
+  if (emit_by_cost && settings.shard.active()) {
+    throw std::runtime_error("--emit-order cost cannot be used with --shard");
+  }
+  settings.comparison = initialize_output_directories::value_comparison(
+      ap.get_compare_values(), ap.get_compare_tolerance());
   bool timer = ap.timer();
+  bool use_content_store = ap.content_store();
+  std::string io_backend_name = ap.get_io_backend();
+  std::string report_filename = ap.get_report();
+  settings.model_matrix_format = ap.get_model_matrix_format();
+  settings.write_model_matrices = settings.model_matrix_format.compare("none");
+  settings.matrix_suffix = ".model_matrix.tsv";
+  if (!settings.model_matrix_format.compare("gzip")) {
+    settings.matrix_format =
+        initialize_output_directories::model_matrix::tsv_gzip;
+    settings.matrix_suffix = ".model_matrix.tsv.gz";
+  } else if (!settings.model_matrix_format.compare("binary")) {
+    settings.matrix_format =
+        initialize_output_directories::model_matrix::binary;
+    settings.matrix_suffix = ".model_matrix.bin";
+  } else if (settings.write_model_matrices &&
+             settings.model_matrix_format.compare("tsv")) {
+    throw std::runtime_error("unrecognized model matrix format: \"" +
+                             settings.model_matrix_format + "\"");
+  }
+  settings.covariate_statistics_mode = ap.get_covariate_statistics();
+  settings.drop_constant_covariates =
+      !settings.covariate_statistics_mode.compare("drop");
+  settings.write_covariate_statistics =
+      settings.drop_constant_covariates ||
+      !settings.covariate_statistics_mode.compare("report");
+  if (!settings.write_covariate_statistics &&
+      settings.covariate_statistics_mode.compare("none")) {
+    throw std::runtime_error("unrecognized covariate statistics mode: \"" +
+                             settings.covariate_statistics_mode + "\"");
+  }
 
   std::chrono::time_point<std::chrono::high_resolution_clock> start_time,
       end_time;
@@ -42,116 +229,151 @@ int main(int argc, char **argv) {
     start_time = std::chrono::high_resolution_clock::now();
   }
 
-  // read configuration files
-  initialize_output_directories::yaml_reader pheno_config(
-      phenotype_config_filename);
+  settings.pool = &pool;
+
+  // read extension configuration file
   initialize_output_directories::yaml_reader extension_config(
-      extension_config_filename);
+      settings.extension_config_filename);
+  // the extension config is shared by every target, so compile it once
+  settings.schema =
+      initialize_output_directories::extension_schema::create(extension_config);
 
-  // read required entries from phenotype configuration
-  std::string analysis_prefix = pheno_config.get_entry("analysis_prefix");
-  std::vector<std::string> chips = pheno_config.get_sequence("chips");
-  std::vector<std::string> ancestries = pheno_config.get_sequence("ancestries");
-  std::vector<std::string> algorithms = pheno_config.get_sequence("algorithm");
+  if (use_content_store && !settings.pretend && !settings.explain) {
+    settings.store.reset(new initialize_output_directories::content_store(
+        settings.results_dir + "/.content_store"));
+  }
+  // tracking file access for every target is batched through one cache
+  settings.cache.reset(new initialize_output_directories::tracker_cache(
+      initialize_output_directories::io_backend::create(io_backend_name, &pool),
+      true, settings.store));
+  if (!report_filename.empty()) {
+    settings.report.reset(
+        new initialize_output_directories::run_report(report_filename));
+  }
+  // phenotype data is read only once some target needs it
+  settings.library.reset(new initialize_output_directories::phenotype_library(
+      settings.phenotype_id_colname));
+  if (ap.get_memory_limit()) {
+    settings.streaming.reset(
+        new initialize_output_directories::streaming_database(
+            settings.phenotype_id_colname,
+            static_cast<std::size_t>(ap.get_memory_limit()) * 1024 * 1024,
+            pool.size(), settings.comparison));
+  }
+  // target directories are collected here and created together
+  settings.planner.reset(
+      new initialize_output_directories::directory_planner(settings.explain));
 
-  initialize_output_directories::model_matrix mm;
-  mm.set_id(phenotype_id_colname);
-  mm.set_phenotype(pheno_config.get_entry("phenotype"));
-  if (pheno_config.query_valid("covariates")) {
-    mm.set_covariates(pheno_config.get_sequence("covariates"));
-  }
-  // if one of the algorithms is what was requested on the command line
-  initialize_output_directories::categorical_variable categories;
-  if (initialize_output_directories::find_entry("saige", algorithms)) {
-    // compute groups and sizes, combining any group with N<100 into
-    //    a single meta-group
-    mm.load_data(phenotype_database);
-    categories = mm.categorize(pheno_config.get_entry("phenotype"));
-  }
-  // for each chip
-  for (std::vector<std::string>::const_iterator chip = chips.begin();
-       chip != chips.end(); ++chip) {
-    // for each ancestry
-    for (std::vector<std::string>::const_iterator ancestry = ancestries.begin();
-         ancestry != ancestries.end(); ++ancestry) {
-      // if the requested software is specified in the pheno config
-      //    and the bgen directory for this chip/ancestry combination exists
-      //    and the "chr22-filtered-noNAs.sample" file exists in that directory
-      std::string bgen_directory =
-          bgen_prefix + "/" +
-          initialize_output_directories::strreplace(*chip, '_', '/') + "/" +
-          *ancestry;
-      std::string bgen_samplefile =
-          bgen_directory + "/chr22-filtered-noNAs.sample";
-      boost::filesystem::path bgen_dir_path = bgen_directory;
-      boost::filesystem::path bgen_sample_path = bgen_samplefile;
-      if (initialize_output_directories::find_entry(software, algorithms) &&
-          boost::filesystem::is_directory(bgen_dir_path) &&
-          boost::filesystem::is_regular_file(bgen_sample_path)) {
-        // compute number of subjects in this sample file
-        // deduct 2 because of .sample file header conventions
-        unsigned n_subjects =
-            initialize_output_directories::wc(bgen_samplefile) - 2;
-        // if there are enough subjects in this sample file to run this
-        // particular software
-        if (n_subjects >= software_min_sample_size) {
-          // build the results directory name:
-          // {results/phenotype/ancestry/SOFTWARE}
-          std::string results_prefix =
-              results_dir + "/" + analysis_prefix + "/" + *ancestry + "/" +
-              initialize_output_directories::uppercase(software) + "/" +
-              analysis_prefix + "." + *chip + "." +
-              initialize_output_directories::lowercase(software);
-          // presumably build a tracker class and initialize an instance of it
-          //   and make the directory if needed
-          initialize_output_directories::tracking_files tf(results_prefix,
-                                                           extension_config);
-          // make the tracker class determine if updates are needed
-          bool updated = tf.check_files(pheno_config, mm, phenotype_database,
-                                        pretend, force);
-          // for categoricals (n comparisons > 1)
-          //    copy top-level trackers into "comparison[1-n]" subdirectories
-          if (updated) {
-            tf.remove_finalization();
-            // if there are more than two categories
-            if (categories.size() > 2) {
-              unsigned comparison_count = 1;
-              for (std::vector<std::set<unsigned> >::const_iterator iter =
-                       categories.comparison_begin();
-                   iter != categories.comparison_end();
-                   ++iter, ++comparison_count) {
-                // at some point, this will have to be moved outside of this
-                // conditional, as the assignment of reference and comparison
-                // groups will be exposed as a configuration variable. but for
-                // now, comparison groups are determined by phenotype database
-                // counts, which is deterministic pending things that guarantee
-                // `updated == true`
-                tf.copy_trackers(comparison_count,
-                                 categories.get_reference_group(), *iter);
-              }
-            } else if (categories.size() == 2) {
-              tf.report_categories(tf.get_output_prefix(),
-                                   categories.get_reference_group(),
-                                   *categories.comparison_begin());
-            }
-          }
-          // actually emit output prefixes as appropriate
-          if (categories.size() > 2) {
-            // for categorical data, suppress the top level directory
-            // as an analysis target, and just emit the comparison
-            // subdirectories
-            for (unsigned i = 1; i <= categories.n_comparison_groups(); ++i) {
-              std::cout << results_prefix.substr(0, results_prefix.rfind("/"))
-                        << "/comparison" << i
-                        << results_prefix.substr(results_prefix.rfind("/"))
-                        << std::endl;
-            }
-          } else {
-            std::cout << results_prefix << std::endl;
-          }
+  // parse every config, declaring the phenotype columns it may need
+  std::vector<std::unique_ptr<initialize_output_directories::config_run> >
+      configs;
+  for (std::vector<std::string>::const_iterator iter =
+           phenotype_config_filenames.begin();
+       iter != phenotype_config_filenames.end(); ++iter) {
+    configs.push_back(
+        std::unique_ptr<initialize_output_directories::config_run>(
+            new initialize_output_directories::config_run(
+                *iter, iter - phenotype_config_filenames.begin(),
+                &settings)));
+  }
+  {
+    initialize_output_directories::task_group group(&pool);
+    for (std::vector<std::unique_ptr<initialize_output_directories::
+                                         config_run> >::const_iterator iter =
+             configs.begin();
+         iter != configs.end(); ++iter) {
+      initialize_output_directories::config_run *run = iter->get();
+      group.run([run]() { run->prepare(); });
+    }
+    group.wait();
+  }
+  // discover targets for every config side by side; the database starts
+  // loading in the background as soon as some target needs it
+  {
+    initialize_output_directories::task_group group(&pool);
+    for (std::vector<std::unique_ptr<initialize_output_directories::
+                                         config_run> >::const_iterator iter =
+             configs.begin();
+         iter != configs.end(); ++iter) {
+      initialize_output_directories::config_run *run = iter->get();
+      group.run([run]() { run->discover(); });
+    }
+    group.wait();
+  }
+  // only the database tracker, category propagation and model matrices
+  // depend on phenotype data: finish loading it and compute categories
+  // off the pool while everything else proceeds
+  std::future<void> background =
+      std::async(std::launch::async, [&configs, &settings]() {
+        settings.library->wait(settings.phenotype_database);
+        for (std::vector<std::unique_ptr<initialize_output_directories::
+                                             config_run> >::const_iterator
+                 iter = configs.begin();
+             iter != configs.end(); ++iter) {
+          (*iter)->categorize();
         }
-      }
+      });
+  settings.planner->create(&pool);
+  target_group_map target_groups;
+  for (std::vector<std::unique_ptr<initialize_output_directories::
+                                       config_run> >::const_iterator iter =
+           configs.begin();
+       iter != configs.end(); ++iter) {
+    for (unsigned i = 0; i < (*iter)->n_targets(); ++i) {
+      target_groups[(*iter)->get_target_prefix(i)].push_back(
+          std::make_pair(iter->get(), i));
+    }
+  }
+  // concurrent runs may share output prefixes; hold each prefix's lock
+  // from before its trackers are read until this run's changes are on disk
+  initialize_output_directories::directory_locks locks;
+  if (!settings.pretend && !settings.explain) {
+    std::set<std::string> locked_prefixes;
+    for (target_group_map::const_iterator iter = target_groups.begin();
+         iter != target_groups.end(); ++iter) {
+      locked_prefixes.insert(iter->first);
     }
+    locks.acquire(locked_prefixes);
+  }
+  // load every tracker any target might inspect in a single batch;
+  // comparison subdirectories follow once categories are known
+  if (!settings.pretend) prefetch_trackers(configs, settings.cache.get());
+  run_target_groups(target_groups,
+                    &initialize_output_directories::config_run::check_trackers,
+                    &pool);
+  background.get();
+  // comparison subdirectories, now that categories are known
+  if (!settings.pretend) prefetch_trackers(configs, settings.cache.get());
+  run_target_groups(target_groups,
+                    &initialize_output_directories::config_run::check_target,
+                    &pool);
+  // apply every tracker change in a single batch, unless only explaining
+  if (!settings.explain) settings.cache->flush();
+  if (settings.shard.active()) settings.shard.write_header(std::cout);
+  std::vector<initialize_output_directories::emitted_prefix> prefixes;
+  for (std::vector<std::unique_ptr<initialize_output_directories::
+                                       config_run> >::const_iterator iter =
+           configs.begin();
+       iter != configs.end(); ++iter) {
+    // only once everything is on disk, record the targets as complete
+    (*iter)->mark_complete();
+    // actually emit output prefixes as appropriate
+    if (settings.explain) {
+      (*iter)->explain(std::cout);
+    } else if (emit_by_cost) {
+      (*iter)->emit(&prefixes);
+    } else {
+      (*iter)->emit(std::cout);
+    }
+  }
+  // equal costs keep config order
+  std::stable_sort(
+      prefixes.begin(), prefixes.end(),
+      initialize_output_directories::emitted_prefix::longest_first);
+  for (std::vector<initialize_output_directories::emitted_prefix>::
+           const_iterator iter = prefixes.begin();
+       iter != prefixes.end(); ++iter) {
+    std::cout << iter->line << std::endl;
   }
   if (timer) {
     end_time = std::chrono::high_resolution_clock::now();
@@ -160,6 +382,42 @@ int main(int argc, char **argv) {
                                                               start_time);
     std::cout << "Time taken by run: " << elapsed.count() << " milliseconds"
               << std::endl;
+    if (settings.library->loaded()) {
+      std::cout << "Time taken by phenotype load: "
+                << settings.library->get_load_milliseconds()
+                << " milliseconds (" << settings.library->get_arena_bytes()
+                << " bytes of cell storage)" << std::endl;
+    }
+    if (settings.streaming && settings.streaming->get_n_passes()) {
+      std::cout << "Phenotype database passes: "
+                << settings.streaming->get_n_passes() << " ("
+                << settings.streaming->get_peak_row_bytes()
+                << " bytes of rows held at most)" << std::endl;
+    }
+    std::map<std::string,
+             initialize_output_directories::input_source::read_statistics>
+        reads = initialize_output_directories::input_source::
+            get_read_statistics();
+    for (std::map<std::string, initialize_output_directories::input_source::
+                                   read_statistics>::const_iterator iter =
+             reads.begin();
+         iter != reads.end(); ++iter) {
+      std::cout << "Phenotype database reads (" << iter->first
+                << "): " << iter->second.bytes << " bytes from "
+                << iter->second.n_files << " file(s) at "
+                << static_cast<uint64_t>(
+                       iter->second.seconds > 0.0
+                           ? iter->second.bytes / 1048576.0 /
+                                 iter->second.seconds
+                           : 0.0)
+                << " MB/s" << std::endl;
+    }
+    std::cout << "Peak resident memory: "
+              << initialize_output_directories::peak_resident_kb()
+              << " kilobytes" << std::endl;
   }
+  // only a shard that got this far may be merged
+  if (settings.shard.active())
+    initialize_output_directories::shard_spec::write_trailer(std::cout);
   return 0;
 }
@@ -0,0 +1,106 @@
+/*!
+  \file phenotype_library.cc
+  \brief implementation of shared phenotype database loading
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/phenotype_library.h"
+
+#include <algorithm>
+#include <chrono>  // NOLINT [build/c++11]
+#include <iterator>
+
+std::shared_ptr<initialize_output_directories::phenotype_library::source>
+initialize_output_directories::phenotype_library::find_source(
+    const std::string &filename) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::shared_ptr<source> &src = _sources[filename];
+  if (!src) src.reset(new source);
+  return src;
+}
+
+void initialize_output_directories::phenotype_library::require(
+    const std::string &filename, const std::vector<std::string> &columns) {
+  std::shared_ptr<source> src = find_source(filename);
+  std::lock_guard<std::mutex> lock(src->mutex);
+  src->required.insert(columns.begin(), columns.end());
+}
+
+const initialize_output_directories::model_matrix &
+initialize_output_directories::phenotype_library::load_locked(
+    source *src, const std::string &filename,
+    const std::set<std::string> &columns, thread_pool *pool) {
+  // reuse the first load that extracted every requested column
+  for (std::vector<std::pair<std::set<std::string>, model_matrix> >::
+           const_iterator iter = src->loads.begin();
+       iter != src->loads.end(); ++iter) {
+    if (std::includes(iter->first.begin(), iter->first.end(), columns.begin(),
+                      columns.end()))
+      return iter->second;
+  }
+  // otherwise read the database once for everything declared so far
+  std::set<std::string> wanted = src->required;
+  wanted.insert(columns.begin(), columns.end());
+  model_matrix mm;
+  mm.set_id(_id_colname);
+  mm.set_covariates(std::vector<std::string>(wanted.begin(), wanted.end()));
+  std::chrono::time_point<std::chrono::high_resolution_clock> start_time =
+      std::chrono::high_resolution_clock::now();
+  mm.load_data(filename, pool);
+  _load_milliseconds += std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::high_resolution_clock::now() -
+                            start_time)
+                            .count();
+  _arena_bytes += mm.arena_bytes();
+  ++_n_loads;
+  src->loads.push_back(std::make_pair(wanted, mm));
+  return src->loads.rbegin()->second;
+}
+
+void initialize_output_directories::phenotype_library::preload(
+    const std::string &filename, thread_pool *pool) {
+  std::shared_ptr<source> src = find_source(filename);
+  std::lock_guard<std::mutex> lock(src->mutex);
+  load_locked(src.get(), filename, src->required, pool);
+}
+
+void initialize_output_directories::phenotype_library::preload_async(
+    const std::string &filename, thread_pool *pool) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_pending.find(filename) != _pending.end()) return;
+  _pending[filename] =
+      std::async(std::launch::async, [this, filename, pool]() {
+        preload(filename, pool);
+      }).share();
+}
+
+void initialize_output_directories::phenotype_library::wait(
+    const std::string &filename) {
+  std::shared_future<void> pending;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::map<std::string, std::shared_future<void> >::const_iterator finder =
+        _pending.find(filename);
+    if (finder == _pending.end()) return;
+    pending = finder->second;
+  }
+  pending.get();
+}
+
+initialize_output_directories::model_matrix
+initialize_output_directories::phenotype_library::get(
+    const std::string &filename, const std::string &phenotype,
+    const std::vector<std::string> &covariates) {
+  // a background load in progress is cheaper to wait for than to repeat
+  wait(filename);
+  std::set<std::string> columns(covariates.begin(), covariates.end());
+  columns.insert(phenotype);
+  std::shared_ptr<source> src = find_source(filename);
+  model_matrix res;
+  {
+    std::lock_guard<std::mutex> lock(src->mutex);
+    res = load_locked(src.get(), filename, columns, 0);
+  }
+  return res.project(phenotype, covariates);
+}
@@ -0,0 +1,129 @@
+/*!
+  \file phenotype_library.h
+  \brief on-demand, shared loading of phenotype databases
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_PHENOTYPE_LIBRARY_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_PHENOTYPE_LIBRARY_H_
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "initialize_output_directories/thread_pool.h"
+#include "initialize_output_directories/tracking_files.h"
+
+namespace initialize_output_directories {
+/*!
+  \class phenotype_library
+  \brief every phenotype database a run reads, loaded only when needed
+
+  Consumers first declare the columns they may need with require(),
+  without any I/O. The first get() for a database then reads it once,
+  extracting the union of every declared column, and each consumer
+  receives a projection sharing that storage. A request for columns
+  that no earlier load covered (e.g. an older database named in a
+  tracker) triggers one further load, which later requests reuse.
+  A database can also be loaded in the background with preload_async(),
+  so that a run overlaps the read with filesystem work that does not
+  depend on it; get() waits for such a load instead of repeating it.
+  All members are safe to call concurrently.
+ */
+class phenotype_library {
+ public:
+  /*!
+    \brief constructor
+    @param id_colname column header for subject IDs in every database
+   */
+  explicit phenotype_library(const std::string &id_colname)
+      : _id_colname(id_colname), _n_loads(0), _load_milliseconds(0),
+        _arena_bytes(0) {}
+  /*!
+    \brief destructor; waits for any background loads
+   */
+  ~phenotype_library() throw() {}
+
+  /*!
+    \brief declare columns that may later be requested from a database
+   */
+  void require(const std::string &filename,
+               const std::vector<std::string> &columns);
+
+  /*!
+    \brief load everything declared for a database now, if not yet loaded
+    @param filename database to load
+    @param pool worker pool for parallel decompression; may be null
+
+    Loads triggered by get() run without the pool, as get() may be
+    called from the pool's own workers. Call this first from outside
+    the pool for databases that are certain to be needed.
+   */
+  void preload(const std::string &filename, thread_pool *pool);
+
+  /*!
+    \brief a config's columns from a database, loading it if needed
+   */
+  model_matrix get(const std::string &filename, const std::string &phenotype,
+                   const std::vector<std::string> &covariates);
+
+  /*!
+    \brief start preload() on a thread of its own, if not yet started
+    @param filename database to load
+    @param pool worker pool for parallel decompression; may be null
+
+    Returns immediately. Call only once every consumer has declared its
+    columns. While loading, the thread helps run queued pool tasks, so
+    no pool task may wait() or get() on this database until the load
+    has finished; anything else, including further calls to this
+    function, is safe.
+   */
+  void preload_async(const std::string &filename, thread_pool *pool);
+
+  /*!
+    \brief block until any background load of a database has finished
+    \warning rethrows an exception thrown by that load
+   */
+  void wait(const std::string &filename);
+
+  bool loaded() const { return _n_loads; }
+  unsigned get_load_milliseconds() const { return _load_milliseconds; }
+  std::size_t get_arena_bytes() const { return _arena_bytes; }
+
+ private:
+  phenotype_library(const phenotype_library &) = delete;
+  phenotype_library &operator=(const phenotype_library &) = delete;
+  /*!
+    \brief one database: declared columns and the loads made so far
+   */
+  struct source {
+    std::mutex mutex;
+    std::set<std::string> required;
+    //! each load's requested columns, and its contents
+    std::vector<std::pair<std::set<std::string>, model_matrix> > loads;
+  };
+  std::shared_ptr<source> find_source(const std::string &filename);
+  const model_matrix &load_locked(source *src, const std::string &filename,
+                                  const std::set<std::string> &columns,
+                                  thread_pool *pool);
+  std::string _id_colname;
+  std::mutex _mutex;
+  std::map<std::string, std::shared_ptr<source> > _sources;
+  std::atomic<unsigned> _n_loads;
+  std::atomic<unsigned> _load_milliseconds;
+  std::atomic<std::size_t> _arena_bytes;
+  //! background loads by filename, guarded by _mutex rather than by the
+  //! source, so that tasks run by a loading thread never contend with it;
+  //! last, so they finish before anything they use is destroyed
+  std::map<std::string, std::shared_future<void> > _pending;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_PHENOTYPE_LIBRARY_H_
@@ -0,0 +1,129 @@
+/*!
+  \file resolved_trackers.cc
+  \brief implementation of per-config tracker resolution
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/resolved_trackers.h"
+
+#include <map>
+
+void initialize_output_directories::resolved_tracker::resolve(
+    const yaml_reader &config, const extension_definition &edef,
+    bool must_exist) {
+  const std::string &tag = edef.get_name();
+  _name = tag;
+  _suffix = edef.get_extension();
+  _contents = _comparison = _error = "";
+  _missing = false;
+  std::vector<std::string> values;
+  std::map<std::string, std::string> mapped_values;
+  // weird corner case: current config doesn't have entry but previous run did
+  if (!config.query_valid(tag)) {
+    if (must_exist && edef.get_default().empty()) {
+      _missing = true;
+      return;
+    }
+    values.push_back(edef.get_default());
+  } else {
+    YAML::NodeType::value type = config.get_type(tag);
+    if (type == YAML::NodeType::Scalar || type == YAML::NodeType::Sequence) {
+      values = config.get_sequence(tag);
+    } else if (type == YAML::NodeType::Map) {
+      const std::vector<std::pair<std::string, std::string> > &pairs =
+          config.map_values(std::vector<std::string>(1, tag));
+      for (std::vector<std::pair<std::string, std::string> >::const_iterator
+               iter = pairs.begin();
+           iter != pairs.end(); ++iter) {
+        mapped_values[iter->first] = iter->second;
+      }
+    } else {
+      _error = "check_file: tracker '" + tag +
+               "' entry "
+               "type not recognized";
+      return;
+    }
+  }
+  // sequence trackers are written and compared as a single comma-delimited
+  // line. map trackers are written one tab-delimited pair per line, but
+  // historically compared as comma-joined pairs; that is preserved here
+  if (values.empty()) {
+    for (std::map<std::string, std::string>::const_iterator iter =
+             mapped_values.begin();
+         iter != mapped_values.end(); ++iter) {
+      _contents += iter->first + '\t' + iter->second + '\n';
+      _comparison += (iter == mapped_values.begin() ? "" : ",") + iter->first +
+                     '\t' + iter->second;
+    }
+    _comparison += '\n';
+  } else {
+    set_values(edef, values);
+  }
+}
+
+void initialize_output_directories::resolved_tracker::assign(
+    const extension_definition &edef, const std::vector<std::string> &values) {
+  _name = edef.get_name();
+  _suffix = edef.get_extension();
+  _contents = _comparison = _error = "";
+  _missing = false;
+  set_values(edef, values.empty()
+                       ? std::vector<std::string>(1, edef.get_default())
+                       : values);
+}
+
+void initialize_output_directories::resolved_tracker::set_values(
+    const extension_definition &edef, const std::vector<std::string> &values) {
+  // confirm that all entries in "values" are valid options for this tracker
+  // currently only enabled for sequence-type input; map type input is targeted
+  // at variable names, which won't ever be enumerated at config level,
+  // hopefully?
+  for (std::vector<std::string>::const_iterator iter = values.begin();
+       iter != values.end(); ++iter) {
+    if (!edef.is_permitted_value(*iter)) {
+      _error = "check_file: tracker '" + _name + "' value '" + *iter +
+               "' not among permitted values for this tracker";
+      return;
+    }
+  }
+  for (std::vector<std::string>::const_iterator iter = values.begin();
+       iter != values.end(); ++iter) {
+    _contents += (iter == values.begin() ? "" : ",") + *iter;
+  }
+  _contents += '\n';
+  _comparison = _contents;
+}
+
+void initialize_output_directories::resolved_tracker::validate(
+    const std::string &output_prefix) const {
+  if (_missing)
+    throw std::runtime_error("check_file: essential tag \"" + _name +
+                             "\" not found "
+                             "in configuration for analysis \"" +
+                             output_prefix + "\"");
+  if (!_error.empty()) throw std::runtime_error(_error);
+}
+
+void initialize_output_directories::resolved_tracker_set::resolve(
+    const yaml_reader &config, const extension_schema &schema) {
+  _trackers.clear();
+  _trackers.resize(2 + schema.n_general_extensions());
+  _trackers.at(0).resolve(config, schema.get_phenotype_definition(), true);
+  _trackers.at(1).resolve(config, schema.get_covariates_definition(), false);
+  for (unsigned i = 0; i < schema.n_general_extensions(); ++i) {
+    _trackers.at(i + 2).resolve(config, schema.get_general_extension(i),
+                                false);
+  }
+}
+
+void initialize_output_directories::resolved_tracker_set::exclude(
+    const std::string &name) {
+  for (std::vector<resolved_tracker>::iterator iter = _trackers.begin();
+       iter != _trackers.end(); ++iter) {
+    if (!iter->get_name().compare(name)) {
+      _trackers.erase(iter);
+      return;
+    }
+  }
+}
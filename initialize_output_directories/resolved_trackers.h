@@ -0,0 +1,133 @@
+/*!
+  \file resolved_trackers.h
+  \brief tracker contents resolved once per phenotype config
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_RESOLVED_TRACKERS_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_RESOLVED_TRACKERS_H_
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "initialize_output_directories/extension_schema.h"
+#include "initialize_output_directories/yaml_reader.h"
+
+namespace initialize_output_directories {
+/*!
+  \class resolved_tracker
+  \brief the serialized state of one config-derived tracker
+
+  Holds the exact bytes written to the tracker file, and the bytes that
+  existing tracker contents are compared against. The two only differ
+  for map-valued trackers, which are compared in their legacy
+  comma-joined form.
+ */
+class resolved_tracker {
+ public:
+  resolved_tracker() : _missing(false) {}
+  resolved_tracker(const resolved_tracker &obj)
+      : _name(obj._name),
+        _suffix(obj._suffix),
+        _contents(obj._contents),
+        _comparison(obj._comparison),
+        _error(obj._error),
+        _missing(obj._missing) {}
+  ~resolved_tracker() throw() {}
+
+  /*!
+    \brief resolve the value of a tracker from a phenotype config
+    @param config loaded phenotype configuration
+    @param edef definition of the tracker
+    @param must_exist whether the tag is required when it has no default
+
+    Errors are not thrown here but deferred to validate(), so that
+    configs are only rejected once a target actually uses the tracker.
+   */
+  void resolve(const yaml_reader &config, const extension_definition &edef,
+               bool must_exist);
+  /*!
+    \brief resolve a sequence tracker from values known only at run time
+    @param edef definition of the tracker
+    @param values values of the tracker; its default if there are none
+   */
+  void assign(const extension_definition &edef,
+              const std::vector<std::string> &values);
+  /*!
+    \brief throw any error found during resolution
+    @param output_prefix analysis prefix, for error reporting
+   */
+  void validate(const std::string &output_prefix) const;
+
+  const std::string &get_name() const { return _name; }
+  const std::string &get_suffix() const { return _suffix; }
+  const std::string &get_contents() const { return _contents; }
+  const std::string &get_comparison() const { return _comparison; }
+
+ private:
+  /*!
+    \brief check values against the definition and join them as contents
+   */
+  void set_values(const extension_definition &edef,
+                  const std::vector<std::string> &values);
+  std::string _name;
+  std::string _suffix;
+  std::string _contents;
+  std::string _comparison;
+  std::string _error;
+  bool _missing;  //!< essential tag absent with no default
+};
+
+/*!
+  \class resolved_tracker_set
+  \brief every config-derived tracker for one phenotype config
+
+  Tracker values are identical for every chip/ancestry target of a
+  config, so they are queried, validated and serialized once here and
+  then only compared against disk per target.
+ */
+class resolved_tracker_set {
+ public:
+  resolved_tracker_set() {}
+  /*!
+    \brief resolve all trackers of a config against a schema
+    @param config loaded phenotype configuration
+    @param schema compiled extension configuration
+   */
+  resolved_tracker_set(const yaml_reader &config,
+                       const extension_schema &schema) {
+    resolve(config, schema);
+  }
+  resolved_tracker_set(const resolved_tracker_set &obj)
+      : _trackers(obj._trackers) {}
+  ~resolved_tracker_set() throw() {}
+
+  void resolve(const yaml_reader &config, const extension_schema &schema);
+  /*!
+    \brief drop a tracker from the set, to be checked apart from it
+    @param name tracker name as listed in the config
+
+    For trackers whose contents depend on phenotype data, such as the
+    covariates when constant ones are dropped.
+   */
+  void exclude(const std::string &name);
+  /*!
+    \brief trackers in check order: phenotype, covariates, then general
+    extensions by interned ID
+   */
+  std::vector<resolved_tracker>::const_iterator begin() const {
+    return _trackers.begin();
+  }
+  std::vector<resolved_tracker>::const_iterator end() const {
+    return _trackers.end();
+  }
+  unsigned size() const { return _trackers.size(); }
+
+ private:
+  std::vector<resolved_tracker> _trackers;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_RESOLVED_TRACKERS_H_
@@ -0,0 +1,85 @@
+/*!
+  \file run_report.cc
+  \brief implementation of the per-target run report
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/run_report.h"
+
+#include <cstdio>
+
+initialize_output_directories::run_report::run_report(
+    const std::string &filename)
+    : _filename(filename), _output(filename.c_str()) {
+  if (!_output.is_open())
+    throw std::runtime_error("cannot write run report \"" + filename + "\"");
+}
+
+std::string initialize_output_directories::run_report::quote(
+    const std::string &s) {
+  std::string res = "\"";
+  for (std::string::const_iterator iter = s.begin(); iter != s.end();
+       ++iter) {
+    switch (*iter) {
+      case '"':
+        res += "\\\"";
+        break;
+      case '\\':
+        res += "\\\\";
+        break;
+      case '\n':
+        res += "\\n";
+        break;
+      case '\t':
+        res += "\\t";
+        break;
+      case '\r':
+        res += "\\r";
+        break;
+      default:
+        if (static_cast<unsigned char>(*iter) < 0x20) {
+          char buffer[8];
+          snprintf(buffer, sizeof(buffer), "\\u%04x",
+                   static_cast<unsigned>(*iter));
+          res += buffer;
+        } else {
+          res += *iter;
+        }
+    }
+  }
+  return res + "\"";
+}
+
+void initialize_output_directories::run_report::write(
+    const target_record &record) {
+  // format outside the lock; only the write itself is serialized
+  std::string line = "{\"config\":" + quote(record.config) +
+                     ",\"output_prefix\":" + quote(record.output_prefix) +
+                     ",\"chip\":" + quote(record.chip) +
+                     ",\"ancestry\":" + quote(record.ancestry) +
+                     ",\"software\":" + quote(record.software) +
+                     ",\"n_subjects\":" + std::to_string(record.n_subjects) +
+                     ",\"n_categories\":" +
+                     std::to_string(record.n_categories) +
+                     ",\"n_comparisons\":" +
+                     std::to_string(record.n_comparisons) +
+                     ",\"skipped\":" + (record.skipped ? "true" : "false") +
+                     ",\"database\":" + quote(record.database) +
+                     ",\"changed_trackers\":[";
+  for (std::vector<std::string>::const_iterator iter =
+           record.changed_trackers.begin();
+       iter != record.changed_trackers.end(); ++iter) {
+    if (iter != record.changed_trackers.begin()) line += ",";
+    line += quote(*iter);
+  }
+  line += std::string("],\"updated\":") + (record.updated ? "true" : "false") +
+          ",\"finalization_removed\":" +
+          (record.finalization_removed ? "true" : "false") +
+          ",\"model_matrix_written\":" +
+          (record.model_matrix_written ? "true" : "false") +
+          ",\"microseconds\":" + std::to_string(record.microseconds) + "}\n";
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!(_output << line))
+    throw std::runtime_error("cannot write run report \"" + _filename + "\"");
+}
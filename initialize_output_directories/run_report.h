@@ -0,0 +1,81 @@
+/*!
+  \file run_report.h
+  \brief machine-readable per-target run report
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_RUN_REPORT_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_RUN_REPORT_H_
+
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace initialize_output_directories {
+/*!
+  \brief everything reported about one analysis target
+ */
+struct target_record {
+  target_record()
+      : n_subjects(0),
+        n_categories(0),
+        n_comparisons(0),
+        skipped(false),
+        updated(false),
+        finalization_removed(false),
+        model_matrix_written(false),
+        microseconds(0) {}
+  std::string config;
+  std::string output_prefix;
+  std::string chip;
+  std::string ancestry;
+  std::string software;
+  unsigned n_subjects;
+  unsigned n_categories;   //!< phenotype levels, 0 if not categorized
+  unsigned n_comparisons;  //!< comparison subdirectories emitted
+  bool skipped;            //!< content store had already seen these inputs
+  std::string database;    //!< see check_report::database
+  std::vector<std::string> changed_trackers;
+  bool updated;
+  bool finalization_removed;
+  bool model_matrix_written;
+  unsigned long microseconds;  //!< time spent checking the target
+};
+
+/*!
+  \class run_report
+  \brief newline-delimited JSON stream with one object per target
+
+  Records are written as targets finish, so memory use does not grow
+  with the number of targets; their order across targets is therefore
+  unspecified. Safe to call from several threads.
+ */
+class run_report {
+ public:
+  /*!
+    \brief constructor
+    @param filename file to create or truncate
+   */
+  explicit run_report(const std::string &filename);
+  ~run_report() throw() {}
+
+  void write(const target_record &record);
+
+  /*!
+    \brief quote and escape a string as a JSON string literal
+   */
+  static std::string quote(const std::string &s);
+
+ private:
+  run_report(const run_report &) = delete;
+  run_report &operator=(const run_report &) = delete;
+  std::string _filename;
+  std::ofstream _output;
+  std::mutex _mutex;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_RUN_REPORT_H_
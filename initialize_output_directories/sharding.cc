@@ -0,0 +1,164 @@
+/*!
+  \file sharding.cc
+  \brief implementation of target partitioning across runs
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/sharding.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <set>
+
+namespace {
+const char *shard_header = "#shard";
+const char *shard_trailer = "#shard-complete";
+
+/*!
+  \brief parse a non-empty run of decimal digits
+  \return false if str is anything else
+ */
+bool parse_unsigned(const std::string &str, unsigned *res) {
+  if (str.empty() || str.size() > 9) return false;
+  unsigned value = 0;
+  for (std::string::const_iterator iter = str.begin(); iter != str.end();
+       ++iter) {
+    if (!isdigit(static_cast<unsigned char>(*iter))) return false;
+    value = value * 10 + (*iter - '0');
+  }
+  *res = value;
+  return true;
+}
+
+/*!
+  \brief one tagged output line from a fragment
+ */
+struct fragment_record {
+  unsigned config_index;
+  unsigned target_index;
+  std::string line;
+};
+
+bool record_order(const fragment_record &lhs, const fragment_record &rhs) {
+  if (lhs.config_index != rhs.config_index)
+    return lhs.config_index < rhs.config_index;
+  return lhs.target_index < rhs.target_index;
+}
+}  // namespace
+
+initialize_output_directories::shard_spec::shard_spec(const std::string &spec)
+    : _index(0), _count(1), _active(!spec.empty()) {
+  if (!_active) return;
+  std::string::size_type slash = spec.find('/');
+  if (slash == std::string::npos ||
+      !parse_unsigned(spec.substr(0, slash), &_index) ||
+      !parse_unsigned(spec.substr(slash + 1), &_count) || !_count ||
+      _index >= _count) {
+    throw std::runtime_error("invalid shard \"" + spec +
+                             "\": expected i/n with 0 <= i < n");
+  }
+}
+
+uint64_t initialize_output_directories::shard_spec::stable_hash(
+    const std::string &key) {
+  uint64_t res = 14695981039346656037ULL;
+  for (std::string::const_iterator iter = key.begin(); iter != key.end();
+       ++iter) {
+    res ^= static_cast<unsigned char>(*iter);
+    res *= 1099511628211ULL;
+  }
+  return res;
+}
+
+bool initialize_output_directories::shard_spec::contains(
+    const std::string &key) const {
+  return stable_hash(key) % _count == _index;
+}
+
+void initialize_output_directories::shard_spec::write_header(
+    std::ostream &out) const {
+  out << shard_header << '\t' << _index << '\t' << _count << std::endl;
+}
+
+void initialize_output_directories::shard_spec::write_record(
+    std::ostream &out, unsigned config_index, unsigned target_index,
+    const std::string &line) {
+  out << config_index << '\t' << target_index << '\t' << line << std::endl;
+}
+
+void initialize_output_directories::shard_spec::write_trailer(
+    std::ostream &out) {
+  out << shard_trailer << std::endl;
+}
+
+void initialize_output_directories::shard_spec::merge(
+    const std::vector<std::string> &filenames, std::ostream &out) {
+  std::vector<fragment_record> records;
+  std::set<unsigned> seen;
+  unsigned count = 0;
+  for (std::vector<std::string>::const_iterator filename = filenames.begin();
+       filename != filenames.end(); ++filename) {
+    std::ifstream input(filename->c_str());
+    if (!input.is_open())
+      throw std::runtime_error("cannot open shard fragment \"" + *filename +
+                               "\"");
+    std::string line;
+    bool in_shard = false, complete = false;
+    while (std::getline(input, line)) {
+      if (line.find(std::string(shard_header) + '\t') == 0) {
+        std::string::size_type tab = line.find('\t', 7);
+        unsigned index = 0, n = 0;
+        if (in_shard || complete || tab == std::string::npos ||
+            !parse_unsigned(line.substr(7, tab - 7), &index) ||
+            !parse_unsigned(line.substr(tab + 1), &n) || index >= n)
+          throw std::runtime_error("invalid shard header in \"" + *filename +
+                                   "\"");
+        if (count && n != count)
+          throw std::runtime_error("shard fragment \"" + *filename +
+                                   "\" is from a different split");
+        if (!seen.insert(index).second)
+          throw std::runtime_error("shard " + std::to_string(index) +
+                                   " given more than once");
+        count = n;
+        in_shard = true;
+        continue;
+      }
+      if (!line.compare(shard_trailer)) {
+        if (!in_shard)
+          throw std::runtime_error("unexpected shard trailer in \"" +
+                                   *filename + "\"");
+        in_shard = false;
+        complete = true;
+        continue;
+      }
+      if (!in_shard) continue;
+      std::string::size_type first = line.find('\t');
+      std::string::size_type second = first == std::string::npos
+                                          ? std::string::npos
+                                          : line.find('\t', first + 1);
+      fragment_record record;
+      if (second == std::string::npos ||
+          !parse_unsigned(line.substr(0, first), &record.config_index) ||
+          !parse_unsigned(line.substr(first + 1, second - first - 1),
+                          &record.target_index))
+        continue;
+      record.line = line.substr(second + 1);
+      records.push_back(record);
+    }
+    if (!complete)
+      throw std::runtime_error("shard fragment \"" + *filename +
+                               "\" is incomplete");
+  }
+  if (seen.size() != count)
+    throw std::runtime_error("expected " + std::to_string(count) +
+                             " shard fragments, found " +
+                             std::to_string(seen.size()));
+  // a target's lines all come from one fragment, already in order
+  std::stable_sort(records.begin(), records.end(), record_order);
+  for (std::vector<fragment_record>::const_iterator iter = records.begin();
+       iter != records.end(); ++iter) {
+    out << iter->line << std::endl;
+  }
+}
@@ -0,0 +1,101 @@
+/*!
+  \file sharding.h
+  \brief partitioning of analysis targets across independent runs
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_SHARDING_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_SHARDING_H_
+
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace initialize_output_directories {
+/*!
+  \class shard_spec
+  \brief which share of a batch's targets one run is responsible for
+
+  A batch can be split over n runs, e.g. cluster array jobs, each given
+  the same configs and its own index i in [0, n). A target belongs to
+  the shard its key hashes to, with a hash that is the same on every
+  platform and build, so the partition depends on nothing but the key
+  and n. Instead of bare analysis prefixes, a shard writes a fragment:
+  a header line, one record per output line tagged with its config's
+  position and its target's position within the config, and a trailer
+  line once the shard has finished. merge() combines the fragments of
+  all n shards into exactly what one unsharded run would have written.
+ */
+class shard_spec {
+ public:
+  /*!
+    \brief the whole batch, as a single run
+   */
+  shard_spec() : _index(0), _count(1), _active(false) {}
+  /*!
+    \brief constructor
+    @param spec "i/n", with 0 <= i < n; empty for the whole batch
+   */
+  explicit shard_spec(const std::string &spec);
+  shard_spec(const shard_spec &obj)
+      : _index(obj._index), _count(obj._count), _active(obj._active) {}
+  ~shard_spec() throw() {}
+
+  /*!
+    \brief whether this run is a shard, even the only one, of a split
+   */
+  bool active() const { return _active; }
+  unsigned get_index() const { return _index; }
+  unsigned get_count() const { return _count; }
+
+  /*!
+    \brief whether a target belongs to this shard
+    @param key stable identity of the target
+   */
+  bool contains(const std::string &key) const;
+
+  /*!
+    \brief 64-bit FNV-1a hash, identical across platforms and builds
+   */
+  static uint64_t stable_hash(const std::string &key);
+
+  /*!
+    \brief write this shard's fragment header
+   */
+  void write_header(std::ostream &out) const;
+  /*!
+    \brief write one output line, tagged for merging
+    @param config_index position of the config in the batch
+    @param target_index position of the target within the config
+    @param line output line, without newline
+   */
+  static void write_record(std::ostream &out, unsigned config_index,
+                           unsigned target_index, const std::string &line);
+  /*!
+    \brief mark this shard's fragment as complete
+   */
+  static void write_trailer(std::ostream &out);
+
+  /*!
+    \brief combine shard fragments into unsharded output
+    @param filenames one fragment per shard, in any order
+    @param out where to write the combined lines
+
+    Lines in a fragment other than its header, records and trailer (for
+    instance timer output) are ignored. Throws unless the fragments are
+    exactly the complete shards 0 to n-1 of one n-way split.
+   */
+  static void merge(const std::vector<std::string> &filenames,
+                    std::ostream &out);
+
+ private:
+  unsigned _index;
+  unsigned _count;
+  bool _active;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_SHARDING_H_
@@ -0,0 +1,285 @@
+/*!
+  \file streaming_database.cc
+  \brief implementation of bounded-memory phenotype database passes
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/streaming_database.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+#include "initialize_output_directories/arena.h"
+#include "initialize_output_directories/utilities.h"
+
+const std::size_t
+    initialize_output_directories::streaming_database::row_not_found =
+        std::numeric_limits<std::size_t>::max();
+
+std::shared_ptr<
+    initialize_output_directories::streaming_database::category_source>
+initialize_output_directories::streaming_database::find_source(
+    const std::string &filename) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::shared_ptr<category_source> &src = _sources[filename];
+  if (!src) src.reset(new category_source);
+  return src;
+}
+
+std::unique_ptr<initialize_output_directories::database_cursor>
+initialize_output_directories::streaming_database::open(
+    const std::string &filename, const std::vector<std::string> &columns) {
+  column_selection selection;
+  selection.id = _id_colname;
+  selection.names = columns;
+  ++_n_passes;
+  return database_reader::open(filename, 0)->stream(selection);
+}
+
+void initialize_output_directories::streaming_database::record_row_bytes(
+    std::size_t bytes) {
+  std::size_t peak = _peak_row_bytes;
+  while (bytes > peak && !_peak_row_bytes.compare_exchange_weak(peak, bytes)) {
+  }
+}
+
+void initialize_output_directories::streaming_database::require_categories(
+    const std::string &filename, const std::string &column) {
+  std::shared_ptr<category_source> src = find_source(filename);
+  std::lock_guard<std::mutex> lock(src->mutex);
+  src->required.insert(column);
+}
+
+initialize_output_directories::categorical_variable
+initialize_output_directories::streaming_database::categorize(
+    const std::string &filename, const std::string &column) {
+  std::shared_ptr<category_source> src = find_source(filename);
+  std::lock_guard<std::mutex> lock(src->mutex);
+  if (src->counted.find(column) == src->counted.end()) {
+    // one pass counts every column declared so far and not yet counted
+    src->required.insert(column);
+    std::vector<std::string> columns;
+    std::set_difference(src->required.begin(), src->required.end(),
+                        src->counted.begin(), src->counted.end(),
+                        std::back_inserter(columns));
+    std::unique_ptr<database_cursor> cursor = open(filename, columns);
+    const std::vector<std::string> &headers = cursor->headers();
+    // only distinct values are kept
+    string_arena levels;
+    std::vector<std::map<std::string_view, unsigned> > counts(headers.size());
+    std::string_view id;
+    std::vector<std::string_view> cells;
+    while (cursor->next(&id, &cells)) {
+      for (unsigned j = 0; j < cells.size(); ++j) {
+        std::map<std::string_view, unsigned>::iterator finder =
+            counts[j].find(cells[j]);
+        if (finder == counts[j].end()) {
+          finder = counts[j]
+                       .insert(std::make_pair(
+                           levels.store(cells[j].data(), cells[j].size()), 0))
+                       .first;
+        }
+        ++finder->second;
+      }
+    }
+    // as for a loaded matrix, the first column of a name counts
+    for (unsigned j = 0; j < headers.size(); ++j) {
+      if (src->results.find(headers[j]) == src->results.end())
+        src->results[headers[j]] =
+            categorical_variable::from_level_counts(counts[j]);
+    }
+    src->counted.insert(columns.begin(), columns.end());
+  }
+  std::map<std::string, categorical_variable>::const_iterator finder =
+      src->results.find(column);
+  if (finder == src->results.end())
+    throw std::runtime_error("categorize: unable to find header \"" + column +
+                             "\"");
+  return finder->second;
+}
+
+bool initialize_output_directories::streaming_database::equivalent(
+    const std::string &current, const std::string &previous,
+    const std::vector<std::string> &columns, const std::string &categorical) {
+  std::string key = current + '\n' + previous + '\n' + categorical;
+  for (std::vector<std::string>::const_iterator iter = columns.begin();
+       iter != columns.end(); ++iter) {
+    key += '\n' + *iter;
+  }
+  std::shared_ptr<comparison> cmp;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::shared_ptr<comparison> &entry = _comparisons[key];
+    if (!entry) entry.reset(new comparison);
+    cmp = entry;
+  }
+  std::call_once(cmp->made, [&]() {
+    std::unique_ptr<database_cursor> new_rows = open(current, columns),
+                                     old_rows = open(previous, columns);
+    cmp->result = false;
+    const std::vector<std::string> &headers = new_rows->headers();
+    if (headers.size() != old_rows->headers().size()) return;
+    std::vector<char> categorized(headers.size(), 0);
+    for (unsigned j = 0; j < headers.size(); ++j) {
+      categorized[j] = !categorical.empty() && !headers[j].compare(categorical);
+    }
+    std::string_view new_id, old_id;
+    std::vector<std::string_view> new_cells, old_cells;
+    while (true) {
+      bool more = new_rows->next(&new_id, &new_cells);
+      if (more != old_rows->next(&old_id, &old_cells)) return;
+      if (!more) break;
+      if (new_id != old_id) return;
+      for (unsigned j = 0; j < new_cells.size(); ++j) {
+        if (!_comparison.same(new_cells[j], old_cells[j], categorized[j]))
+          return;
+      }
+    }
+    cmp->result = true;
+  });
+  return cmp->result;
+}
+
+initialize_output_directories::model_matrix
+initialize_output_directories::streaming_database::gather(
+    const std::string &filename, const std::vector<std::string> &columns,
+    std::unordered_map<std::string_view, std::size_t> *wanted,
+    std::size_t budget, bool *fits) {
+  *fits = true;
+  return model_matrix::build(_id_colname, [&](database_table *table) {
+    std::unique_ptr<database_cursor> cursor = open(filename, columns);
+    table->headers = cursor->headers();
+    table->data.resize(table->headers.size());
+    std::size_t held = 0;
+    std::string_view id;
+    std::vector<std::string_view> cells;
+    while (cursor->next(&id, &cells)) {
+      std::unordered_map<std::string_view, std::size_t>::iterator finder =
+          wanted->find(id);
+      // as for a loaded matrix, a subject's first row counts
+      if (finder == wanted->end() || finder->second != row_not_found)
+        continue;
+      std::size_t bytes = id.size() + sizeof(id) * (cells.size() + 1);
+      for (std::vector<std::string_view>::const_iterator iter = cells.begin();
+           iter != cells.end(); ++iter) {
+        bytes += iter->size();
+      }
+      finder->second = bytes;
+      if (!*fits || held + bytes > budget) {
+        // keep counting the rest, so the caller can plan further passes
+        *fits = false;
+        continue;
+      }
+      held += bytes;
+      table->ids.push_back(table->arena.store(id.data(), id.size()));
+      for (unsigned j = 0; j < cells.size(); ++j) {
+        table->data[j].push_back(
+            table->arena.store(cells[j].data(), cells[j].size()));
+      }
+    }
+    record_row_bytes(held);
+  });
+}
+
+void initialize_output_directories::streaming_database::write_model_matrix(
+    const std::string &filename, const std::vector<std::string> &columns,
+    const std::string &sample_filename, const std::string &output,
+    model_matrix::output_format format, thread_pool *pool) {
+  std::vector<std::string> sample_ids = read_sample_ids(sample_filename);
+  std::unordered_map<std::string_view, std::size_t> row_bytes;
+  for (std::vector<std::string>::const_iterator iter = sample_ids.begin();
+       iter != sample_ids.end(); ++iter) {
+    row_bytes.emplace(*iter, row_not_found);
+  }
+  bool fits = false;
+  model_matrix gathered =
+      gather(filename, columns, &row_bytes, _row_budget, &fits);
+  if (fits) {
+    gathered.restrict_to(sample_ids).write(output, pool, format);
+    return;
+  }
+  // too large to hold at once: write runs of sample subjects in order,
+  // each run gathered by a pass of its own
+  unsigned n_rows = 0;
+  for (std::vector<std::string>::const_iterator iter = sample_ids.begin();
+       iter != sample_ids.end(); ++iter) {
+    if (row_bytes[*iter] != row_not_found) ++n_rows;
+  }
+  int fd = ::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+    throw std::runtime_error("cannot write model_matrix file \"" + output +
+                             "\"");
+  try {
+    std::string prefix = gathered.format_header(format, n_rows);
+    gathered = model_matrix();
+    gather_runs(filename, columns, sample_ids, &row_bytes,
+                [&](const model_matrix &run) {
+                  run.write_rows(fd, output, pool, format, prefix);
+                  prefix.clear();
+                });
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  if (::close(fd))
+    throw std::runtime_error("cannot write model_matrix file \"" + output +
+                             "\": " + strerror(errno));
+}
+
+initialize_output_directories::column_statistics
+initialize_output_directories::streaming_database::statistics(
+    const std::string &filename, const std::vector<std::string> &columns,
+    const std::string &sample_filename) {
+  std::vector<std::string> sample_ids = read_sample_ids(sample_filename);
+  std::unordered_map<std::string_view, std::size_t> row_bytes;
+  for (std::vector<std::string>::const_iterator iter = sample_ids.begin();
+       iter != sample_ids.end(); ++iter) {
+    row_bytes.emplace(*iter, row_not_found);
+  }
+  column_statistics res(columns);
+  bool fits = false;
+  model_matrix gathered =
+      gather(filename, columns, &row_bytes, _row_budget, &fits);
+  if (fits) {
+    res.add(gathered.restrict_to(sample_ids));
+    return res;
+  }
+  gathered = model_matrix();
+  gather_runs(filename, columns, sample_ids, &row_bytes,
+              [&res](const model_matrix &run) { res.add(run); });
+  return res;
+}
+
+void initialize_output_directories::streaming_database::gather_runs(
+    const std::string &filename, const std::vector<std::string> &columns,
+    const std::vector<std::string> &sample_ids,
+    std::unordered_map<std::string_view, std::size_t> *row_bytes,
+    const std::function<void(const model_matrix &)> &visit) {
+  // each run takes subjects in order until their rows would exceed the
+  // budget; duplicates and subjects absent from the database take none
+  std::vector<std::string>::const_iterator run_start = sample_ids.begin();
+  while (run_start != sample_ids.end()) {
+    std::unordered_map<std::string_view, std::size_t> run;
+    std::vector<std::string>::const_iterator run_end = run_start;
+    std::size_t run_bytes = 0;
+    for (; run_end != sample_ids.end(); ++run_end) {
+      std::size_t bytes = (*row_bytes)[*run_end];
+      if (bytes == row_not_found || run.count(*run_end)) continue;
+      if (!run.empty() && run_bytes + bytes > _row_budget) break;
+      run.emplace(*run_end, row_not_found);
+      run_bytes += bytes;
+    }
+    // nothing left but subjects absent from the database
+    if (run.empty()) break;
+    bool run_fits = false;
+    visit(gather(filename, columns, &run, run_bytes, &run_fits)
+              .restrict_to(std::vector<std::string>(run_start, run_end)));
+    run_start = run_end;
+  }
+}
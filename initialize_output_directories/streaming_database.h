@@ -0,0 +1,198 @@
+/*!
+  \file streaming_database.h
+  \brief phenotype database checks in bounded memory
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_STREAMING_DATABASE_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_STREAMING_DATABASE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "initialize_output_directories/column_statistics.h"
+#include "initialize_output_directories/database_reader.h"
+#include "initialize_output_directories/thread_pool.h"
+#include "initialize_output_directories/tracking_files.h"
+#include "initialize_output_directories/value_comparison.h"
+
+namespace initialize_output_directories {
+/*!
+  \class streaming_database
+  \brief phenotype database work done in passes, never loading a database
+
+  The alternative to phenotype_library for hosts where databases do not
+  fit in memory. Each pass reads a database a row at a time through a
+  database_cursor, and keeps only its results: categories are counted
+  in one pass over every phenotype column declared for a database; an
+  earlier database is compared with the current one by reading both
+  side by side, stopping at the first difference; and a model matrix
+  holds only its sample file's subjects, gathered in as many passes as
+  the memory limit requires. The limit is shared evenly by the worker
+  threads, as each may be writing a model matrix. Results match those
+  of a loaded database exactly. All members are safe to call
+  concurrently.
+ */
+class streaming_database {
+ public:
+  /*!
+    \brief constructor
+    @param id_colname column header for subject IDs in every database
+    @param memory_limit bytes of rows that may be held at once
+    @param n_workers threads that may write model matrices at once
+    @param comparison how cells of different databases are compared
+   */
+  streaming_database(const std::string &id_colname, std::size_t memory_limit,
+                     unsigned n_workers, const value_comparison &comparison)
+      : _id_colname(id_colname),
+        _row_budget(std::max<std::size_t>(
+            memory_limit / std::max<unsigned>(n_workers, 1), 1)),
+        _comparison(comparison),
+        _n_passes(0),
+        _peak_row_bytes(0) {}
+  ~streaming_database() throw() {}
+
+  /*!
+    \brief declare a column whose categories will be requested
+   */
+  void require_categories(const std::string &filename,
+                          const std::string &column);
+
+  /*!
+    \brief categories of a column, as model_matrix::categorize computes
+    them; the first request for a database counts every declared column
+   */
+  categorical_variable categorize(const std::string &filename,
+                                  const std::string &column);
+
+  /*!
+    \brief whether two databases have the same subjects, in the same
+    order, and the same cells in some columns
+    @param current current database
+    @param previous earlier database
+    @param columns columns compared, when present
+    @param categorical name of the categorized column; may be empty
+    \return whether model matrices loaded from each would be
+    model_matrix::equivalent
+
+    Results are kept, so targets of one config compare only once.
+   */
+  bool equivalent(const std::string &current, const std::string &previous,
+                  const std::vector<std::string> &columns,
+                  const std::string &categorical);
+
+  /*!
+    \brief write a model matrix from a database
+    @param filename database to read
+    @param columns phenotype and covariate columns
+    @param sample_filename bgen .sample file listing the subjects
+    @param output name of file to write
+    @param format on-disk layout
+    @param pool worker pool for formatting and compression; may be null
+
+    Writes the same bytes as restricting a loaded matrix to the sample
+    file's subjects, if they fit within this thread's share of the
+    limit; otherwise the file is written in parts, each a further pass,
+    and gzip member boundaries may differ.
+   */
+  void write_model_matrix(const std::string &filename,
+                          const std::vector<std::string> &columns,
+                          const std::string &sample_filename,
+                          const std::string &output,
+                          model_matrix::output_format format,
+                          thread_pool *pool);
+
+  /*!
+    \brief summarize columns of a database over a sample file's subjects
+    @param filename database to read
+    @param columns columns to summarize
+    @param sample_filename bgen .sample file listing the subjects
+    \return the summaries of the rows write_model_matrix would write
+
+    Rows are gathered as for write_model_matrix, in as many passes as
+    the limit requires, and summarized as each part arrives.
+   */
+  column_statistics statistics(const std::string &filename,
+                               const std::vector<std::string> &columns,
+                               const std::string &sample_filename);
+
+  unsigned get_n_passes() const { return _n_passes; }
+  /*!
+    \brief most bytes of rows held at once by one model matrix
+   */
+  std::size_t get_peak_row_bytes() const { return _peak_row_bytes; }
+
+ private:
+  streaming_database(const streaming_database &) = delete;
+  streaming_database &operator=(const streaming_database &) = delete;
+  /*!
+    \brief one database's declared and counted category columns
+   */
+  struct category_source {
+    std::mutex mutex;
+    std::set<std::string> required;
+    std::set<std::string> counted;
+    std::map<std::string, categorical_variable> results;
+  };
+  /*!
+    \brief one comparison between databases, made once
+   */
+  struct comparison {
+    comparison() : result(false) {}
+    std::once_flag made;
+    bool result;
+  };
+  std::shared_ptr<category_source> find_source(const std::string &filename);
+  /*!
+    \brief start a pass over a database
+   */
+  std::unique_ptr<database_cursor> open(
+      const std::string &filename, const std::vector<std::string> &columns);
+  /*!
+    \brief gather the first row of each wanted subject into a matrix
+    @param wanted each subject to gather, mapped to row_not_found; the
+    pass sets each subject found to the bytes its row takes
+    @param budget bytes of rows to hold at most
+    @param fits set to whether every row found was held
+   */
+  model_matrix gather(
+      const std::string &filename, const std::vector<std::string> &columns,
+      std::unordered_map<std::string_view, std::size_t> *wanted,
+      std::size_t budget, bool *fits);
+  /*!
+    \brief gather the sample file's subjects in runs that fit the limit
+    @param row_bytes the bytes each subject's row takes, as a first
+    gather() pass found them
+    @param visit called with each run, restricted to its subjects in
+    sample file order
+   */
+  void gather_runs(
+      const std::string &filename, const std::vector<std::string> &columns,
+      const std::vector<std::string> &sample_ids,
+      std::unordered_map<std::string_view, std::size_t> *row_bytes,
+      const std::function<void(const model_matrix &)> &visit);
+  static const std::size_t row_not_found;
+  void record_row_bytes(std::size_t bytes);
+  std::string _id_colname;
+  std::size_t _row_budget;
+  value_comparison _comparison;
+  std::mutex _mutex;
+  std::map<std::string, std::shared_ptr<category_source> > _sources;
+  std::map<std::string, std::shared_ptr<comparison> > _comparisons;
+  std::atomic<unsigned> _n_passes;
+  std::atomic<std::size_t> _peak_row_bytes;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_STREAMING_DATABASE_H_
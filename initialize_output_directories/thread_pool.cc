@@ -0,0 +1,235 @@
+/*!
+  \file thread_pool.cc
+  \brief implementation of worker pool
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+// the pool and worker index of the current thread, if it is a worker
+thread_local const initialize_output_directories::thread_pool *current_pool =
+    0;
+thread_local unsigned current_worker = 0;
+}  // namespace
+
+initialize_output_directories::thread_pool::thread_pool(unsigned n_threads)
+    : _queued(0), _stopping(false) {
+  if (n_threads > 1) {
+    _workers.reserve(n_threads);
+    for (unsigned i = 0; i < n_threads; ++i) {
+      _queues.push_back(std::unique_ptr<worker_queue>(new worker_queue));
+    }
+    for (unsigned i = 0; i < n_threads; ++i) {
+      _workers.push_back(std::thread(&thread_pool::worker_loop, this, i));
+    }
+  }
+}
+
+initialize_output_directories::thread_pool::~thread_pool() throw() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _condition.notify_all();
+  for (std::vector<std::thread>::iterator iter = _workers.begin();
+       iter != _workers.end(); ++iter) {
+    if (iter->joinable()) iter->join();
+  }
+}
+
+void initialize_output_directories::thread_pool::enqueue(
+    const std::function<void()> &task) {
+  if (_stopping)
+    throw std::runtime_error("thread_pool: submit after shutdown");
+  worker_queue &queue =
+      current_pool == this ? *_queues.at(current_worker) : _injection;
+  {
+    std::lock_guard<std::mutex> queue_lock(queue.mutex);
+    queue.tasks.push_back(task);
+    ++_queued;
+  }
+  // a worker checks _queued under _mutex before sleeping; passing through
+  // the lock means it has either seen the task or is waiting for this
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+  }
+  _condition.notify_one();
+}
+
+bool initialize_output_directories::thread_pool::take(
+    std::function<void()> *task) {
+  if (_queues.empty()) return false;
+  unsigned start = 0;
+  // own deque first, newest task
+  if (current_pool == this) {
+    start = current_worker;
+    worker_queue &own = *_queues.at(current_worker);
+    std::lock_guard<std::mutex> own_lock(own.mutex);
+    if (!own.tasks.empty()) {
+      *task = own.tasks.back();
+      own.tasks.pop_back();
+      --_queued;
+      return true;
+    }
+  }
+  // then work from outside the pool
+  {
+    std::lock_guard<std::mutex> injection_lock(_injection.mutex);
+    if (!_injection.tasks.empty()) {
+      *task = _injection.tasks.front();
+      _injection.tasks.pop_front();
+      --_queued;
+      return true;
+    }
+  }
+  // then steal the oldest task from another worker
+  for (unsigned i = 1; i <= _queues.size(); ++i) {
+    worker_queue &victim = *_queues.at((start + i) % _queues.size());
+    std::lock_guard<std::mutex> victim_lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      *task = victim.tasks.front();
+      victim.tasks.pop_front();
+      --_queued;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool initialize_output_directories::thread_pool::run_one() {
+  std::function<void()> task;
+  if (!take(&task)) return false;
+  task();
+  return true;
+}
+
+void initialize_output_directories::thread_pool::worker_loop(unsigned index) {
+  current_pool = this;
+  current_worker = index;
+  while (true) {
+    if (run_one()) continue;
+    std::unique_lock<std::mutex> lock(_mutex);
+    _condition.wait(lock, [this]() { return _stopping || _queued; });
+    if (_stopping && !_queued) return;
+  }
+}
+
+namespace {
+/*!
+  \brief shared progress for one parallel_for call
+
+  Held by shared pointer so that helper tasks scheduled after the loop
+  has already finished can still safely observe it and exit.
+ */
+struct parallel_for_state {
+  parallel_for_state(unsigned n_in, const std::function<void(unsigned)> &f_in)
+      : n(n_in), next(0), done(0), f(f_in) {}
+  const unsigned n;
+  std::atomic<unsigned> next;
+  std::atomic<unsigned> done;
+  std::function<void(unsigned)> f;
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::exception_ptr error;
+
+  void run() {
+    unsigned index = 0;
+    while ((index = next.fetch_add(1)) < n) {
+      try {
+        f(index);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) error = std::current_exception();
+      }
+      if (done.fetch_add(1) + 1 == n) {
+        std::lock_guard<std::mutex> lock(mutex);
+        condition.notify_all();
+      }
+    }
+  }
+};
+}  // namespace
+
+void initialize_output_directories::thread_pool::parallel_for(
+    unsigned n, const std::function<void(unsigned)> &f) {
+  if (!n) return;
+  if (_workers.empty() || n == 1) {
+    for (unsigned i = 0; i < n; ++i) f(i);
+    return;
+  }
+  std::shared_ptr<parallel_for_state> state(new parallel_for_state(n, f));
+  unsigned n_helpers = std::min<unsigned>(n - 1, _workers.size());
+  for (unsigned i = 0; i < n_helpers; ++i) {
+    enqueue([state]() { state->run(); });
+  }
+  state->run();
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->condition.wait(lock, [&state]() { return state->done == state->n; });
+  }
+  if (state->error) std::rethrow_exception(state->error);
+}
+
+initialize_output_directories::task_group::task_group(thread_pool *pool)
+    : _pool(pool), _state(new state) {
+  if (!_pool) throw std::runtime_error("task_group: null pool");
+}
+
+initialize_output_directories::task_group::~task_group() throw() {
+  try {
+    wait();
+  } catch (...) {
+  }
+}
+
+void initialize_output_directories::task_group::run(
+    const std::function<void()> &f) {
+  std::shared_ptr<state> st = _state;
+  if (_pool->_workers.empty()) {
+    try {
+      f();
+    } catch (...) {
+      if (!st->error) st->error = std::current_exception();
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(st->mutex);
+    ++st->outstanding;
+  }
+  _pool->enqueue([st, f]() {
+    try {
+      f();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(st->mutex);
+      if (!st->error) st->error = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(st->mutex);
+    if (!--st->outstanding) st->condition.notify_all();
+  });
+}
+
+void initialize_output_directories::task_group::wait() {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(_state->mutex);
+      if (!_state->outstanding) break;
+    }
+    if (!_pool->run_one()) {
+      // nothing to help with; sleep briefly, as new work may be spawned
+      std::unique_lock<std::mutex> lock(_state->mutex);
+      _state->condition.wait_for(lock, std::chrono::microseconds(200),
+                                 [this]() { return !_state->outstanding; });
+    }
+  }
+  if (_state->error) {
+    std::exception_ptr error = _state->error;
+    _state->error = std::exception_ptr();
+    std::rethrow_exception(error);
+  }
+}
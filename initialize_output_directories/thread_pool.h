@@ -0,0 +1,180 @@
+/*!
+  \file thread_pool.h
+  \brief fixed-size worker pool for concurrent tasks
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_THREAD_POOL_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_THREAD_POOL_H_
+
+#include <atomic>
+#include <chrono>  // NOLINT [build/c++11]
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace initialize_output_directories {
+/*!
+  \class thread_pool
+  \brief fixed-size pool of worker threads with work stealing
+
+  Each worker owns a deque of tasks. Tasks submitted from a worker go
+  to the back of its own deque and are taken back LIFO, which keeps
+  nested work (a config's targets, a target's comparisons) hot in one
+  thread's cache; idle workers steal from the front of other deques,
+  so the oldest and typically largest pieces of work migrate. Tasks
+  submitted from outside the pool go to a shared injection queue.
+
+  A pool of size 0 or 1 spawns no threads at all: tasks then run inline
+  on the submitting thread, which keeps single-threaded runs free of any
+  synchronization overhead.
+ */
+class thread_pool {
+ public:
+  /*!
+    \brief constructor
+    @param n_threads number of worker threads to spawn
+   */
+  explicit thread_pool(unsigned n_threads);
+  /*!
+    \brief destructor; drains the queues and joins all workers
+   */
+  ~thread_pool() throw();
+
+  /*!
+    \brief number of threads that can execute tasks concurrently
+   */
+  unsigned size() const { return _workers.empty() ? 1 : _workers.size(); }
+
+  /*!
+    \brief queue a task for execution
+    @tparam function_type callable with no arguments
+    @param f task to run
+    \return future for the task's result; exceptions propagate through it
+   */
+  template <class function_type>
+  std::future<typename std::result_of<function_type()>::type> submit(
+      function_type f) {
+    typedef typename std::result_of<function_type()>::type result_type;
+    std::shared_ptr<std::packaged_task<result_type()> > task(
+        new std::packaged_task<result_type()>(f));
+    std::future<result_type> res = task->get_future();
+    if (_workers.empty()) {
+      (*task)();
+    } else {
+      enqueue([task]() { (*task)(); });
+    }
+    return res;
+  }
+
+  /*!
+    \brief wait for a future, running queued tasks in the meantime
+    @param f future for a task submitted to this pool
+    \return the task's result
+
+    Blocking a worker on a future whose task is still queued behind
+    it could otherwise stall the pool; helping guarantees progress.
+   */
+  template <class result_type>
+  result_type await(std::future<result_type> *f) {
+    while (f->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      if (!run_one()) f->wait_for(std::chrono::microseconds(200));
+    }
+    return f->get();
+  }
+
+  /*!
+    \brief run f(0) ... f(n-1) across the pool and wait for completion
+    @param n number of indices
+    @param f function to apply to each index
+
+    The calling thread participates, and completion is tracked by index
+    rather than by task, so this is safe to call from inside a pool task.
+    The first exception thrown by any index is rethrown here.
+   */
+  void parallel_for(unsigned n, const std::function<void(unsigned)> &f);
+
+  /*!
+    \brief run one queued task on the calling thread, if any is available
+    \return whether a task was run
+   */
+  bool run_one();
+
+ private:
+  friend class task_group;
+  struct worker_queue {
+    std::mutex mutex;
+    std::deque<std::function<void()> > tasks;
+  };
+  thread_pool(const thread_pool &obj) = delete;
+  thread_pool &operator=(const thread_pool &obj) = delete;
+  void enqueue(const std::function<void()> &task);
+  bool take(std::function<void()> *task);
+  void worker_loop(unsigned index);
+  std::vector<std::thread> _workers;
+  std::vector<std::unique_ptr<worker_queue> > _queues;
+  worker_queue _injection;  //!< tasks submitted from outside the pool
+  //! guards only the sleep and wakeup of idle workers
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  /*!
+    tasks in any queue: raised under the lock of the queue a task is
+    pushed to, lowered once it is popped, so it never underflows
+   */
+  std::atomic<unsigned> _queued;
+  std::atomic<bool> _stopping;
+};
+
+/*!
+  \class task_group
+  \brief a set of pool tasks that can be spawned dynamically and joined
+
+  Tasks may spawn further tasks into the same or other groups. wait()
+  runs queued work while the group is outstanding, so groups can be
+  nested inside pool tasks without exhausting the workers. The first
+  exception thrown by any task in the group is rethrown by wait().
+ */
+class task_group {
+ public:
+  explicit task_group(thread_pool *pool);
+  /*!
+    \brief destructor; waits for outstanding tasks, discarding errors
+   */
+  ~task_group() throw();
+
+  /*!
+    \brief spawn a task into the group
+   */
+  void run(const std::function<void()> &f);
+
+  /*!
+    \brief wait for every task spawned so far, helping in the meantime
+   */
+  void wait();
+
+ private:
+  struct state {
+    state() : outstanding(0) {}
+    std::mutex mutex;
+    std::condition_variable condition;
+    unsigned outstanding;
+    std::exception_ptr error;
+  };
+  task_group(const task_group &obj) = delete;
+  task_group &operator=(const task_group &obj) = delete;
+  thread_pool *_pool;
+  std::shared_ptr<state> _state;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_THREAD_POOL_H_
@@ -0,0 +1,680 @@
+/*!
+  \file tracker_io.cc
+  \brief implementation of batched tracking file access
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/tracker_io.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+
+#include "initialize_output_directories/config.h"
+#include "initialize_output_directories/utilities.h"
+
+#ifdef INITIALIZE_OUTPUT_DIRECTORIES_HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+namespace {
+/*!
+  \brief synchronously stat and read one file
+ */
+void perform_read(initialize_output_directories::io_read_request *r) {
+  r->exists = false;
+  r->error = 0;
+  r->contents.clear();
+  struct stat st;
+  if (stat(r->path.c_str(), &st)) {
+    if (errno != ENOENT && errno != ENOTDIR) r->error = errno;
+    return;
+  }
+  if (!S_ISREG(st.st_mode)) return;
+  int fd = open(r->path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    r->error = errno;
+    return;
+  }
+  r->contents.reserve(st.st_size);
+  char buffer[4096];
+  ssize_t n = 0;
+  while ((n = read(fd, buffer, sizeof(buffer))) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      r->error = errno;
+      close(fd);
+      return;
+    }
+    r->contents.append(buffer, n);
+  }
+  close(fd);
+  r->exists = true;
+}
+
+/*!
+  \brief write all of [data, data + len) at offset to fd
+  \return 0 on success, errno on failure
+ */
+int write_fully(int fd, const char *data, size_t len, off_t offset) {
+  while (len) {
+    ssize_t n = pwrite(fd, data, len, offset);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno;
+    }
+    data += n;
+    len -= n;
+    offset += n;
+  }
+  return 0;
+}
+
+/*!
+  \brief synchronously write or remove one file
+
+  Contents go to a temporary file that is then renamed over the target,
+  so concurrent readers never see a partially written tracker.
+ */
+void perform_write(initialize_output_directories::io_write_request *r) {
+  r->error = 0;
+  if (r->remove) {
+    if (unlink(r->path.c_str()) && errno != ENOENT) r->error = errno;
+    return;
+  }
+  std::string tmp = initialize_output_directories::temporary_sibling(r->path);
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    r->error = errno;
+    return;
+  }
+  r->error = write_fully(fd, r->contents.data(), r->contents.size(), 0);
+  if (close(fd) && !r->error) r->error = errno;
+  if (!r->error && rename(tmp.c_str(), r->path.c_str())) r->error = errno;
+  if (r->error) unlink(tmp.c_str());
+}
+
+/*!
+  \class sync_io_backend
+  \brief one request at a time on the calling thread
+ */
+class sync_io_backend : public initialize_output_directories::io_backend {
+ public:
+  void read_batch(
+      std::vector<initialize_output_directories::io_read_request> *requests) {
+    for (unsigned i = 0; i < requests->size(); ++i) {
+      perform_read(&requests->at(i));
+    }
+  }
+  void write_batch(
+      std::vector<initialize_output_directories::io_write_request> *requests) {
+    for (unsigned i = 0; i < requests->size(); ++i) {
+      perform_write(&requests->at(i));
+    }
+  }
+  std::string name() const { return "sync"; }
+};
+
+/*!
+  \class threaded_io_backend
+  \brief blocking requests spread across a worker pool
+ */
+class threaded_io_backend : public initialize_output_directories::io_backend {
+ public:
+  explicit threaded_io_backend(initialize_output_directories::thread_pool *pool)
+      : _pool(pool) {
+    if (!_pool) throw std::runtime_error("threaded_io_backend: null pool");
+  }
+  void read_batch(
+      std::vector<initialize_output_directories::io_read_request> *requests) {
+    _pool->parallel_for(requests->size(), [requests](unsigned i) {
+      perform_read(&requests->at(i));
+    });
+  }
+  void write_batch(
+      std::vector<initialize_output_directories::io_write_request> *requests) {
+    _pool->parallel_for(requests->size(), [requests](unsigned i) {
+      perform_write(&requests->at(i));
+    });
+  }
+  std::string name() const { return "threads"; }
+
+ private:
+  initialize_output_directories::thread_pool *_pool;
+};
+
+#ifdef INITIALIZE_OUTPUT_DIRECTORIES_HAVE_LINUX_IO_URING_H
+/*!
+  \class uring_io_backend
+  \brief requests submitted as deep io_uring queues, one queue per phase
+
+  Reads run as four dependent phases over the whole batch (statx, open,
+  read, close); writes as four (open a temporary file or unlink, write,
+  close, rename over the target). Each
+  phase keeps up to the ring depth of operations in flight, so metadata
+  round-trips to network filesystems overlap instead of serializing.
+  This talks to the kernel directly and does not require liburing.
+ */
+class uring_io_backend : public initialize_output_directories::io_backend {
+ public:
+  explicit uring_io_backend(unsigned entries);
+  ~uring_io_backend() throw();
+  void read_batch(
+      std::vector<initialize_output_directories::io_read_request> *requests);
+  void write_batch(
+      std::vector<initialize_output_directories::io_write_request> *requests);
+  std::string name() const { return "io_uring"; }
+
+ private:
+  typedef std::function<void(unsigned, struct io_uring_sqe *)> prep_function;
+  typedef std::function<void(unsigned, int)> complete_function;
+  void run(const std::vector<unsigned> &ops, const prep_function &prep,
+           const complete_function &complete);
+  unsigned reap(const complete_function &complete);
+  int _ring_fd;
+  unsigned _entries;
+  void *_sq_ptr;
+  size_t _sq_size;
+  void *_cq_ptr;
+  size_t _cq_size;
+  struct io_uring_sqe *_sqes;
+  size_t _sqes_size;
+  unsigned *_sq_tail;
+  unsigned *_sq_mask;
+  unsigned *_sq_array;
+  unsigned *_cq_head;
+  unsigned *_cq_tail;
+  unsigned *_cq_mask;
+  struct io_uring_cqe *_cqes;
+  std::mutex _mutex;
+};
+
+uring_io_backend::uring_io_backend(unsigned entries)
+    : _ring_fd(-1),
+      _entries(0),
+      _sq_ptr(MAP_FAILED),
+      _sq_size(0),
+      _cq_ptr(MAP_FAILED),
+      _cq_size(0),
+      _sqes(0),
+      _sqes_size(0) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  _ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (_ring_fd < 0)
+    throw std::runtime_error(std::string("io_uring_setup failed: ") +
+                             strerror(errno));
+  // confirm the kernel knows every opcode used here before committing to it
+  std::vector<char> probe_storage(sizeof(struct io_uring_probe) +
+                                  256 * sizeof(struct io_uring_probe_op));
+  struct io_uring_probe *probe =
+      reinterpret_cast<struct io_uring_probe *>(&probe_storage[0]);
+  if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_PROBE, probe,
+              256) < 0) {
+    close(_ring_fd);
+    throw std::runtime_error("io_uring opcode probe not supported");
+  }
+  const unsigned required[] = {IORING_OP_STATX,    IORING_OP_OPENAT,
+                               IORING_OP_READ,     IORING_OP_WRITE,
+                               IORING_OP_CLOSE,    IORING_OP_UNLINKAT,
+                               IORING_OP_RENAMEAT};
+  for (unsigned i = 0; i < sizeof(required) / sizeof(required[0]); ++i) {
+    if (required[i] > probe->last_op ||
+        !(probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED)) {
+      close(_ring_fd);
+      throw std::runtime_error("io_uring opcode " +
+                               std::to_string(required[i]) +
+                               " not supported by kernel");
+    }
+  }
+  _entries = params.sq_entries;
+  _sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  _cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+  }
+  _sq_ptr = mmap(0, _sq_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+  if (_sq_ptr == MAP_FAILED) {
+    close(_ring_fd);
+    throw std::runtime_error("io_uring submission ring mmap failed");
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    _cq_ptr = _sq_ptr;
+  } else {
+    _cq_ptr = mmap(0, _cq_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+    if (_cq_ptr == MAP_FAILED) {
+      munmap(_sq_ptr, _sq_size);
+      close(_ring_fd);
+      throw std::runtime_error("io_uring completion ring mmap failed");
+    }
+  }
+  _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  void *sqes = mmap(0, _sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    if (_cq_ptr != _sq_ptr) munmap(_cq_ptr, _cq_size);
+    munmap(_sq_ptr, _sq_size);
+    close(_ring_fd);
+    throw std::runtime_error("io_uring sqe array mmap failed");
+  }
+  _sqes = static_cast<struct io_uring_sqe *>(sqes);
+  char *sq = static_cast<char *>(_sq_ptr);
+  char *cq = static_cast<char *>(_cq_ptr);
+  _sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  _sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  _sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  _cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  _cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  _cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  _cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+uring_io_backend::~uring_io_backend() throw() {
+  munmap(_sqes, _sqes_size);
+  if (_cq_ptr != _sq_ptr) munmap(_cq_ptr, _cq_size);
+  munmap(_sq_ptr, _sq_size);
+  close(_ring_fd);
+}
+
+unsigned uring_io_backend::reap(const complete_function &complete) {
+  unsigned head = *_cq_head, n = 0;
+  unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    const struct io_uring_cqe &cqe = _cqes[head & *_cq_mask];
+    complete(static_cast<unsigned>(cqe.user_data), cqe.res);
+    ++head;
+    ++n;
+  }
+  __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+  return n;
+}
+
+void uring_io_backend::run(const std::vector<unsigned> &ops,
+                           const prep_function &prep,
+                           const complete_function &complete) {
+  unsigned submitted = 0, completed = 0;
+  while (completed < ops.size()) {
+    // top up the submission queue to the ring depth
+    unsigned tail = *_sq_tail, to_submit = 0;
+    while (submitted < ops.size() && submitted - completed < _entries) {
+      unsigned index = tail & *_sq_mask;
+      struct io_uring_sqe *sqe = &_sqes[index];
+      memset(sqe, 0, sizeof(*sqe));
+      prep(ops.at(submitted), sqe);
+      sqe->user_data = ops.at(submitted);
+      _sq_array[index] = index;
+      ++tail;
+      ++submitted;
+      ++to_submit;
+    }
+    __atomic_store_n(_sq_tail, tail, __ATOMIC_RELEASE);
+    int res = 0;
+    do {
+      res = syscall(__NR_io_uring_enter, _ring_fd, to_submit, 1,
+                    IORING_ENTER_GETEVENTS, 0, 0);
+    } while (res < 0 && errno == EINTR);
+    if (res < 0)
+      throw std::runtime_error(std::string("io_uring_enter failed: ") +
+                               strerror(errno));
+    completed += reap(complete);
+  }
+}
+
+void uring_io_backend::read_batch(
+    std::vector<initialize_output_directories::io_read_request> *requests) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::vector<struct statx> stats(requests->size());
+  std::vector<int> fds(requests->size(), -1);
+  std::vector<unsigned> ops;
+  for (unsigned i = 0; i < requests->size(); ++i) {
+    requests->at(i).exists = false;
+    requests->at(i).error = 0;
+    requests->at(i).contents.clear();
+    ops.push_back(i);
+  }
+  // phase 1: stat everything
+  run(
+      ops,
+      [requests, &stats](unsigned i, struct io_uring_sqe *sqe) {
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(requests->at(i).path.c_str());
+        sqe->len = STATX_TYPE | STATX_SIZE;
+        sqe->off = reinterpret_cast<uint64_t>(&stats.at(i));
+      },
+      [requests, &stats](unsigned i, int res) {
+        if (res < 0) {
+          if (-res != ENOENT && -res != ENOTDIR) requests->at(i).error = -res;
+        } else {
+          requests->at(i).exists = S_ISREG(stats.at(i).stx_mode);
+        }
+      });
+  // phase 2: open the regular files
+  ops.clear();
+  for (unsigned i = 0; i < requests->size(); ++i) {
+    if (requests->at(i).exists) ops.push_back(i);
+  }
+  run(
+      ops,
+      [requests](unsigned i, struct io_uring_sqe *sqe) {
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(requests->at(i).path.c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+      },
+      [requests, &fds](unsigned i, int res) {
+        if (res < 0) {
+          requests->at(i).exists = false;
+          if (-res != ENOENT) requests->at(i).error = -res;
+        } else {
+          fds.at(i) = res;
+        }
+      });
+  // phase 3: read each at its stat size
+  ops.clear();
+  for (unsigned i = 0; i < requests->size(); ++i) {
+    if (fds.at(i) >= 0 && stats.at(i).stx_size) {
+      requests->at(i).contents.resize(stats.at(i).stx_size);
+      ops.push_back(i);
+    }
+  }
+  std::vector<int> read_sizes(requests->size(), 0);
+  run(
+      ops,
+      [requests, &fds](unsigned i, struct io_uring_sqe *sqe) {
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fds.at(i);
+        sqe->addr = reinterpret_cast<uint64_t>(&requests->at(i).contents[0]);
+        sqe->len = requests->at(i).contents.size();
+        sqe->off = 0;
+      },
+      [&read_sizes](unsigned i, int res) { read_sizes.at(i) = res; });
+  for (std::vector<unsigned>::const_iterator iter = ops.begin();
+       iter != ops.end(); ++iter) {
+    initialize_output_directories::io_read_request &r = requests->at(*iter);
+    if (read_sizes.at(*iter) < 0) {
+      r.error = -read_sizes.at(*iter);
+      r.exists = false;
+    } else if (static_cast<size_t>(read_sizes.at(*iter)) !=
+               r.contents.size()) {
+      // file changed size underfoot; take the slow path for this one
+      close(fds.at(*iter));
+      fds.at(*iter) = -1;
+      perform_read(&r);
+    }
+  }
+  // phase 4: close
+  ops.clear();
+  for (unsigned i = 0; i < requests->size(); ++i) {
+    if (fds.at(i) >= 0) ops.push_back(i);
+  }
+  run(
+      ops,
+      [&fds](unsigned i, struct io_uring_sqe *sqe) {
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fds.at(i);
+      },
+      [](unsigned i, int res) {});
+}
+
+void uring_io_backend::write_batch(
+    std::vector<initialize_output_directories::io_write_request> *requests) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::vector<int> fds(requests->size(), -1);
+  std::vector<std::string> temporaries(requests->size());
+  std::vector<unsigned> ops;
+  for (unsigned i = 0; i < requests->size(); ++i) {
+    requests->at(i).error = 0;
+    if (!requests->at(i).remove) {
+      temporaries.at(i) = initialize_output_directories::temporary_sibling(
+          requests->at(i).path);
+    }
+    ops.push_back(i);
+  }
+  // phase 1: open a temporary file for writing, or unlink
+  run(
+      ops,
+      [requests, &temporaries](unsigned i, struct io_uring_sqe *sqe) {
+        sqe->fd = AT_FDCWD;
+        if (requests->at(i).remove) {
+          sqe->opcode = IORING_OP_UNLINKAT;
+          sqe->addr = reinterpret_cast<uint64_t>(requests->at(i).path.c_str());
+        } else {
+          sqe->opcode = IORING_OP_OPENAT;
+          sqe->addr = reinterpret_cast<uint64_t>(temporaries.at(i).c_str());
+          sqe->open_flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+          sqe->len = 0666;
+        }
+      },
+      [requests, &fds](unsigned i, int res) {
+        if (requests->at(i).remove) {
+          if (res < 0 && -res != ENOENT) requests->at(i).error = -res;
+        } else if (res < 0) {
+          requests->at(i).error = -res;
+        } else {
+          fds.at(i) = res;
+        }
+      });
+  // phase 2: write contents
+  ops.clear();
+  for (unsigned i = 0; i < requests->size(); ++i) {
+    if (fds.at(i) >= 0 && !requests->at(i).contents.empty()) ops.push_back(i);
+  }
+  std::vector<int> write_sizes(requests->size(), 0);
+  run(
+      ops,
+      [requests, &fds](unsigned i, struct io_uring_sqe *sqe) {
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fds.at(i);
+        sqe->addr = reinterpret_cast<uint64_t>(requests->at(i).contents.data());
+        sqe->len = requests->at(i).contents.size();
+        sqe->off = 0;
+      },
+      [&write_sizes](unsigned i, int res) { write_sizes.at(i) = res; });
+  for (std::vector<unsigned>::const_iterator iter = ops.begin();
+       iter != ops.end(); ++iter) {
+    initialize_output_directories::io_write_request &r = requests->at(*iter);
+    int n = write_sizes.at(*iter);
+    if (n < 0) {
+      r.error = -n;
+    } else if (static_cast<size_t>(n) < r.contents.size()) {
+      // short write; finish synchronously
+      r.error = write_fully(fds.at(*iter), r.contents.data() + n,
+                            r.contents.size() - n, n);
+    }
+  }
+  // phase 3: close, surfacing deferred write errors
+  ops.clear();
+  for (unsigned i = 0; i < requests->size(); ++i) {
+    if (fds.at(i) >= 0) ops.push_back(i);
+  }
+  run(
+      ops,
+      [&fds](unsigned i, struct io_uring_sqe *sqe) {
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fds.at(i);
+      },
+      [requests](unsigned i, int res) {
+        if (res < 0 && !requests->at(i).error) requests->at(i).error = -res;
+      });
+  // phase 4: rename complete files over their targets
+  std::vector<unsigned> renames;
+  for (std::vector<unsigned>::const_iterator iter = ops.begin();
+       iter != ops.end(); ++iter) {
+    if (!requests->at(*iter).error) renames.push_back(*iter);
+  }
+  run(
+      renames,
+      [requests, &temporaries](unsigned i, struct io_uring_sqe *sqe) {
+        sqe->opcode = IORING_OP_RENAMEAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(temporaries.at(i).c_str());
+        sqe->len = AT_FDCWD;
+        sqe->addr2 = reinterpret_cast<uint64_t>(requests->at(i).path.c_str());
+      },
+      [requests](unsigned i, int res) {
+        if (res < 0) requests->at(i).error = -res;
+      });
+  for (std::vector<unsigned>::const_iterator iter = ops.begin();
+       iter != ops.end(); ++iter) {
+    if (requests->at(*iter).error) unlink(temporaries.at(*iter).c_str());
+  }
+}
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_HAVE_LINUX_IO_URING_H
+}  // namespace
+
+std::shared_ptr<initialize_output_directories::io_backend>
+initialize_output_directories::io_backend::create(const std::string &name,
+                                                  thread_pool *pool) {
+  if (!name.compare("sync")) {
+    return std::shared_ptr<io_backend>(new sync_io_backend);
+  }
+  if (!name.compare("threads")) {
+    return std::shared_ptr<io_backend>(new threaded_io_backend(pool));
+  }
+  if (!name.compare("io_uring") || !name.compare("auto")) {
+#ifdef INITIALIZE_OUTPUT_DIRECTORIES_HAVE_LINUX_IO_URING_H
+    try {
+      return std::shared_ptr<io_backend>(new uring_io_backend(256));
+    } catch (const std::runtime_error &e) {
+      if (!name.compare("io_uring")) throw;
+    }
+#else
+    if (!name.compare("io_uring"))
+      throw std::runtime_error(
+          "io_backend: io_uring support was not compiled in");
+#endif
+    if (pool && pool->size() > 1) {
+      return std::shared_ptr<io_backend>(new threaded_io_backend(pool));
+    }
+    return std::shared_ptr<io_backend>(new sync_io_backend);
+  }
+  throw std::runtime_error("io_backend: unrecognized backend \"" + name +
+                           "\"");
+}
+
+initialize_output_directories::tracker_cache::entry &
+initialize_output_directories::tracker_cache::load(const std::string &path) {
+  std::map<std::string, entry>::iterator finder = _entries.find(path);
+  if (finder != _entries.end()) return finder->second;
+  std::vector<std::string> paths(1, path);
+  prefetch(paths);
+  return _entries[path];
+}
+
+void initialize_output_directories::tracker_cache::prefetch(
+    const std::vector<std::string> &paths) {
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  std::vector<io_read_request> requests;
+  for (std::vector<std::string>::const_iterator iter = paths.begin();
+       iter != paths.end(); ++iter) {
+    if (_entries.find(*iter) == _entries.end())
+      requests.push_back(io_read_request(*iter));
+  }
+  if (requests.empty()) return;
+  _backend->read_batch(&requests);
+  for (std::vector<io_read_request>::iterator iter = requests.begin();
+       iter != requests.end(); ++iter) {
+    if (iter->error)
+      throw std::runtime_error("cannot read tracking file \"" + iter->path +
+                               "\": " + strerror(iter->error));
+    entry &e = _entries[iter->path];
+    e.exists = iter->exists;
+    e.contents.swap(iter->contents);
+  }
+}
+
+bool initialize_output_directories::tracker_cache::is_regular_file(
+    const std::string &path) {
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  return load(path).exists;
+}
+
+const std::string &initialize_output_directories::tracker_cache::read(
+    const std::string &path) {
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  entry &e = load(path);
+  if (!e.exists)
+    throw std::runtime_error("cannot open tracking file \"" + path + "\"");
+  return e.contents;
+}
+
+void initialize_output_directories::tracker_cache::write(
+    const std::string &path, const std::string &contents, bool append) {
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  entry &e = load(path);
+  if (append && e.exists) {
+    e.contents += contents;
+  } else {
+    e.contents = contents;
+  }
+  e.exists = true;
+  e.dirty = true;
+  if (!_deferred) apply(path, e);
+}
+
+void initialize_output_directories::tracker_cache::remove(
+    const std::string &path) {
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  entry &e = _entries[path];
+  e.exists = false;
+  e.contents.clear();
+  e.dirty = true;
+  if (!_deferred) apply(path, e);
+}
+
+void initialize_output_directories::tracker_cache::apply(
+    const std::string &path, const entry &e) {
+  std::vector<std::string> paths(1, path);
+  commit(paths);
+}
+
+void initialize_output_directories::tracker_cache::flush() {
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  std::vector<std::string> paths;
+  for (std::map<std::string, entry>::const_iterator iter = _entries.begin();
+       iter != _entries.end(); ++iter) {
+    if (iter->second.dirty) paths.push_back(iter->first);
+  }
+  commit(paths);
+}
+
+void initialize_output_directories::tracker_cache::commit(
+    const std::vector<std::string> &paths) {
+  std::vector<io_write_request> requests;
+  for (std::vector<std::string>::const_iterator iter = paths.begin();
+       iter != paths.end(); ++iter) {
+    entry &e = _entries[*iter];
+    if (e.exists && _store) {
+      _store->link(_store->put(e.contents), *iter);
+      e.dirty = false;
+      continue;
+    }
+    io_write_request r;
+    r.path = *iter;
+    r.contents = e.contents;
+    r.remove = !e.exists;
+    requests.push_back(r);
+  }
+  if (requests.empty()) return;
+  _backend->write_batch(&requests);
+  for (std::vector<io_write_request>::const_iterator iter = requests.begin();
+       iter != requests.end(); ++iter) {
+    if (iter->error)
+      throw std::runtime_error("cannot write tracking file \"" + iter->path +
+                               "\": " + strerror(iter->error));
+    _entries[iter->path].dirty = false;
+  }
+}
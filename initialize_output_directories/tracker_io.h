@@ -0,0 +1,153 @@
+/*!
+  \file tracker_io.h
+  \brief batched filesystem access for tracking files
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_TRACKER_IO_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_TRACKER_IO_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "initialize_output_directories/content_store.h"
+#include "initialize_output_directories/thread_pool.h"
+
+namespace initialize_output_directories {
+/*!
+  \brief one whole-file read: stat, and if a regular file, its contents
+ */
+struct io_read_request {
+  io_read_request() : exists(false), error(0) {}
+  explicit io_read_request(const std::string &p)
+      : path(p), exists(false), error(0) {}
+  std::string path;
+  bool exists;           //!< whether path is a regular file
+  std::string contents;  //!< file contents if exists
+  int error;             //!< errno for failures other than absence
+};
+
+/*!
+  \brief one whole-file write (atomic replacement) or removal
+ */
+struct io_write_request {
+  io_write_request() : remove(false), error(0) {}
+  std::string path;
+  std::string contents;
+  bool remove;  //!< unlink instead of writing; absence is not an error
+  int error;    //!< errno on failure
+};
+
+/*!
+  \class io_backend
+  \brief executes batches of independent whole-file operations
+
+  Requests within a batch may complete in any order. Failures are
+  reported per request through the error field rather than thrown.
+ */
+class io_backend {
+ public:
+  virtual ~io_backend() throw() {}
+  virtual void read_batch(std::vector<io_read_request> *requests) = 0;
+  virtual void write_batch(std::vector<io_write_request> *requests) = 0;
+  virtual std::string name() const = 0;
+
+  /*!
+    \brief construct a backend by name
+    @param name one of "auto", "io_uring", "threads", "sync"
+    @param pool worker pool for the threaded backend; must outlive it
+    \return the requested backend
+
+    "auto" tries io_uring and falls back to the thread pool if the
+    kernel or build does not support it. Requesting "io_uring"
+    explicitly fails loudly instead.
+   */
+  static std::shared_ptr<io_backend> create(const std::string &name,
+                                            thread_pool *pool);
+};
+
+/*!
+  \class tracker_cache
+  \brief in-memory view of tracking files with deferred, batched writes
+
+  Tracking files are small, so a run can prefetch every tracker it will
+  inspect in a single batch, evaluate all changes in memory, and then
+  apply every write and removal in a second batch with flush(). In
+  write-through mode, each write is applied as soon as it is made.
+  All operations are safe to call concurrently; a reference returned
+  by read() stays valid as long as no other thread changes that path.
+  With a content store, written trackers are linked to store blobs
+  instead. Backends replace files by renaming a complete temporary file
+  over them, so other processes never see a partial tracker and a store
+  blob linked at that path is never modified in place.
+ */
+class tracker_cache {
+ public:
+  /*!
+    \brief constructor
+    @param backend filesystem backend executing reads and writes
+    @param deferred whether to hold writes until flush()
+   */
+  tracker_cache(const std::shared_ptr<io_backend> &backend, bool deferred)
+      : _backend(backend), _deferred(deferred) {
+    if (!_backend) throw std::runtime_error("tracker_cache: null backend");
+  }
+  /*!
+    \brief constructor
+    @param backend filesystem backend executing reads and removals
+    @param deferred whether to hold writes until flush()
+    @param store content store; written trackers become links to its blobs
+   */
+  tracker_cache(const std::shared_ptr<io_backend> &backend, bool deferred,
+                const std::shared_ptr<content_store> &store)
+      : _backend(backend), _deferred(deferred), _store(store) {
+    if (!_backend) throw std::runtime_error("tracker_cache: null backend");
+  }
+  ~tracker_cache() throw() {}
+
+  /*!
+    \brief load any paths not yet known, in one batch
+    @param paths tracker files that will be inspected
+   */
+  void prefetch(const std::vector<std::string> &paths);
+  /*!
+    \brief whether path is (or will be, after flush) a regular file
+   */
+  bool is_regular_file(const std::string &path);
+  /*!
+    \brief current contents of a tracker
+    \warning throws if the file does not exist
+   */
+  const std::string &read(const std::string &path);
+  void write(const std::string &path, const std::string &contents,
+             bool append);
+  void remove(const std::string &path);
+  /*!
+    \brief apply all pending writes and removals in one batch
+   */
+  void flush();
+
+ private:
+  struct entry {
+    entry() : exists(false), dirty(false) {}
+    bool exists;
+    bool dirty;
+    std::string contents;
+  };
+  entry &load(const std::string &path);
+  void apply(const std::string &path, const entry &e);
+  void commit(const std::vector<std::string> &paths);
+  std::shared_ptr<io_backend> _backend;
+  bool _deferred;
+  std::shared_ptr<content_store> _store;
+  std::map<std::string, entry> _entries;
+  std::recursive_mutex _mutex;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_TRACKER_IO_H_
@@ -7,127 +7,347 @@
 
 #include "initialize_output_directories/tracking_files.h"
 
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+
 void initialize_output_directories::model_matrix::load_data(
     const std::string &filename) {
-  // https://stackoverflow.com/questions/17925051/fast-textfile-reading-in-c
-  boost::iostreams::mapped_file input;
+  load_data(filename, 0);
+}
+
+void initialize_output_directories::model_matrix::load_data(
+    const std::string &filename, thread_pool *pool) {
+  load(filename, pool, false);
+}
+
+void initialize_output_directories::model_matrix::load_all_data(
+    const std::string &filename, thread_pool *pool) {
+  load(filename, pool, true);
+}
+
+initialize_output_directories::model_matrix
+initialize_output_directories::model_matrix::build(
+    const std::string &id, const std::function<void(database_table *)> &fill) {
+  std::shared_ptr<storage> filled(new storage);
+  fill(filled.get());
+  model_matrix res;
+  res.set_id(id);
+  res._storage = filled;
+  return res;
+}
+
+bool initialize_output_directories::model_matrix::equivalent(
+    const model_matrix &obj, const value_comparison &compare,
+    const std::string &categorical) const {
+  if (!compare.typed()) return *this == obj;
+  if (_storage == obj._storage) return true;
+  if (get_ids() != obj.get_ids() ||
+      get_data().size() != obj.get_data().size())
+    return false;
+  for (unsigned i = 0; i < get_data().size(); ++i) {
+    bool categorized =
+        !categorical.empty() && !get_headers().at(i).compare(categorical);
+    if (!compare.same_column(get_data().at(i), obj.get_data().at(i),
+                             categorized))
+      return false;
+  }
+  return true;
+}
+
+void initialize_output_directories::model_matrix::load(
+    const std::string &filename, thread_pool *pool, bool all_columns) {
+  column_selection selection;
+  selection.id = get_id();
+  selection.all = all_columns;
+  selection.names.push_back(get_phenotype());
+  selection.names.insert(selection.names.end(), get_covariates().begin(),
+                         get_covariates().end());
+  std::shared_ptr<storage> loaded(new storage);
+  database_reader::open(filename, pool)->read(selection, loaded.get());
+  _storage = loaded;
+}
+
+namespace {
+const unsigned rows_per_block = 16384;
+
+void append_uint32(uint32_t value, std::string *out) {
+  // little endian, independent of host
+  for (unsigned i = 0; i < 4; ++i) {
+    *out += static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+}
+
+void append_binary_string(std::string_view s, std::string *out) {
+  append_uint32(s.size(), out);
+  out->append(s.data(), s.size());
+}
+
+/*!
+  \brief compress a buffer as one complete gzip member
+
+  Concatenated gzip members form a valid gzip file, so blocks can be
+  compressed independently and written back to back.
+ */
+std::string gzip_member(const std::string &raw, const std::string &filename) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  // 15 + 16: maximum window, gzip wrapper
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    throw std::runtime_error("cannot initialize zlib for \"" + filename +
+                             "\"");
+  std::string res(deflateBound(&stream, raw.size()), '\0');
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(raw.data()));
+  stream.avail_in = raw.size();
+  stream.next_out = reinterpret_cast<Bytef *>(&res[0]);
+  stream.avail_out = res.size();
+  int status = deflate(&stream, Z_FINISH);
+  res.resize(res.size() - stream.avail_out);
+  deflateEnd(&stream);
+  if (status != Z_STREAM_END)
+    throw std::runtime_error("gzip compression failed for \"" + filename +
+                             "\"");
+  return res;
+}
+
+void write_all(int fd, std::vector<std::string> *buffers,
+               const std::string &filename) {
+  std::vector<struct iovec> iov;
+  for (std::vector<std::string>::iterator iter = buffers->begin();
+       iter != buffers->end(); ++iter) {
+    if (iter->empty()) continue;
+    struct iovec v;
+    v.iov_base = &(*iter)[0];
+    v.iov_len = iter->size();
+    iov.push_back(v);
+  }
+  std::size_t next = 0;
+  while (next < iov.size()) {
+    int count = std::min<std::size_t>(iov.size() - next, IOV_MAX);
+    ssize_t written = writev(fd, &iov[next], count);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      throw std::runtime_error("cannot write model_matrix file \"" + filename +
+                               "\": " + strerror(errno));
+    }
+    // skip fully written buffers, then trim a partially written one
+    while (next < iov.size() &&
+           static_cast<std::size_t>(written) >= iov[next].iov_len) {
+      written -= iov[next].iov_len;
+      ++next;
+    }
+    if (written) {
+      iov[next].iov_base = static_cast<char *>(iov[next].iov_base) + written;
+      iov[next].iov_len -= written;
+    }
+  }
+}
+}  // namespace
+
+void initialize_output_directories::model_matrix::write(
+    const std::string &filename) const {
+  write(filename, 0, tsv);
+}
+
+void initialize_output_directories::model_matrix::write(
+    const std::string &filename, thread_pool *pool,
+    output_format format) const {
+  const std::vector<std::string_view> &ids = get_ids();
+  const std::vector<std::vector<std::string_view> > &data = get_data();
+  for (unsigned i = 0; i < data.size(); ++i) {
+    if (ids.size() != data.at(i).size())
+      throw std::runtime_error(
+          "jagged model matrix: " + std::to_string(ids.size()) +
+          " (ids) versus " + std::to_string(data.at(i).size()) + " (" +
+          std::to_string(i) + ")");
+  }
+  std::string header = format_header(format, data.at(0).size());
+  int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+    throw std::runtime_error("cannot write model_matrix file \"" + filename +
+                             "\"");
   try {
-    input.open(filename.c_str(), boost::iostreams::mapped_file::readonly);
+    write_rows(fd, filename, pool, format, header);
   } catch (...) {
-    throw std::runtime_error(
-        "initialize_output_directories::model_matrix::load_data: "
-        "cannot open file \"" +
-        filename + "\"");
-  }
-  const char *f = input.const_data(), *f_next = 0;
-  const char *l = f + input.size();
-  std::string line = "", catcher = "";
-  std::map<std::string, bool> targets;
-  targets[get_phenotype()] = true;
-  for (std::vector<std::string>::const_iterator iter = get_covariates().begin();
-       iter != get_covariates().end(); ++iter) {
-    targets[*iter] = true;
-  }
-  std::vector<bool> include_column;
-  unsigned id_colnum = 0, nfound = 0;
-  _headers.clear();
-  _ids.clear();
-  if ((f_next = static_cast<const char *>(memchr(f, '\n', l - f)))) {
-    line = std::string(f, f_next - f);
-    std::istringstream strm1(line);
-    while (strm1 >> catcher) {
-      include_column.push_back(targets.find(catcher) != targets.end());
-      if (targets.find(catcher) != targets.end()) ++nfound;
-      if (*include_column.rbegin()) _headers.push_back(catcher);
-      if (!catcher.compare(get_id())) {
-        id_colnum = include_column.size() - 1;
-      }
+    ::close(fd);
+    throw;
+  }
+  if (::close(fd))
+    throw std::runtime_error("cannot write model_matrix file \"" + filename +
+                             "\": " + strerror(errno));
+}
+
+std::string initialize_output_directories::model_matrix::format_header(
+    output_format format, unsigned n_rows) const {
+  const std::vector<std::string> &headers = _storage->headers;
+  std::string header = "";
+  if (format == binary) {
+    header.append("IODMM1\n", 8);
+    append_uint32(n_rows, &header);
+    append_uint32(headers.size(), &header);
+    append_binary_string(get_id(), &header);
+    for (std::vector<std::string>::const_iterator iter = headers.begin();
+         iter != headers.end(); ++iter) {
+      append_binary_string(*iter, &header);
     }
-    f = f_next + 1;
   } else {
-    throw std::runtime_error("no header in phenotype file \"" + filename +
-                             "\"");
+    header = get_id();
+    for (std::vector<std::string>::const_iterator iter = headers.begin();
+         iter != headers.end(); ++iter) {
+      header += '\t';
+      header += *iter;
+    }
+    header += '\n';
   }
-  _data.clear();
-  _data.resize(nfound);
-  while (f && f != l) {
-    nfound = 0;
-    for (unsigned i = 0; i < include_column.size(); ++i) {
-      if (!f || f == l) {
-        throw std::runtime_error("ran out of tokens for phenotype file \"" +
-                                 filename + "\"");
-      }
-      if ((f_next = static_cast<const char *>(memchr(
-               f, (i == include_column.size() - 1 ? '\n' : '\t'), l - f)))) {
-        if (i == id_colnum) {
-          catcher = std::string(f, f_next - f);
-          _ids.push_back(catcher);
-        }
-        if (include_column.at(i)) {
-          catcher = std::string(f, f_next - f);
-          _data.at(nfound).push_back(catcher);
-          ++nfound;
+  return header;
+}
+
+void initialize_output_directories::model_matrix::write_rows(
+    int fd, const std::string &filename, thread_pool *pool,
+    output_format format, const std::string &prefix) const {
+  const std::vector<std::string_view> &ids = get_ids();
+  const std::vector<std::vector<std::string_view> > &data = get_data();
+  unsigned n_rows = ids.size();
+  // rows are formatted row-major in independent blocks, a batch of
+  // blocks at a time, and each batch goes out in a single writev
+  unsigned n_blocks = (n_rows + rows_per_block - 1) / rows_per_block;
+  unsigned blocks_per_batch = 4 * (pool ? pool->size() : 1);
+  if (!n_blocks) n_blocks = 1;
+  for (unsigned batch_start = 0; batch_start < n_blocks;
+       batch_start += blocks_per_batch) {
+    unsigned batch_size =
+        std::min<unsigned>(blocks_per_batch, n_blocks - batch_start);
+    std::vector<std::string> buffers(batch_size);
+    std::function<void(unsigned)> format_block = [&](unsigned b) {
+      unsigned block = batch_start + b;
+      unsigned row_start = block * rows_per_block;
+      unsigned row_end =
+          std::min<unsigned>(row_start + rows_per_block, n_rows);
+      std::string &out = buffers[b];
+      if (!block) out = prefix;
+      for (unsigned i = row_start; i < row_end; ++i) {
+        if (format == binary) {
+          append_binary_string(ids[i], &out);
+          for (unsigned j = 0; j < data.size(); ++j) {
+            append_binary_string(data[j][i], &out);
+          }
+        } else {
+          out.append(ids[i].data(), ids[i].size());
+          for (unsigned j = 0; j < data.size(); ++j) {
+            out += '\t';
+            out.append(data[j][i].data(), data[j][i].size());
+          }
+          out += '\n';
         }
-      } else {
-        throw std::runtime_error("insufficient tokens in phenotype file \"" +
-                                 filename + "\"");
       }
-      f = f_next + 1;
+      if (format == tsv_gzip && !out.empty()) out = gzip_member(out, filename);
+    };
+    if (pool) {
+      pool->parallel_for(batch_size, format_block);
+    } else {
+      for (unsigned b = 0; b < batch_size; ++b) format_block(b);
     }
+    write_all(fd, &buffers, filename);
   }
-  input.close();
 }
 
-void initialize_output_directories::model_matrix::write(
-    const std::string &filename) const {
-  std::ofstream output;
-  output.open(filename.c_str());
-  if (!output.is_open())
-    throw std::runtime_error("cannot write model_matrix file \"" + filename +
-                             "\"");
-  output << get_id();
-  for (std::vector<std::string>::const_iterator iter = _headers.begin();
-       iter != _headers.end(); ++iter) {
-    output << '\t' << *iter;
-  }
-  output << std::endl;
-  for (unsigned i = 0; i < _data.size(); ++i) {
-    if (_ids.size() != _data.at(i).size())
-      throw std::runtime_error(
-          "jagged model matrix: " + std::to_string(_ids.size()) +
-          " (ids) versus " + std::to_string(_data.at(i).size()) + " (" +
-          std::to_string(i) + ")");
+initialize_output_directories::model_matrix
+initialize_output_directories::model_matrix::restrict_to(
+    const std::vector<std::string> &ids) const {
+  const storage &full = *_storage;
+  std::call_once(full.row_index_built, [&full]() {
+    full.row_index.reserve(full.ids.size());
+    for (unsigned i = 0; i < full.ids.size(); ++i) {
+      full.row_index.emplace(full.ids[i], i);
+    }
+  });
+  std::shared_ptr<storage> subset(new storage);
+  subset->parent = _storage;
+  subset->headers = full.headers;
+  subset->data.resize(full.data.size());
+  std::vector<unsigned> rows;
+  rows.reserve(ids.size());
+  for (std::vector<std::string>::const_iterator iter = ids.begin();
+       iter != ids.end(); ++iter) {
+    std::unordered_map<std::string_view, unsigned>::const_iterator finder =
+        full.row_index.find(*iter);
+    if (finder != full.row_index.end()) rows.push_back(finder->second);
   }
-  for (unsigned i = 0; i < _data.at(0).size(); ++i) {
-    output << _ids.at(i);
-    for (unsigned j = 0; j < _data.size(); ++j) {
-      output << '\t' << _data.at(j).at(i);
+  subset->ids.reserve(rows.size());
+  for (std::vector<unsigned>::const_iterator iter = rows.begin();
+       iter != rows.end(); ++iter) {
+    subset->ids.push_back(full.ids[*iter]);
+  }
+  for (unsigned j = 0; j < full.data.size(); ++j) {
+    subset->data[j].reserve(rows.size());
+    for (std::vector<unsigned>::const_iterator iter = rows.begin();
+         iter != rows.end(); ++iter) {
+      subset->data[j].push_back(full.data[j][*iter]);
     }
-    output << std::endl;
   }
-  output.close();
+  model_matrix res(*this);
+  res._storage = subset;
+  return res;
+}
+
+initialize_output_directories::model_matrix
+initialize_output_directories::model_matrix::project(
+    const std::string &phenotype,
+    const std::vector<std::string> &covariates) const {
+  std::shared_ptr<storage> projection(new storage);
+  projection->parent = _storage;
+  projection->ids = _storage->ids;
+  for (unsigned j = 0; j < _storage->headers.size(); ++j) {
+    const std::string &header = _storage->headers[j];
+    if (header.compare(phenotype) &&
+        std::find(covariates.begin(), covariates.end(), header) ==
+            covariates.end())
+      continue;
+    projection->headers.push_back(header);
+    projection->data.push_back(_storage->data[j]);
+  }
+  model_matrix res(*this);
+  res.set_phenotype(phenotype);
+  res.set_covariates(covariates);
+  res._storage = projection;
+  return res;
 }
 
 initialize_output_directories::categorical_variable
 initialize_output_directories::model_matrix::categorize(
     const std::string &name) const {
-  std::map<std::string, unsigned> res;
-  std::map<std::string, unsigned>::iterator finder;
+  // keys view the arena, which outlives this function
+  std::map<std::string_view, unsigned> res;
+  std::map<std::string_view, unsigned>::iterator finder;
+  const std::vector<std::string> &headers = _storage->headers;
   unsigned target_colnum = 0;
-  for (; target_colnum < _headers.size(); ++target_colnum) {
-    if (!_headers.at(target_colnum).compare(name)) break;
+  for (; target_colnum < headers.size(); ++target_colnum) {
+    if (!headers.at(target_colnum).compare(name)) break;
   }
-  if (target_colnum == _headers.size())
+  if (target_colnum == headers.size())
     throw std::runtime_error("categorize: unable to find header \"" + name +
                              "\"");
-  for (std::vector<std::string>::const_iterator iter =
-           _data.at(target_colnum).begin();
-       iter != _data.at(target_colnum).end(); ++iter) {
+  for (std::vector<std::string_view>::const_iterator iter =
+           get_data().at(target_colnum).begin();
+       iter != get_data().at(target_colnum).end(); ++iter) {
     if ((finder = res.find(*iter)) == res.end()) {
       finder = res.insert(std::make_pair(*iter, 0)).first;
     }
     ++finder->second;
   }
+  return categorical_variable::from_level_counts(res);
+}
+
+initialize_output_directories::categorical_variable
+initialize_output_directories::categorical_variable::from_level_counts(
+    const std::map<std::string_view, unsigned> &counts) {
   // so realistically, there shouldn't be more than like...
   //   15 or so categories? probably want to configure this
   //   in a user-accessible way later. alternate groups with <100
@@ -139,20 +359,24 @@ initialize_output_directories::model_matrix::categorize(
   categorical_variable cv;
   std::set<unsigned> combined_alternate;
   unsigned combined_alternate_meta_count = 0;
-  for (std::map<std::string, unsigned>::const_iterator iter = res.begin();
-       iter != res.end(); ++iter) {
+  for (std::map<std::string_view, unsigned>::const_iterator iter =
+           counts.begin();
+       iter != counts.end(); ++iter) {
+    cv._total_subjects += iter->second;
     if (iter->first.find_first_not_of("0123456789") == std::string::npos) {
-      std::istringstream strm1(iter->first);
+      std::istringstream strm1{std::string(iter->first)};
       unsigned val = 0;
       if (!(strm1 >> val))
         throw std::runtime_error(
-            "confusingly unable to convert to integer: \"" + iter->first +
+            "confusingly unable to convert to integer: \"" +
+            std::string(iter->first) +
             "\"");
+      cv._level_subjects[val] += iter->second;
       if (iter->second < 100) {
         combined_alternate.emplace(val);
         combined_alternate_meta_count += iter->second;
       } else {
-        if (iter == res.begin()) {
+        if (iter == counts.begin()) {
           cv.set_reference_level(val);
         } else {
           cv.add_comparison_group(val);
@@ -166,194 +390,63 @@ initialize_output_directories::model_matrix::categorize(
   return cv;
 }
 
-void initialize_output_directories::tracking_files::initialize(
-    const yaml_reader &config) {
+double initialize_output_directories::categorical_variable::comparison_share(
+    unsigned index) const {
+  if (!_total_subjects) return 1.0;
+  std::set<unsigned> levels(_reference_group);
+  const std::set<unsigned> &comparison = get_comparison_group(index);
+  levels.insert(comparison.begin(), comparison.end());
+  unsigned subjects = 0;
+  for (std::set<unsigned>::const_iterator iter = levels.begin();
+       iter != levels.end(); ++iter) {
+    std::map<unsigned, unsigned>::const_iterator finder =
+        _level_subjects.find(*iter);
+    if (finder != _level_subjects.end()) subjects += finder->second;
+  }
+  return static_cast<double>(subjects) / _total_subjects;
+}
+
+void initialize_output_directories::tracking_files::initialize() {
+  // without a shared cache, act directly on disk as each change is made
+  if (!_cache) {
+    _cache.reset(new tracker_cache(io_backend::create("sync", 0), false));
+  }
   // create the target directory if needed
   std::string target_dir =
       get_output_prefix().substr(0, get_output_prefix().rfind("/"));
+  if (_planner) {
+    _planner->require(target_dir);
+    return;
+  }
   boost::filesystem::path target_dir_path = target_dir;
   boost::filesystem::create_directories(target_dir_path);
-  // pull the required presets from this extension configuration
-  _phenotype_dataset_suffix = config.get_entry("phenotype-dataset");
-  _phenotype_suffix = config.get_entry("phenotype");
-  _covariates_suffix = config.get_entry("covariates");
-  // the categories tracking suffix is permitted to be NA in the original code
-  // which indicated the use of BOLT or fastGWA, one of the methods that doesn't
-  // operate on categorical/binary traits. but now, the categorical tracker is
-  // specified once in the global tracker extension file and never again.
-  // so, it's appropriate to unconditionally search for it here, but later
-  // on the tracker should only run when the trait is actually categorical or
-  // binary
-  _categories_suffix = config.get_entry("categories");
-  _finalized_suffix = config.get_entry("finalization");
-  // get as many custom extensions as are available
-  YAML::Node data;
-  data = config.get_node("general-extensions");
-  // should be a map
-  if (data.Type() != YAML::NodeType::Map) {
-    throw std::runtime_error(
-        "initialize: extensions config entry 'general-extensions'"
-        " is supposed to be a YAML Map, but is not :(");
-  }
-  std::string observed_name = "", observed_suffix = "", observed_default = "",
-              observed_option = "";
-  for (YAML::const_iterator iter = data.begin(); iter != data.end(); ++iter) {
-    if (iter->second["suffix"] && iter->second["default"]) {
-      if (iter->second["suffix"].IsScalar() &&
-          iter->second["default"].IsScalar()) {
-        extension_definition edef;
-        observed_name = iter->first.as<std::string>();
-        observed_suffix = iter->second["suffix"].as<std::string>();
-        observed_default = iter->second["default"].as<std::string>();
-        edef.set_name(observed_name);
-        edef.set_extension(observed_suffix);
-        edef.set_default(observed_default);
-        // there is an optional "options" section that contains the predefined
-        // permitted values for this extension tracker
-        if (iter->second["options"]) {
-          std::vector<std::string> extension_options;
-          if (iter->second["options"].Type() == YAML::NodeType::Scalar) {
-            observed_option = iter->second["options"].as<std::string>();
-            edef.add_permitted_value(observed_option);
-          } else if (iter->second["options"].Type() ==
-                     YAML::NodeType::Sequence) {
-            for (YAML::const_iterator options_iter =
-                     iter->second["options"].begin();
-                 options_iter != iter->second["options"].end();
-                 ++options_iter) {
-              observed_option = options_iter->as<std::string>();
-              edef.add_permitted_value(observed_option);
-            }
-          } else {
-            throw std::runtime_error(
-                "initialize: extensions config entry 'general-extensions'"
-                " key '" +
-                observed_name +
-                "' section 'options' contains "
-                "invalid data type (likely a Map which is not supported");
-          }
-        }
-        _general_extensions[iter->first.as<std::string>()] = edef;
-      } else {
-        throw std::runtime_error(
-            "initialize: extensions config entry 'general-extensions'"
-            " key '" +
-            iter->first.as<std::string>() +
-            "' is supposed to contain "
-            "simple key:value pairs, but is not for either entry 'suffix' or "
-            "'default'");
-      }
-    } else {
-      throw std::runtime_error(
-          "initialize: extensions config entry 'general-extensions'"
-          " should have maps containing at least keys 'suffix' and "
-          "'default', but key '" +
-          iter->first.as<std::string>() + "' does not");
-    }
-  }
 }
 
 bool initialize_output_directories::tracking_files::check_file(
-    const yaml_reader &config, const extension_definition &edef, bool pretend,
-    bool force, bool must_exist) const {
-  std::string tag = edef.get_name();
-  std::string suffix = edef.get_extension();
-  std::string value_default = edef.get_default();
+    const resolved_tracker &tracker, bool pretend, bool force) const {
   if (pretend) return false;
-  std::string line = "";
-  std::vector<std::string> values;
-  std::map<std::string, std::string> mapped_values;
-  std::string filename = get_output_prefix() + suffix;
-  // weird corner case: current config doesn't have entry but previous run did
-  if (!config.query_valid(tag)) {
-    if (must_exist && value_default.empty())
-      throw std::runtime_error("check_file: essential tag \"" + tag +
-                               "\" not found "
-                               "in configuration for analysis \"" +
-                               get_output_prefix() + "\"");
-    values.push_back(value_default);
-  } else {
-    YAML::Node head = config.get_node(tag);
-    if (head.Type() == YAML::NodeType::Scalar) {
-      values.push_back(head.as<std::string>());
-    } else if (head.Type() == YAML::NodeType::Sequence) {
-      for (YAML::const_iterator iter = head.begin(); iter != head.end();
-           ++iter) {
-        values.push_back(iter->as<std::string>());
-      }
-    } else if (head.Type() == YAML::NodeType::Map) {
-      for (YAML::const_iterator iter = head.begin(); iter != head.end();
-           ++iter) {
-        mapped_values[iter->first.as<std::string>()] =
-            iter->second.as<std::string>();
-      }
-    } else {
-      throw std::runtime_error("check_file: tracker '" + tag +
-                               "' entry "
-                               "type not recognized");
-    }
-  }
-  // confirm that all entries in "values" are valid options for this tracker
-  // currently only enabled for sequence-type input; map type input is targeted
-  // at variable names, which won't ever be enumerated at config level,
-  // hopefully?
-  for (std::vector<std::string>::const_iterator iter = values.begin();
-       iter != values.end(); ++iter) {
-    if (!edef.is_permitted_value(*iter)) {
-      throw std::runtime_error("check_file: tracker '" + tag + "' value '" +
-                               *iter +
-                               "' not among permitted values for this tracker");
-    }
-  }
-  if (!boost::filesystem::is_regular_file(boost::filesystem::path(filename))) {
-    if (values.empty()) {
-      update_tracker(filename, mapped_values, false);
-    } else {
-      update_tracker(filename, values, false);
-    }
+  tracker.validate(get_output_prefix());
+  std::string filename = get_output_prefix() + tracker.get_suffix();
+  if (!_cache->is_regular_file(filename)) {
+    write_tracker(filename, tracker.get_contents(), false);
     return true;
   }
-  std::ifstream input(filename.c_str());
-  if (!input.is_open())
-    throw std::runtime_error("cannot open \"" + tag + "\" tracking file \"" +
-                             filename + "\"");
-  // for esoteric reasons, need to be careful about how this is computed.
-  // acquire the (guaranteed very small) file contents into a single string;
-  // do the same for the new values; compare those
-  std::ostringstream existing_data, new_data;
-  while (input.peek() != EOF) {
-    getline(input, line);
-    existing_data << line << std::endl;
-  }
-  input.close();
-  if (values.empty()) {
-    for (std::map<std::string, std::string>::const_iterator iter =
-             mapped_values.begin();
-         iter != mapped_values.end(); ++iter) {
-      new_data << (iter == mapped_values.begin() ? "" : ",") << iter->first
-               << '\t' << iter->second;
-    }
-  } else {
-    for (std::vector<std::string>::const_iterator iter = values.begin();
-         iter != values.end(); ++iter) {
-      new_data << (iter == values.begin() ? "" : ",") << *iter;
-    }
-  }
-  new_data << std::endl;
-  if (existing_data.str().compare(new_data.str())) {
-    if (values.empty()) {
-      update_tracker(filename, mapped_values, false);
-    } else {
-      update_tracker(filename, values, false);
-    }
+  // compare the (guaranteed very small) file contents, newline-terminated,
+  // against the resolved bytes
+  std::string existing_data = _cache->read(filename);
+  if (!existing_data.empty() && *existing_data.rbegin() != '\n')
+    existing_data += '\n';
+  if (existing_data.compare(tracker.get_comparison())) {
+    write_tracker(filename, tracker.get_contents(), false);
     return true;
   }
   return false;
 }
 
 bool initialize_output_directories::tracking_files::check_phenotype_database(
-    const yaml_reader &config, const model_matrix &input_model,
-    const std::string &phenotype_filename, bool pretend, bool force) const {
+    const database_comparison &equivalent,
+    const std::string &phenotype_filename, bool pretend, bool force,
+    std::string *status) const {
   // logic is as follows:
   // - if a pretend run (make -n), leave everything as is, return false
   // - if a force run (make -B), or
@@ -368,20 +461,20 @@ bool initialize_output_directories::tracking_files::check_phenotype_database(
   // tracker, create a version with this version, return true
   // --- if there is no meaningful difference between the versions, append this
   // filename to the tracker, return false
+  std::string ignored_status;
+  if (!status) status = &ignored_status;
+  *status = "unchecked";
   if (pretend) return false;
   std::string line = "";
   std::string filename = get_output_prefix() + get_phenotype_dataset_suffix();
   std::vector<std::string> update_contents;
   update_contents.push_back(phenotype_filename);
-  if (!boost::filesystem::is_regular_file(boost::filesystem::path(filename)) ||
-      force) {
+  if (!_cache->is_regular_file(filename) || force) {
+    *status = force ? "forced" : "new";
     update_tracker(filename, update_contents, false);
     return true;
   } else {
-    std::ifstream input(filename.c_str());
-    if (!input.is_open())
-      throw std::runtime_error("cannot read phenotype dataset tracker file \"" +
-                               filename + "\"");
+    std::istringstream input(_cache->read(filename));
     bool found_match = false;
     std::vector<std::string> previous_datasets;
     while (input.peek() != EOF) {
@@ -389,66 +482,48 @@ bool initialize_output_directories::tracking_files::check_phenotype_database(
       if (!line.compare(phenotype_filename)) found_match = true;
       previous_datasets.push_back(line);
     }
-    input.close();
-    if (found_match) return false;
-    // tracker file exists but does not contain the current phenotype file
-    model_matrix new_mm, old_mm;
-    if (input_model.empty()) {
-      new_mm.set_id(input_model.get_id());
-      new_mm.set_phenotype(config.get_entry("phenotype"));
-      if (config.query_valid("covariates")) {
-        new_mm.set_covariates(config.get_sequence("covariates"));
-      }
-      new_mm.load_data(phenotype_filename);
-    } else {
-      new_mm = input_model;
-    }
-    old_mm.set_id(new_mm.get_id());
-    old_mm.set_phenotype(config.get_entry("phenotype"));
-    if (config.query_valid("covariates")) {
-      old_mm.set_covariates(config.get_sequence("covariates"));
+    if (found_match) {
+      *status = "current";
+      return false;
     }
+    // tracker file exists but does not contain the current phenotype file
+    bool available = false, unchanged = false;
     for (std::vector<std::string>::const_iterator iter =
              previous_datasets.begin();
          iter != previous_datasets.end(); ++iter) {
       if (boost::filesystem::is_regular_file(boost::filesystem::path(*iter))) {
-        old_mm.load_data(*iter);
+        available = true;
+        unchanged = equivalent(*iter);
         break;
       }
     }
     // not necessarily any guarantee any old dataset is still present for
     // comparison
-    if (old_mm.empty() || old_mm != new_mm) {
+    if (!unchanged) {
       // overwrite the tracker with the new dataset, as change state is
       // undefined
+      *status = available ? "changed" : "previous_unavailable";
       update_tracker(filename, update_contents, false);
       return true;
     } else {  // no contextual change
       // append current dataset to tracker and return no change
+      *status = "equivalent";
       update_tracker(filename, update_contents, true);
       return false;
     }
   }
 }
 
-bool initialize_output_directories::tracking_files::check_files(
-    const yaml_reader &config, const model_matrix &input_model,
-    const std::string &phenotype_filename, bool pretend, bool force) const {
-  bool res = check_phenotype_database(config, input_model, phenotype_filename,
-                                      pretend, force);
-  extension_definition extension_pheno;
-  extension_pheno.set_name("phenotype");
-  extension_pheno.set_extension(get_phenotype_suffix());
-  res |= check_file(config, extension_pheno, pretend, force, true);
-  extension_definition extension_covar;
-  extension_covar.set_name("covariates");
-  extension_covar.set_extension(get_covariates_suffix());
-  extension_covar.set_default("NA");
-  res |= check_file(config, extension_covar, pretend, force, false);
-  for (std::map<std::string, extension_definition>::const_iterator iter =
-           _general_extensions.begin();
-       iter != _general_extensions.end(); ++iter) {
-    res |= check_file(config, iter->second, pretend, force, false);
+bool initialize_output_directories::tracking_files::check_config_files(
+    const resolved_tracker_set &trackers, bool pretend, bool force,
+    std::vector<std::string> *changed) const {
+  bool res = false;
+  for (std::vector<resolved_tracker>::const_iterator iter = trackers.begin();
+       iter != trackers.end(); ++iter) {
+    if (check_file(*iter, pretend, force)) {
+      if (changed) changed->push_back(iter->get_suffix());
+      res = true;
+    }
   }
   return res;
 }
@@ -456,51 +531,66 @@ bool initialize_output_directories::tracking_files::check_files(
 void initialize_output_directories::tracking_files::remove_finalization()
     const {
   std::string finalization_file = get_output_prefix() + get_finalized_suffix();
-  boost::filesystem::remove(boost::filesystem::path(finalization_file));
+  _cache->remove(finalization_file);
 }
 
 void initialize_output_directories::tracking_files::update_tracker(
     const std::string &filename, const std::vector<std::string> &vec,
     bool append) const {
-  std::ofstream output;
-  output.open(filename.c_str(),
-              append ? std::ios_base::app : std::ios_base::out);
-  if (!output.is_open())
-    throw std::runtime_error("cannot write tracking file \"" + filename + "\"");
+  std::string contents = "";
   unsigned counter = 0;
   for (std::vector<std::string>::const_iterator iter = vec.begin();
        iter != vec.end(); ++iter, ++counter) {
-    if (!(output << *iter))
-      throw std::runtime_error("cannot write entry to tracking file \"" +
-                               filename + "\"");
-    if (counter < vec.size() - 1) {
-      if (!(output << ','))
-        throw std::runtime_error(
-            "cannot write comma delimiter to tracking file \"" + filename +
-            "\"");
-    }
+    contents += *iter;
+    if (counter < vec.size() - 1) contents += ',';
   }
-  if (!(output << std::endl))
-    throw std::runtime_error("cannot write newline to tracking file \"" +
-                             filename + "\"");
-  output.close();
+  contents += '\n';
+  write_tracker(filename, contents, append);
 }
 
 void initialize_output_directories::tracking_files::update_tracker(
     const std::string &filename,
     const std::map<std::string, std::string> &values, bool append) const {
-  std::ofstream output;
-  output.open(filename.c_str(),
-              append ? std::ios_base::app : std::ios_base::out);
-  if (!output.is_open())
-    throw std::runtime_error("cannot write tracking file \"" + filename + "\"");
+  std::string contents = "";
   for (std::map<std::string, std::string>::const_iterator iter = values.begin();
        iter != values.end(); ++iter) {
-    if (!(output << iter->first << '\t' << iter->second << std::endl))
-      throw std::runtime_error("cannot write entry to tracking file \"" +
-                               filename + "\"");
+    contents += iter->first + '\t' + iter->second + '\n';
   }
-  output.close();
+  write_tracker(filename, contents, append);
+}
+
+void initialize_output_directories::tracking_files::write_tracker(
+    const std::string &filename, const std::string &contents,
+    bool append) const {
+  _cache->write(filename, contents, append);
+}
+
+std::vector<std::string>
+initialize_output_directories::tracking_files::tracker_paths(
+    unsigned n_comparisons) const {
+  std::vector<std::string> suffixes, res;
+  suffixes.push_back(get_phenotype_dataset_suffix());
+  suffixes.push_back(get_phenotype_suffix());
+  suffixes.push_back(get_covariates_suffix());
+  for (std::vector<extension_definition>::const_iterator iter =
+           get_schema().general_begin();
+       iter != get_schema().general_end(); ++iter) {
+    suffixes.push_back(iter->get_extension());
+  }
+  std::string file_prefix =
+      get_output_prefix().substr(get_output_prefix().rfind("/") + 1);
+  std::string dir_prefix =
+      get_output_prefix().substr(0, get_output_prefix().rfind("/"));
+  for (unsigned i = 0; i <= n_comparisons; ++i) {
+    std::string prefix = i ? dir_prefix + "/comparison" + std::to_string(i) +
+                                 "/" + file_prefix
+                           : get_output_prefix();
+    for (std::vector<std::string>::const_iterator iter = suffixes.begin();
+         iter != suffixes.end(); ++iter) {
+      res.push_back(prefix + *iter);
+    }
+  }
+  return res;
 }
 
 void initialize_output_directories::tracking_files::copy_trackers(
@@ -512,52 +602,83 @@ void initialize_output_directories::tracking_files::copy_trackers(
       get_output_prefix().substr(0, get_output_prefix().rfind("/")) +
       "/comparison" + std::to_string(comparison_number);
   std::string target_prefix = target_dir + "/" + file_prefix;
-  boost::filesystem::create_directories(boost::filesystem::path(target_dir));
+  if (_planner) {
+    _planner->ensure(target_dir);
+  } else {
+    boost::filesystem::create_directories(boost::filesystem::path(target_dir));
+  }
   // acquire suffixes of copyable files
   std::vector<std::string> suffixes;
   suffixes.push_back(get_phenotype_dataset_suffix());
   suffixes.push_back(get_phenotype_suffix());
   suffixes.push_back(get_covariates_suffix());
-  for (std::map<std::string, extension_definition>::const_iterator iter =
-           _general_extensions.begin();
-       iter != _general_extensions.end(); ++iter) {
-    suffixes.push_back(iter->second.get_extension());
+  for (std::vector<extension_definition>::const_iterator iter =
+           get_schema().general_begin();
+       iter != get_schema().general_end(); ++iter) {
+    suffixes.push_back(iter->get_extension());
   }
   // for each suffix, test to see if the source file exists; if so, copy to
   // target
   for (std::vector<std::string>::const_iterator iter = suffixes.begin();
        iter != suffixes.end(); ++iter) {
-    if (boost::filesystem::is_regular_file(
-            boost::filesystem::path(get_output_prefix() + *iter))) {
+    std::string source = get_output_prefix() + *iter;
+    std::string target = target_prefix + *iter;
+    if (_cache->is_regular_file(source)) {
+      const std::string &source_data = _cache->read(source);
       // test whether the target already exists
-      if (boost::filesystem::is_regular_file(
-              boost::filesystem::path(target_prefix + *iter))) {
-        // if the contents of source and target are identical, do nothing
-        std::ifstream in1, in2;
-        std::string line1 = "", line2 = "";
-        in1.open((get_output_prefix() + *iter).c_str());
-        in2.open((target_prefix + *iter).c_str());
-        while (in1.peek() != EOF && in2.peek() != EOF &&
-               !line1.compare(line2)) {
-          getline(in1, line1);
-          getline(in2, line2);
-        }
-        if (!line1.compare(line2) && in1.peek() == EOF && in2.peek() == EOF) {
-          // files are the same
-          continue;
-        }
-        // delete the target file so boost::filesystem::copy works without issue
-        boost::filesystem::remove(
-            boost::filesystem::path(target_prefix + *iter));
+      if (_cache->is_regular_file(target)) {
+        // if the contents of source and target are identical, up to
+        // a trailing newline, do nothing
+        std::string a = source_data, b = _cache->read(target);
+        if (!a.empty() && *a.rbegin() != '\n') a += '\n';
+        if (!b.empty() && *b.rbegin() != '\n') b += '\n';
+        if (!a.compare(b)) continue;
       }
-      boost::filesystem::copy(
-          boost::filesystem::path(get_output_prefix() + *iter),
-          boost::filesystem::path(target_prefix + *iter));
+      write_tracker(target, source_data, false);
     }
   }
   report_categories(target_prefix, reference, comparison);
 }
 
+bool initialize_output_directories::tracking_files::write_model_matrix(
+    const model_matrix &mm, const std::string &sample_filename,
+    const std::string &filename, model_matrix::output_format format,
+    thread_pool *pool, bool updated,
+    const std::shared_ptr<content_store> &store) const {
+  return write_model_matrix(
+      [&mm, &sample_filename, format, pool](const std::string &tmp) {
+        mm.restrict_to(read_sample_ids(sample_filename))
+            .write(tmp, pool, format);
+      },
+      filename, updated, store);
+}
+
+bool initialize_output_directories::tracking_files::write_model_matrix(
+    const matrix_writer &write, const std::string &filename, bool updated,
+    const std::shared_ptr<content_store> &store) const {
+  // the file is shared by targets on the same chip and ancestry, and its
+  // contents only change when the trackers do
+  if (!updated && boost::filesystem::is_regular_file(filename)) return false;
+  if (store) {
+    std::string tmp = store->temporary_path();
+    write(tmp);
+    store->link(store->adopt(tmp), filename);
+  } else {
+    // replace atomically: concurrent runs may share this file, and it
+    // may be a link into a store left by an earlier run
+    std::string tmp = temporary_sibling(filename);
+    try {
+      write(tmp);
+      boost::filesystem::rename(tmp, filename);
+    } catch (...) {
+      boost::system::error_code ec;
+      boost::filesystem::remove(tmp, ec);
+      throw;
+    }
+  }
+  return true;
+}
+
 void initialize_output_directories::tracking_files::report_categories(
     const std::string &target_prefix, const std::set<unsigned> &reference,
     const std::set<unsigned> &comparison) const {
@@ -590,3 +711,14 @@ void initialize_output_directories::tracking_files::report_categories(
   update_tracker(target_prefix + get_categories_suffix(), category_tracker_data,
                  false);
 }
+
+bool initialize_output_directories::tracking_files::update_covariate_statistics(
+    const std::string &contents) const {
+  std::string filename =
+      get_output_prefix() + get_schema().get_covariate_statistics_suffix();
+  if (_cache->is_regular_file(filename) &&
+      !_cache->read(filename).compare(contents))
+    return false;
+  write_tracker(filename, contents, false);
+  return true;
+}
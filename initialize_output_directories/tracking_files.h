@@ -10,27 +10,44 @@
 #include <algorithm>
 #include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "boost/filesystem.hpp"
-#include "boost/iostreams/device/mapped_file.hpp"
+#include "initialize_output_directories/arena.h"
+#include "initialize_output_directories/database_reader.h"
+#include "initialize_output_directories/directory_planner.h"
+#include "initialize_output_directories/extension_schema.h"
+#include "initialize_output_directories/input_source.h"
+#include "initialize_output_directories/resolved_trackers.h"
+#include "initialize_output_directories/thread_pool.h"
+#include "initialize_output_directories/tracker_io.h"
+#include "initialize_output_directories/utilities.h"
+#include "initialize_output_directories/value_comparison.h"
 #include "initialize_output_directories/yaml_reader.h"
 #include "yaml-cpp/yaml.h"
 
 namespace initialize_output_directories {
 class categorical_variable {
  public:
-  categorical_variable() {}
+  categorical_variable() : _total_subjects(0) {}
   categorical_variable(const categorical_variable &obj)
       : _reference_group(obj._reference_group),
-        _comparison_groups(obj._comparison_groups) {}
+        _comparison_groups(obj._comparison_groups),
+        _level_subjects(obj._level_subjects),
+        _total_subjects(obj._total_subjects) {}
   ~categorical_variable() throw() {}
 
   void set_reference_level(unsigned u) {
@@ -68,21 +85,47 @@ class categorical_variable {
   unsigned n_comparison_groups() const { return _comparison_groups.size(); }
   unsigned size() const { return n_comparison_groups() + 1; }
 
+  /*!
+    \brief fraction of the subjects counted that a comparison analyzes
+    @param index comparison group
+    \return subjects at its levels and the reference levels, over all
+    subjects counted; 1 if nothing was counted
+   */
+  double comparison_share(unsigned index) const;
+
+  /*!
+    \brief groups for a phenotype, from the subject count of each level
+    @param counts subjects with each value of the phenotype column
+   */
+  static categorical_variable from_level_counts(
+      const std::map<std::string_view, unsigned> &counts);
+
  private:
   std::set<unsigned> _reference_group;
   std::vector<std::set<unsigned> > _comparison_groups;
+  //! subjects at each level, as counted by from_level_counts
+  std::map<unsigned, unsigned> _level_subjects;
+  //! every subject counted, whatever its value
+  unsigned _total_subjects;
 };
 
+/*!
+  \class model_matrix
+  \brief phenotype and covariate columns extracted from a database
+
+  Loaded contents are immutable and held by shared pointer, so copies
+  of a model_matrix share a single set of column storage rather than
+  duplicating it. Cell and ID bytes live in one arena per load. The
+  database may be in any format database_reader::open recognizes.
+ */
 class model_matrix {
  public:
-  model_matrix() : _id(""), _phenotype("") {}
+  model_matrix() : _id(""), _phenotype(""), _storage(new storage) {}
   model_matrix(const model_matrix &obj)
       : _id(obj._id),
         _phenotype(obj._phenotype),
         _covariates(obj._covariates),
-        _ids(obj._ids),
-        _headers(obj._headers),
-        _data(obj._data) {}
+        _storage(obj._storage) {}
   ~model_matrix() throw() {}
 
   void set_id(const std::string &id) { _id = id; }
@@ -104,150 +147,311 @@ class model_matrix {
 
   const std::vector<std::string> &get_covariates() const { return _covariates; }
 
+  /*!
+    \brief a matrix holding whatever a function stores in a table
+    @param id column header for subject IDs
+    @param fill stores IDs, headers and columns in the empty table given
+    \return matrix with the filled table as its storage
+   */
+  static model_matrix build(
+      const std::string &id,
+      const std::function<void(database_table *)> &fill);
+
   void load_data(const std::string &filename);
+  void load_data(const std::string &filename, thread_pool *pool);
+  /*!
+    \brief load every column of a database, not just the configured ones
+    @param filename name of database to load
+    @param pool worker pool for parallel decompression; may be null
+   */
+  void load_all_data(const std::string &filename, thread_pool *pool);
+
+  /*!
+    \brief names of the loaded columns, in database order
+   */
+  const std::vector<std::string> &get_headers() const {
+    return _storage->headers;
+  }
 
-  const std::vector<std::string> get_ids() const { return _ids; }
+  const std::vector<std::string_view> &get_ids() const {
+    return _storage->ids;
+  }
 
-  const std::vector<std::vector<std::string> > &get_data() const {
-    return _data;
+  const std::vector<std::vector<std::string_view> > &get_data() const {
+    return _storage->data;
   }
 
+  /*!
+    \brief bytes held by the cell storage arena of the current load
+   */
+  std::size_t arena_bytes() const { return _storage->arena.bytes_reserved(); }
+
   categorical_variable categorize(const std::string &name) const;
 
+  /*!
+    \brief subset the matrix to a list of subjects
+    @param ids subject IDs, in the desired output order
+    \return matrix with one row per ID found in this matrix
+
+    IDs absent from this matrix are skipped. The result shares cell
+    storage with this matrix rather than copying it.
+   */
+  model_matrix restrict_to(const std::vector<std::string> &ids) const;
+
+  /*!
+    \brief select the columns for a phenotype and covariates
+    @param phenotype phenotype column name
+    @param covariates covariate column names
+    \return matrix with exactly the columns load_data would have
+    extracted for these names, in database order
+
+    The result shares cell storage with this matrix rather than
+    copying it, so one load of the union of several configs' columns
+    can serve each of them.
+   */
+  model_matrix project(const std::string &phenotype,
+                       const std::vector<std::string> &covariates) const;
+
   bool operator==(const model_matrix &obj) const {
-    if (get_ids().size() != obj.get_ids().size()) return false;
-    if (get_data().size() != obj.get_data().size()) return false;
-    for (unsigned i = 0; i < get_data().size(); ++i) {
-      if (get_data().at(i).size() != obj.get_data().size()) return false;
-      for (unsigned j = 0; j < get_data().at(i).size(); ++j) {
-        if (get_data().at(i).at(j).compare(obj.get_data().at(i).at(j)))
-          return false;
-      }
-    }
-    return true;
+    if (_storage == obj._storage) return true;
+    if (get_ids() != obj.get_ids()) return false;
+    return get_data() == obj.get_data();
   }
 
   bool operator!=(const model_matrix &obj) const { return !(*this == obj); }
 
+  /*!
+    \brief whether two matrices have the same subjects, in the same
+    order, and the same values in each column
+    @param obj matrix to compare against
+    @param compare how cells are compared; exact is the same as ==
+    @param categorical name of the categorized column; may be empty
+   */
+  bool equivalent(const model_matrix &obj, const value_comparison &compare,
+                  const std::string &categorical) const;
+
   bool empty() const {
-    return _headers.empty() && _ids.empty() && _data.empty();
+    return _storage->headers.empty() && _storage->ids.empty() &&
+           _storage->data.empty();
   }
 
+  /*!
+    \brief on-disk layouts for write()
+
+    tsv: the subject ID column followed by the extracted columns,
+    tab-delimited with a header row.
+    tsv_gzip: the same bytes, gzip compressed as a series of members.
+    binary: the magic bytes "IODMM1\n\0", the row and column counts,
+    then the ID header, column headers, and each row's ID and cells in
+    row-major order, all as strings. Integers are 32-bit little endian
+    and each string is its byte length followed by its bytes.
+   */
+  enum output_format { tsv, tsv_gzip, binary };
+
   void write(const std::string &filename) const;
+  /*!
+    \brief write the matrix, formatting blocks of rows in parallel
+    @param filename name of file to write
+    @param pool worker pool for formatting and compression; may be null
+    @param format on-disk layout
+   */
+  void write(const std::string &filename, thread_pool *pool,
+             output_format format) const;
+  /*!
+    \brief the bytes write() puts before the first row
+    @param format on-disk layout
+    @param n_rows rows in the whole file, which may be written in parts
+   */
+  std::string format_header(output_format format, unsigned n_rows) const;
+  /*!
+    \brief append the matrix's rows to an open file, as write() does
+    @param fd file descriptor open for writing
+    @param filename name of the file, for messages
+    @param pool worker pool for formatting and compression; may be null
+    @param format on-disk layout
+    @param prefix bytes to write first, such as format_header()
+
+    A file can be written in parts by appending several matrices with
+    the same columns, the first of them with the header as prefix.
+   */
+  void write_rows(int fd, const std::string &filename, thread_pool *pool,
+                  output_format format, const std::string &prefix) const;
 
  private:
+  /*!
+    \brief the loaded contents; the views point into arena
+   */
+  void load(const std::string &filename, thread_pool *pool, bool all_columns);
+  struct storage : public database_table {
+    //! for subsets, the storage whose arena the views point into
+    std::shared_ptr<const storage> parent;
+    //! first row of each ID, built on first use by restrict_to
+    mutable std::once_flag row_index_built;
+    mutable std::unordered_map<std::string_view, unsigned> row_index;
+  };
   std::string _id;
   std::string _phenotype;
   std::vector<std::string> _covariates;
-  std::vector<std::string> _ids;
-  std::vector<std::string> _headers;
-  std::vector<std::vector<std::string> > _data;
+  std::shared_ptr<const storage> _storage;
 };
 
-class extension_definition {
- public:
-  extension_definition() : _name(""), _extension(""), _default("") {}
-  extension_definition(const extension_definition &obj)
-      : _name(obj._name),
-        _extension(obj._extension),
-        _default(obj._default),
-        _permitted_values(obj._permitted_values) {}
-  ~extension_definition() throw() {}
-
-  void set_name(const std::string &s) { _name = s; }
-  const std::string &get_name() const { return _name; }
-  void set_extension(const std::string &s) { _extension = s; }
-  const std::string &get_extension() const { return _extension; }
-  void set_default(const std::string &s) { _default = s; }
-  const std::string &get_default() const { return _default; }
-  void add_permitted_value(const std::string &s) {
-    _permitted_values[s] = true;
-  }
-  bool is_permitted_value(const std::string &s) const {
-    return _permitted_values.find(s) != _permitted_values.end() ||
-           _permitted_values.empty();
-  }
-
- private:
-  std::string _name;
-  std::string _extension;
-  std::string _default;
-  std::map<std::string, bool> _permitted_values;
+/*!
+  \brief what the tracker checks of tracking_files found for one target
+ */
+struct check_report {
+  check_report() : database("unchecked") {}
+  /*!
+    \brief phenotype database state: "unchecked" (pretend), "new" (no
+    tracker yet), "forced", "current" (already tracked), "equivalent"
+    (new database, no meaningful difference), "changed", or
+    "previous_unavailable" (no earlier database left to compare against)
+   */
+  std::string database;
+  //! suffixes of trackers whose changes invalidate the target
+  std::vector<std::string> changed_trackers;
 };
 
 class tracking_files {
  public:
-  tracking_files()
-      : _output_prefix(""),
-        _phenotype_dataset_suffix(""),
-        _phenotype_suffix(""),
-        _covariates_suffix(""),
-        _categories_suffix(""),
-        _finalized_suffix("") {}
-  tracking_files(const std::string &s, const yaml_reader &config)
-      : _output_prefix(s),
-        _phenotype_dataset_suffix(""),
-        _phenotype_suffix(""),
-        _covariates_suffix(""),
-        _categories_suffix(""),
-        _finalized_suffix("") {
-    initialize(config);
+  tracking_files() : _output_prefix("") {}
+  tracking_files(const std::string &s,
+                 const std::shared_ptr<const extension_schema> &schema)
+      : _output_prefix(s), _schema(schema) {
+    initialize();
+  }
+  tracking_files(const std::string &s,
+                 const std::shared_ptr<const extension_schema> &schema,
+                 const std::shared_ptr<tracker_cache> &cache)
+      : _output_prefix(s), _schema(schema), _cache(cache) {
+    initialize();
+  }
+  /*!
+    \brief constructor deferring directory creation to a shared planner
+    @param s output prefix of the target
+    @param schema compiled extension configuration
+    @param cache shared tracking file cache
+    @param planner directory planner; call its create() before checks
+   */
+  tracking_files(const std::string &s,
+                 const std::shared_ptr<const extension_schema> &schema,
+                 const std::shared_ptr<tracker_cache> &cache,
+                 const std::shared_ptr<directory_planner> &planner)
+      : _output_prefix(s), _schema(schema), _cache(cache), _planner(planner) {
+    initialize();
   }
   tracking_files(const tracking_files &obj)
       : _output_prefix(obj._output_prefix),
-        _phenotype_dataset_suffix(obj._phenotype_dataset_suffix),
-        _phenotype_suffix(obj._phenotype_suffix),
-        _covariates_suffix(obj._covariates_suffix),
-        _categories_suffix(obj._categories_suffix),
-        _finalized_suffix(obj._finalized_suffix),
-        _general_extensions(obj._general_extensions) {}
+        _schema(obj._schema),
+        _cache(obj._cache),
+        _planner(obj._planner) {}
   ~tracking_files() throw() {}
 
-  void initialize(const yaml_reader &config);
-  bool check_phenotype_database(const yaml_reader &config,
-                                const model_matrix &input_model,
+  /*!
+    \brief whether an earlier database, by filename, has the same
+    contents as the current one in this config's columns
+   */
+  typedef std::function<bool(const std::string &)> database_comparison;
+  /*!
+    \brief writes a target's model matrix to the file named
+   */
+  typedef std::function<void(const std::string &)> matrix_writer;
+
+  void initialize();
+  /*!
+    \brief check the phenotype database tracker with a comparison of
+    databases that need not load either of them
+    @param equivalent compares the earliest tracked database still
+    present against the current one; only called if there is one
+    @param status where to store the database state named in check_report;
+    may be null
+    \return whether the change invalidates the target
+   */
+  bool check_phenotype_database(const database_comparison &equivalent,
                                 const std::string &phenotype_filename,
-                                bool pretend, bool force) const;
-  bool check_files(const yaml_reader &config, const model_matrix &input_model,
-                   const std::string &phenotype_filename, bool pretend,
-                   bool force) const;
-  bool check_file(const yaml_reader &config, const extension_definition &edef,
-                  bool pretend, bool force, bool must_exist) const;
+                                bool pretend, bool force,
+                                std::string *status) const;
+  /*!
+    \brief check the trackers derived from the config alone
+    @param changed where to append suffixes of changed trackers; may be null
+    \return whether any change invalidates the target
+
+    None of these depend on phenotype data, so they can be checked while
+    the database is still loading.
+   */
+  bool check_config_files(const resolved_tracker_set &trackers, bool pretend,
+                          bool force, std::vector<std::string> *changed) const;
+  bool check_file(const resolved_tracker &tracker, bool pretend,
+                  bool force) const;
   void remove_finalization() const;
   void copy_trackers(unsigned comparison_number,
                      const std::set<unsigned> &reference,
                      const std::set<unsigned> &comparison) const;
+  bool write_model_matrix(const model_matrix &mm,
+                          const std::string &sample_filename,
+                          const std::string &filename,
+                          model_matrix::output_format format,
+                          thread_pool *pool, bool updated,
+                          const std::shared_ptr<content_store> &store) const;
+  /*!
+    \brief write a model matrix with a writer of its own
+    @param write writes the matrix to the (temporary) file it is given
+    @param filename model matrix file
+    @param updated whether the target's trackers changed
+    @param store content store to link the file from; may be null
+    \return whether the file was written
+   */
+  bool write_model_matrix(const matrix_writer &write,
+                          const std::string &filename, bool updated,
+                          const std::shared_ptr<content_store> &store) const;
   void report_categories(const std::string &target_prefix,
                          const std::set<unsigned> &reference,
                          const std::set<unsigned> &comparison) const;
+  /*!
+    \brief bring the target's column statistics tracker up to date
+    @param contents formatted statistics, as column_statistics::format
+    \return whether the tracker was written
+
+    The statistics follow from the phenotype database, which is tracked
+    already, so a change here never invalidates the target itself.
+   */
+  bool update_covariate_statistics(const std::string &contents) const;
   const std::string &get_output_prefix() const { return _output_prefix; }
+  std::vector<std::string> tracker_paths(unsigned n_comparisons) const;
+  const extension_schema &get_schema() const {
+    if (!_schema)
+      throw std::runtime_error("tracking_files: extension schema not set");
+    return *_schema;
+  }
 
  protected:
   const std::string &get_phenotype_dataset_suffix() const {
-    return _phenotype_dataset_suffix;
+    return get_schema().get_phenotype_dataset_suffix();
+  }
+  const std::string &get_phenotype_suffix() const {
+    return get_schema().get_phenotype_suffix();
   }
-  const std::string &get_phenotype_suffix() const { return _phenotype_suffix; }
   const std::string &get_covariates_suffix() const {
-    return _covariates_suffix;
+    return get_schema().get_covariates_suffix();
   }
   const std::string &get_categories_suffix() const {
-    return _categories_suffix;
+    return get_schema().get_categories_suffix();
+  }
+  const std::string &get_finalized_suffix() const {
+    return get_schema().get_finalized_suffix();
   }
-  const std::string &get_finalized_suffix() const { return _finalized_suffix; }
   void update_tracker(const std::string &filename,
                       const std::vector<std::string> &vec, bool append) const;
   void update_tracker(const std::string &filename,
                       const std::map<std::string, std::string> &values,
                       bool append) const;
+  void write_tracker(const std::string &filename, const std::string &contents,
+                     bool append) const;
 
  private:
   std::string _output_prefix;
-  std::string _phenotype_dataset_suffix;
-  std::string _phenotype_suffix;
-  std::string _covariates_suffix;
-  std::string _categories_suffix;
-  std::string _finalized_suffix;
-  std::map<std::string, extension_definition> _general_extensions;
+  std::shared_ptr<const extension_schema> _schema;
+  std::shared_ptr<tracker_cache> _cache;
+  std::shared_ptr<directory_planner> _planner;
 };
 }  // namespace initialize_output_directories
 
@@ -7,6 +7,12 @@
 
 #include "initialize_output_directories/utilities.h"
 
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+
 std::string initialize_output_directories::strreplace(const std::string &input,
                                                       char query,
                                                       char replacement) {
@@ -61,3 +67,58 @@ unsigned initialize_output_directories::wc(const std::string &filename) {
   input.close();
   return res;
 }
+
+std::vector<std::string> initialize_output_directories::read_sample_ids(
+    const std::string &filename) {
+  std::ifstream input;
+  std::string line = "", id_1 = "", id_2 = "";
+  std::vector<std::string> res;
+  input.open(filename.c_str());
+  if (!input.is_open())
+    throw std::runtime_error("cannot open sample file \"" + filename + "\"");
+  unsigned linecount = 0;
+  while (getline(input, line)) {
+    if (++linecount <= 2) continue;
+    std::istringstream strm1(line);
+    if (!(strm1 >> id_1 >> id_2))
+      throw std::runtime_error("cannot parse line " +
+                               std::to_string(linecount) +
+                               " of sample file \"" + filename + "\"");
+    res.push_back(id_2);
+  }
+  input.close();
+  return res;
+}
+
+std::string initialize_output_directories::read_file(
+    const std::string &filename) {
+  std::ifstream input(filename.c_str(), std::ios_base::binary);
+  if (!input.is_open())
+    throw std::runtime_error("cannot open file \"" + filename + "\"");
+  return std::string(std::istreambuf_iterator<char>(input),
+                     std::istreambuf_iterator<char>());
+}
+
+std::string initialize_output_directories::file_signature(
+    const std::string &filename) {
+  struct stat st;
+  if (stat(filename.c_str(), &st))
+    throw std::runtime_error("cannot stat file \"" + filename + "\"");
+  return filename + ":" + std::to_string(st.st_size) + ":" +
+         std::to_string(st.st_mtim.tv_sec) + "." +
+         std::to_string(st.st_mtim.tv_nsec);
+}
+
+std::string initialize_output_directories::temporary_sibling(
+    const std::string &filename) {
+  static std::atomic<unsigned> counter(0);
+  return filename + ".tmp." + std::to_string(getpid()) + "." +
+         std::to_string(counter.fetch_add(1));
+}
+
+long initialize_output_directories::peak_resident_kb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage)) return 0;
+  // linux reports ru_maxrss in kilobytes
+  return usage.ru_maxrss;
+}
@@ -12,6 +12,8 @@
 #include <cctype>
 #include <fstream>
 #include <iterator>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -29,6 +31,38 @@ bool find_entry(const std::string &query,
 
 unsigned wc(const std::string &filename);
 
+/*!
+  \brief subject IDs from an Oxford format .sample file
+  @param filename name of sample file
+  \return the ID_2 column, skipping the two header lines
+ */
+std::vector<std::string> read_sample_ids(const std::string &filename);
+
+/*!
+  \brief entire contents of a file
+ */
+std::string read_file(const std::string &filename);
+
+/*!
+  \brief cheap identity of a file: its name, size, and modification time
+ */
+std::string file_signature(const std::string &filename);
+
+/*!
+  \brief unique name next to a file, for writing it and renaming over it
+  @param filename file that will be replaced
+  \return a name in the same directory, unique across processes and threads
+
+  rename() within a directory is atomic, so readers (and other runs)
+  see either the old file or the new one, never a partial write.
+ */
+std::string temporary_sibling(const std::string &filename);
+
+/*!
+  \brief peak resident set size of this process so far, in kilobytes
+ */
+long peak_resident_kb();
+
 }  // namespace initialize_output_directories
 
 #endif  // INITIALIZE_OUTPUT_DIRECTORIES_UTILITIES_H_
@@ -0,0 +1,83 @@
+/*!
+  \file value_comparison.cc
+  \brief implementation of phenotype cell comparison
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#include "initialize_output_directories/value_comparison.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+
+initialize_output_directories::value_comparison::value_comparison(
+    const std::string &mode, double tolerance)
+    : _typed(false), _tolerance(tolerance) {
+  if (!mode.compare("typed")) {
+    _typed = true;
+  } else if (mode.compare("exact")) {
+    throw std::runtime_error("unrecognized value comparison: \"" + mode +
+                             "\"");
+  }
+  if (!(_tolerance >= 0.0))
+    throw std::runtime_error("comparison tolerance must be non-negative");
+}
+
+bool initialize_output_directories::value_comparison::missing(
+    std::string_view cell) {
+  if (cell.empty() || cell == "NA") return true;
+  if (cell[0] == '-' || cell[0] == '+') cell.remove_prefix(1);
+  return cell.size() == 3 && (cell[0] == 'n' || cell[0] == 'N') &&
+         (cell[1] == 'a' || cell[1] == 'A') &&
+         (cell[2] == 'n' || cell[2] == 'N');
+}
+
+bool initialize_output_directories::value_comparison::level(
+    std::string_view cell) {
+  return !cell.empty() &&
+         cell.find_first_not_of("0123456789") == std::string_view::npos;
+}
+
+bool initialize_output_directories::value_comparison::number(
+    std::string_view cell, double *value) {
+  // from_chars takes no leading plus sign
+  if (!cell.empty() && cell[0] == '+') cell.remove_prefix(1);
+  const char *end = cell.data() + cell.size();
+  std::from_chars_result res = std::from_chars(cell.data(), end, *value);
+  return res.ec == std::errc() && res.ptr == end;
+}
+
+bool initialize_output_directories::value_comparison::same_column(
+    const std::vector<std::string_view> &a,
+    const std::vector<std::string_view> &b, bool categorical) const {
+  if (a.size() != b.size()) return false;
+  if (!_typed) return a == b;
+  for (std::vector<std::string_view>::const_iterator iter_a = a.begin(),
+                                                     iter_b = b.begin();
+       iter_a != a.end(); ++iter_a, ++iter_b) {
+    if (!same(*iter_a, *iter_b, categorical)) return false;
+  }
+  return true;
+}
+
+bool initialize_output_directories::value_comparison::same_value(
+    std::string_view a, std::string_view b, bool categorical) const {
+  bool missing_a = missing(a), missing_b = missing(b);
+  if (missing_a || missing_b) return missing_a && missing_b;
+  if (categorical) {
+    bool level_a = level(a), level_b = level(b);
+    if (level_a || level_b) {
+      if (!level_a || !level_b) return false;
+      // the same integer, whatever its leading zeros
+      a.remove_prefix(std::min(a.find_first_not_of('0'), a.size()));
+      b.remove_prefix(std::min(b.find_first_not_of('0'), b.size()));
+      return a == b;
+    }
+  }
+  double value_a = 0.0, value_b = 0.0;
+  if (!number(a, &value_a) || !number(b, &value_b)) return false;
+  if (value_a == value_b) return true;
+  return std::fabs(value_a - value_b) <=
+         _tolerance * std::max(std::fabs(value_a), std::fabs(value_b));
+}
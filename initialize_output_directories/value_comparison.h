@@ -0,0 +1,93 @@
+/*!
+  \file value_comparison.h
+  \brief comparison of phenotype cells by value rather than by bytes
+  \copyright Released under the MIT License.
+  Copyright 2020 Cameron Palmer.
+ */
+
+#ifndef INITIALIZE_OUTPUT_DIRECTORIES_VALUE_COMPARISON_H_
+#define INITIALIZE_OUTPUT_DIRECTORIES_VALUE_COMPARISON_H_
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace initialize_output_directories {
+/*!
+  \class value_comparison
+  \brief decides whether two versions of a phenotype cell are the same
+
+  Exact comparison, the default, requires identical bytes. Typed
+  comparison instead treats cells as values, so that a release that
+  only reformats its numbers does not invalidate any target:
+   - empty cells, "NA" and "nan" (in any case, with any sign) are all
+     the same missing value;
+   - in a categorical column, cells of digits are levels, equal if
+     they are the same integer; a level never equals anything else,
+     as model_matrix::categorize would drop it;
+   - otherwise, cells that are both numbers are equal if they differ
+     by at most the tolerance, relative to the larger magnitude.
+  Anything else must match exactly. Identical bytes are always equal
+  and are never parsed, so an unchanged release costs no more to check
+  than with exact comparison.
+ */
+class value_comparison {
+ public:
+  /*!
+    \brief exact comparison
+   */
+  value_comparison() : _typed(false), _tolerance(0.0) {}
+  /*!
+    \brief constructor
+    @param mode "exact" or "typed"
+    @param tolerance for typed comparison, the largest relative
+    difference between numbers that are still equal; non-negative
+   */
+  value_comparison(const std::string &mode, double tolerance);
+  value_comparison(const value_comparison &obj)
+      : _typed(obj._typed), _tolerance(obj._tolerance) {}
+  ~value_comparison() throw() {}
+
+  bool typed() const { return _typed; }
+  double get_tolerance() const { return _tolerance; }
+
+  /*!
+    \brief whether two cells hold the same value
+    @param categorical whether the column is categorized
+   */
+  bool same(std::string_view a, std::string_view b, bool categorical) const {
+    return a == b || (_typed && same_value(a, b, categorical));
+  }
+
+  /*!
+    \brief whether two columns hold the same values, row by row
+    @param categorical whether the column is categorized
+   */
+  bool same_column(const std::vector<std::string_view> &a,
+                   const std::vector<std::string_view> &b,
+                   bool categorical) const;
+
+  /*!
+    \brief whether a cell is missing: empty, "NA" or "nan"
+   */
+  static bool missing(std::string_view cell);
+  /*!
+    \brief whether a cell is a categorical level: all digits
+   */
+  static bool level(std::string_view cell);
+  /*!
+    \brief parse a whole cell as a number
+    \return false if any of the cell is not part of the number
+   */
+  static bool number(std::string_view cell, double *value);
+
+ private:
+  bool same_value(std::string_view a, std::string_view b,
+                  bool categorical) const;
+  bool _typed;
+  double _tolerance;
+};
+}  // namespace initialize_output_directories
+
+#endif  // INITIALIZE_OUTPUT_DIRECTORIES_VALUE_COMPARISON_H_
@@ -10,107 +10,169 @@
 void initialize_output_directories::yaml_reader::load_file(
     const std::string &filename) {
   _data = YAML::LoadFile(filename.c_str());
+  _nodes.clear();
+  index_node(_data);
 }
-std::vector<std::string>
-initialize_output_directories::yaml_reader::get_sequence(
-    const std::vector<std::string> &queries) const {
-  YAML::Node current = YAML::Clone(_data), next;
-  std::vector<std::string> res;
-  apply_queries(queries, &current, &next);
-  if (current.Type() == YAML::NodeType::Scalar) {
-    res.resize(1);
-    res.at(0) = current.as<std::string>();
-  } else if (current.Type() == YAML::NodeType::Sequence) {
-    res.reserve(current.size());
-    for (YAML::const_iterator iter = current.begin(); iter != current.end();
-         ++iter) {
-      res.push_back(iter->as<std::string>());
+
+unsigned initialize_output_directories::yaml_reader::index_node(
+    const YAML::Node &node) {
+  // reserve this node's slot before descending, so the root is always 0.
+  // _nodes may reallocate during recursion, so only hold indices here
+  unsigned index = _nodes.size();
+  _nodes.push_back(indexed_node());
+  _nodes.at(index).type = node.Type();
+  if (node.Type() == YAML::NodeType::Scalar) {
+    _nodes.at(index).values.push_back(node.Scalar());
+    _nodes.at(index).values_valid = true;
+  } else if (node.Type() == YAML::NodeType::Sequence) {
+    bool all_scalar = true;
+    std::vector<std::string> values;
+    values.reserve(node.size());
+    for (YAML::const_iterator iter = node.begin(); iter != node.end(); ++iter) {
+      if (iter->Type() == YAML::NodeType::Scalar) {
+        values.push_back(iter->Scalar());
+      } else {
+        all_scalar = false;
+      }
     }
-  } else {
-    throw std::runtime_error(
-        "get_value: query chain does not end in "
-        "compatible type");
+    _nodes.at(index).values.swap(values);
+    _nodes.at(index).values_valid = all_scalar;
+  } else if (node.Type() == YAML::NodeType::Map) {
+    bool all_scalar = true;
+    std::vector<std::pair<std::string, std::string> > pairs;
+    pairs.reserve(node.size());
+    for (YAML::const_iterator iter = node.begin(); iter != node.end(); ++iter) {
+      // complex keys are not addressable by string queries
+      if (iter->first.Type() != YAML::NodeType::Scalar) {
+        all_scalar = false;
+        continue;
+      }
+      if (iter->second.Type() == YAML::NodeType::Scalar) {
+        pairs.push_back(
+            std::make_pair(iter->first.Scalar(), iter->second.Scalar()));
+      } else {
+        all_scalar = false;
+      }
+      // null entries are treated as absent, matching yaml-cpp lookup
+      if (iter->second.Type() == YAML::NodeType::Null ||
+          _nodes.at(index).children.find(iter->first.Scalar()) !=
+              _nodes.at(index).children.end())
+        continue;
+      unsigned child = index_node(iter->second);
+      _nodes.at(index).children[iter->first.Scalar()] = child;
+    }
+    _nodes.at(index).pairs.swap(pairs);
+    _nodes.at(index).pairs_valid = all_scalar;
   }
-  return res;
+  return index;
 }
 
-YAML::Node initialize_output_directories::yaml_reader::get_node(
-    const std::vector<std::string> &queries) const {
-  YAML::Node current = YAML::Clone(_data), next;
-  apply_queries(queries, &current, &next);
+const initialize_output_directories::yaml_reader::indexed_node *
+initialize_output_directories::yaml_reader::lookup(
+    const std::vector<std::string> &queries, std::string *error) const {
+  if (queries.empty()) {
+    if (error) *error = "apply_queries: no query provided";
+    return 0;
+  }
+  if (_nodes.empty() || (_nodes.at(0).type != YAML::NodeType::Sequence &&
+                         _nodes.at(0).type != YAML::NodeType::Map)) {
+    if (error)
+      *error =
+          "apply_queries: starting node not "
+          "Sequence or Map, cannot apply query \"" +
+          queries.at(0) + "\"";
+    return 0;
+  }
+  const indexed_node *current = &_nodes.at(0);
+  for (unsigned i = 0; i < queries.size(); ++i) {
+    if (current->type == YAML::NodeType::Scalar) {
+      if (error)
+        *error = "apply_queries: query \"" + queries.at(i - 1) +
+                 "\" found scalar terminator";
+      return 0;
+    }
+    std::map<std::string, unsigned>::const_iterator finder =
+        current->children.find(queries.at(i));
+    if (finder == current->children.end()) {
+      if (error)
+        *error = "apply_queries: query \"" + queries.at(i) +
+                 "\" not present at query level";
+      return 0;
+    }
+    current = &_nodes.at(finder->second);
+  }
   return current;
 }
 
-std::vector<std::pair<std::string, std::string> >
-initialize_output_directories::yaml_reader::get_map(
+const initialize_output_directories::yaml_reader::indexed_node &
+initialize_output_directories::yaml_reader::resolve(
     const std::vector<std::string> &queries) const {
-  YAML::Node current = YAML::Clone(_data), next;
-  std::vector<std::pair<std::string, std::string> > res;
-  apply_queries(queries, &current, &next);
-  if (current.Type() == YAML::NodeType::Map) {
-    res.reserve(current.size());
-    for (YAML::const_iterator iter = current.begin(); iter != current.end();
-         ++iter) {
-      std::pair<std::string, std::string> val(iter->first.as<std::string>(),
-                                              iter->second.as<std::string>());
-      res.push_back(val);
-    }
-  } else {
+  std::string error = "";
+  const indexed_node *res = lookup(queries, &error);
+  if (!res) throw std::runtime_error(error);
+  return *res;
+}
+
+std::string initialize_output_directories::yaml_reader::get_entry(
+    const std::vector<std::string> &queries) const {
+  const std::vector<std::string> &all_results = sequence_values(queries);
+  if (all_results.size() != 1) {
     throw std::runtime_error(
-        "get_value: query chain does not end in "
-        "compatible type");
+        "invalid number of results for entry query "
+        "ending in \"" +
+        *queries.rbegin() + "\": found " + std::to_string(all_results.size()));
   }
-  return res;
+  return *all_results.begin();
 }
 
-bool initialize_output_directories::yaml_reader::query_valid(
+const std::vector<std::string> &
+initialize_output_directories::yaml_reader::sequence_values(
     const std::vector<std::string> &queries) const {
-  YAML::Node current = YAML::Clone(_data), next;
-  try {
-    apply_queries(queries, &current, &next);
-  } catch (const std::runtime_error &e) {
-    return false;
+  const indexed_node &current = resolve(queries);
+  if (current.type != YAML::NodeType::Scalar &&
+      current.type != YAML::NodeType::Sequence) {
+    throw std::runtime_error(
+        "get_value: query chain does not end in "
+        "compatible type");
   }
-  return true;
+  if (!current.values_valid) {
+    throw std::runtime_error(
+        "get_value: sequence for query ending in \"" + *queries.rbegin() +
+        "\" contains non-scalar entries");
+  }
+  return current.values;
 }
 
-void initialize_output_directories::yaml_reader::apply_queries(
-    const std::vector<std::string> &queries, YAML::Node *current,
-    YAML::Node *next) const {
-  if (!current || !next)
-    throw std::runtime_error("apply_queries: null pointer");
-  if (queries.empty())
-    throw std::runtime_error("apply_queries: no query provided");
-  if (current->Type() != YAML::NodeType::Sequence &&
-      current->Type() != YAML::NodeType::Map) {
+const std::vector<std::pair<std::string, std::string> > &
+initialize_output_directories::yaml_reader::map_values(
+    const std::vector<std::string> &queries) const {
+  const indexed_node &current = resolve(queries);
+  if (current.type != YAML::NodeType::Map) {
     throw std::runtime_error(
-        "apply_queries: starting node not "
-        "Sequence or Map, cannot apply query \"" +
-        queries.at(0) + "\"");
+        "get_value: query chain does not end in "
+        "compatible type");
   }
-  for (unsigned i = 0; i < queries.size(); ++i) {
-    *next = (*current)[queries.at(i)];
-    switch (next->Type()) {
-      case YAML::NodeType::Null:
-        throw std::runtime_error("apply_queries: query \"" + queries.at(i) +
-                                 "\" not present at query level");
-      case YAML::NodeType::Scalar:
-        if (i != queries.size() - 1)
-          throw std::runtime_error("apply_queries: query \"" + queries.at(i) +
-                                   "\" found scalar terminator");
-        break;
-      case YAML::NodeType::Sequence:
-        break;
-      case YAML::NodeType::Map:
-        break;
-      case YAML::NodeType::Undefined:
-        throw std::runtime_error(
-            "apply_queries: Undefined node type encountered"
-            " for query \"" +
-            queries.at(i) + "\"");
-      default:
-        throw std::runtime_error("apply_queries: unrecognized node type?");
-    }
-    *current = *next;
+  if (!current.pairs_valid) {
+    throw std::runtime_error("get_value: map for query ending in \"" +
+                             *queries.rbegin() +
+                             "\" contains non-scalar entries");
   }
+  return current.pairs;
+}
+
+YAML::Node initialize_output_directories::yaml_reader::get_node(
+    const std::vector<std::string> &queries) const {
+  // validate against the index first, so errors match the other accessors
+  resolve(queries);
+  // reset() rebinds the handle; plain assignment would write through
+  // into the loaded document
+  YAML::Node current;
+  current.reset(_data);
+  for (std::vector<std::string>::const_iterator iter = queries.begin();
+       iter != queries.end(); ++iter) {
+    const YAML::Node &parent = current;
+    YAML::Node next = parent[*iter];
+    current.reset(next);
+  }
+  return current;
 }
@@ -8,6 +8,8 @@
 #ifndef INITIALIZE_OUTPUT_DIRECTORIES_YAML_READER_H_
 #define INITIALIZE_OUTPUT_DIRECTORIES_YAML_READER_H_
 
+#include <map>
+#include <stdexcept>
 #include <string>
 #include <utility>
 #include <vector>
@@ -15,6 +17,14 @@
 #include "yaml-cpp/yaml.h"
 
 namespace initialize_output_directories {
+/*!
+  \class yaml_reader
+  \brief read-only query interface for yaml config files
+
+  The document is flattened into an index of nodes once at load time.
+  Queries walk that index by key, so no part of the document is cloned
+  or reparsed per lookup.
+ */
 class yaml_reader {
  public:
   yaml_reader() {}
@@ -27,25 +37,16 @@ class yaml_reader {
     queries.push_back(query);
     return get_entry(queries);
   }
-  std::string get_entry(const std::vector<std::string> &queries) const {
-    std::vector<std::string> all_results;
-    all_results = get_sequence(queries);
-    if (all_results.size() != 1) {
-      throw std::runtime_error(
-          "invalid number of results for entry query "
-          "ending in \"" +
-          *queries.rbegin() + "\": found " +
-          std::to_string(all_results.size()));
-    }
-    return *all_results.begin();
-  }
+  std::string get_entry(const std::vector<std::string> &queries) const;
   std::vector<std::string> get_sequence(const std::string &query) const {
     std::vector<std::string> queries;
     queries.push_back(query);
     return get_sequence(queries);
   }
   std::vector<std::string> get_sequence(
-      const std::vector<std::string> &queries) const;
+      const std::vector<std::string> &queries) const {
+    return sequence_values(queries);
+  }
   std::vector<std::pair<std::string, std::string> > get_map(
       const std::string &query) const {
     std::vector<std::string> queries;
@@ -53,24 +54,92 @@ class yaml_reader {
     return get_map(queries);
   }
   std::vector<std::pair<std::string, std::string> > get_map(
-      const std::vector<std::string> &queries) const;
+      const std::vector<std::string> &queries) const {
+    return map_values(queries);
+  }
   YAML::Node get_node(const std::string &query) const {
     std::vector<std::string> queries;
     queries.push_back(query);
     return get_node(queries);
   }
+  /*!
+    \brief get a handle to the raw yaml node at the end of a query chain
+    @param queries chain of map keys
+    \return handle to the node within the loaded document
+
+    The handle refers to the loaded document itself; callers must not
+    modify it.
+   */
   YAML::Node get_node(const std::vector<std::string> &queries) const;
   bool query_valid(const std::string &query) const {
     std::vector<std::string> queries;
     queries.push_back(query);
     return query_valid(queries);
   }
-  bool query_valid(const std::vector<std::string> &queries) const;
+  bool query_valid(const std::vector<std::string> &queries) const {
+    return lookup(queries) != 0;
+  }
+  YAML::NodeType::value get_type(const std::string &query) const {
+    std::vector<std::string> queries;
+    queries.push_back(query);
+    return get_type(queries);
+  }
+  /*!
+    \brief get the yaml type of the node at the end of a query chain
+    @param queries chain of map keys
+    \return yaml node type
+
+    \warning throws exception if the query chain is not valid
+   */
+  YAML::NodeType::value get_type(
+      const std::vector<std::string> &queries) const {
+    return resolve(queries).type;
+  }
+  /*!
+    \brief get the scalar/sequence values at the end of a query chain
+    @param queries chain of map keys
+    \return reference to the indexed values, valid for the reader's lifetime
+
+    Same semantics as get_sequence, without copying the result.
+   */
+  const std::vector<std::string> &sequence_values(
+      const std::vector<std::string> &queries) const;
+  /*!
+    \brief get the key/value pairs at the end of a query chain
+    @param queries chain of map keys
+    \return reference to the indexed pairs, valid for the reader's lifetime
+
+    Same semantics as get_map, without copying the result.
+   */
+  const std::vector<std::pair<std::string, std::string> > &map_values(
+      const std::vector<std::string> &queries) const;
 
  private:
-  void apply_queries(const std::vector<std::string> &queries,
-                     YAML::Node *current, YAML::Node *next) const;
+  /*!
+    \brief flattened representation of a single yaml node
+
+    Scalar and sequence-of-scalar nodes carry their values; maps with
+    scalar values carry their pairs in document order. Map keys index
+    into the child nodes for query resolution.
+   */
+  struct indexed_node {
+    indexed_node()
+        : type(YAML::NodeType::Undefined),
+          values_valid(false),
+          pairs_valid(false) {}
+    YAML::NodeType::value type;
+    bool values_valid;
+    bool pairs_valid;
+    std::vector<std::string> values;
+    std::vector<std::pair<std::string, std::string> > pairs;
+    std::map<std::string, unsigned> children;
+  };
+  unsigned index_node(const YAML::Node &node);
+  const indexed_node *lookup(const std::vector<std::string> &queries,
+                             std::string *error = 0) const;
+  const indexed_node &resolve(const std::vector<std::string> &queries) const;
   YAML::Node _data;
+  std::vector<indexed_node> _nodes;
 };
 
 }  // namespace initialize_output_directories
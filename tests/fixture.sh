@@ -0,0 +1,76 @@
+#!/bin/bash
+# shared setup for tests against the small fixture in tests/data: a
+# 400 subject phenotype database, bgen sample files for six chip and
+# ancestry combinations (one too small for -N 10), and three configs:
+# quantitative (boltlmm), categorical with three comparisons (saige),
+# and binary, sex-specific with control filters (saige)
+PROGRAM_NAME=./initialize_output_directories.out
+EXTENSION_CONFIG=./extensions.config.yaml
+DATA_DIR=tests/data
+PHENOTYPE_DATABASE="$DATA_DIR/phenotypes.tsv"
+BGEN_DIR="$DATA_DIR/bgen"
+MIN_SAMPLE_SIZE=10
+CHECK_COUNT=0
+
+# run_config RESULTS CONFIG SOFTWARE DATABASE [ARGS...]: CONFIG is the
+# name of a fixture config, or the path to any other
+run_config() {
+    local results="$1" config="$2" software="$3" database="$4"
+    shift 4
+    if [[ "$config" != */* ]] ; then
+	config="$DATA_DIR/$config.config.yaml"
+    fi
+    "$PROGRAM_NAME" -e "$EXTENSION_CONFIG" -p "$config" -D "$database" -I plco_id -b "$BGEN_DIR" -r "$results" -s "$software" -N "$MIN_SAMPLE_SIZE" "$@"
+}
+
+# run_fixture RESULTS DATABASE [ARGS...]: every config, output concatenated
+run_fixture() {
+    local results="$1" database="$2"
+    shift 2
+    run_config "$results" bmi boltlmm "$database" "$@" &&
+	run_config "$results" balding_trend saige "$database" "$@" &&
+	run_config "$results" panc_cancer.female saige "$database" "$@"
+}
+
+# tree_contents DIR [PATTERN]: each file's path and contents, in path
+# order, skipping paths that match PATTERN (an extended regex)
+tree_contents() {
+    local dir="$1" skip="${2:-^$}"
+    (cd "$dir" && find . -type f -print | LC_ALL=C sort | grep -Ev "$skip" | while read -r file; do
+	echo "## $file"
+	cat "$file"
+    done)
+}
+
+# check DESCRIPTION COMMAND [ARGS...]: one test point, passing if the command does
+check() {
+    local description="$1"
+    shift
+    CHECK_COUNT=$((CHECK_COUNT + 1))
+    if "$@" > /dev/null 2>&1 ; then
+	echo "ok $CHECK_COUNT - $description"
+    else
+	echo "not ok $CHECK_COUNT - $description"
+    fi
+}
+
+# fails COMMAND [ARGS...]: whether the command exits with an error,
+# quietly, even if it aborts
+fails() {
+    ! ("$@") > /dev/null 2>&1
+}
+
+# skip DESCRIPTION REASON: a test point that cannot run here
+skip() {
+    CHECK_COUNT=$((CHECK_COUNT + 1))
+    echo "ok $CHECK_COUNT - $1 # SKIP $2"
+}
+
+# same FILE1 FILE2: whether two files are byte for byte identical
+same() {
+    cmp -s "$1" "$2"
+}
+
+finish() {
+    echo 1..$CHECK_COUNT
+}